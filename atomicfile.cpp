@@ -0,0 +1,126 @@
+#include "atomicfile.h"
+#include <QDir>
+#include <QFileInfo>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * umask は読むために一度書き換える必要があり、プロセス全体の設定のため作業者スレッドからは変更できない
+ * (その間に他のスレッドが作成したファイルのパーミッションが変わる)。
+ * 静的初期化(main() の前、スレッドの開始前)で1回だけ読んでおく。
+ */
+static mode_t readUmask()
+{
+    const mode_t mask = umask(0);
+    umask(mask);
+    return mask;
+}
+
+static const mode_t processUmask = readUmask();
+#endif
+
+AtomicFile::AtomicFile(const QString &fileName)
+{
+    /* シンボリックリンクはリンク先を置き換える */
+    QFileInfo info(fileName);
+    targetFileName = info.isSymLink() ? info.symLinkTarget() : info.absoluteFilePath();
+}
+
+AtomicFile::~AtomicFile()
+{
+    cancel();
+}
+
+bool AtomicFile::open()
+{
+    QFileInfo info(targetFileName);
+    tempFile.setFileTemplate(info.absolutePath() + QDir::separator() + "." + info.fileName() + ".XXXXXX");
+    if (!tempFile.open()) {
+        error = tempFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool AtomicFile::write(const QByteArray &data)
+{
+    if (tempFile.write(data) != data.size()) {
+        error = tempFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * 一時ファイルをディスクへ書き出してから閉じ、対象ファイルへ置き換える
+ * (置き換えた後に異常終了しても、内容の書き込まれていないファイルが残らないようにする)
+ */
+bool AtomicFile::commit()
+{
+    if (!tempFile.flush()) {
+        error = tempFile.errorString();
+        return false;
+    }
+
+    /* 既存ファイルのパーミッションを引き継ぐ(新規の場合は一時ファイルの0600ではなく通常の作成時と同じにする) */
+    if (QFile::exists(targetFileName)) {
+        tempFile.setPermissions(QFile::permissions(targetFileName));
+    } else {
+#ifdef Q_OS_WIN
+        tempFile.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);
+#else
+        fchmod(tempFile.handle(), 0666 & ~processUmask);
+#endif
+    }
+
+#ifndef Q_OS_WIN
+    if (fsync(tempFile.handle()) != 0) {
+        error = QObject::tr("一時ファイルをディスクへ書き込めませんでした: %1").arg(tempFile.fileName());
+        return false;
+    }
+#endif
+    const QString tempFileName = tempFile.fileName();
+    tempFile.close();
+
+#ifdef Q_OS_WIN
+    const QString from = QDir::toNativeSeparators(tempFileName);
+    const QString to = QDir::toNativeSeparators(targetFileName);
+
+    /* QTemporaryFile からはハンドルを取得できないため、開き直してディスクへ書き出す */
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t *>(from.utf16()), GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    const bool synced = handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
+    if (!synced) {
+        error = QObject::tr("一時ファイルをディスクへ書き込めませんでした: %1").arg(tempFileName);
+        tempFile.remove();
+        return false;
+    }
+    bool renamed = MoveFileExW(reinterpret_cast<const wchar_t *>(from.utf16()),
+                               reinterpret_cast<const wchar_t *>(to.utf16()),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    bool renamed = ::rename(QFile::encodeName(tempFileName).constData(),
+                            QFile::encodeName(targetFileName).constData()) == 0;
+#endif
+    if (!renamed) {
+        error = QObject::tr("一時ファイルを置き換えられませんでした: %1").arg(tempFileName);
+        tempFile.remove();
+        return false;
+    }
+    tempFile.setAutoRemove(false);
+    return true;
+}
+
+void AtomicFile::cancel()
+{
+    if (tempFile.isOpen()) {
+        tempFile.close();
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include <QTemporaryFile>
+
+/**
+ * 書き込み内容を同じディレクトリの一時ファイルへ出力し、
+ * commit()で対象ファイルへ置き換える(途中で失敗しても元のファイルは壊れない)
+ */
+class AtomicFile
+{
+public:
+    explicit AtomicFile(const QString &fileName);
+    ~AtomicFile();
+    bool open();
+    bool write(const QByteArray &data);
+    bool commit();
+    void cancel();
+    QString fileName() const { return targetFileName; }
+    QString errorString() const { return error; }
+
+private:
+    QString targetFileName;
+    QTemporaryFile tempFile;
+    QString error;
+};
+
+#endif // ATOMICFILE_H
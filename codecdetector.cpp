@@ -0,0 +1,364 @@
+#include "codecdetector.h"
+#include <QFile>
+#include <QTextCodec>
+#include <string.h>
+
+/**
+ * ASCII(0x00-0x7F)が続く間を読み飛ばし、最初の非ASCIIバイトの位置を返す
+ * 境界合わせの後はワード単位で上位ビットをまとめて検査する
+ */
+static const uchar *skipAscii(const uchar *p, const uchar *end)
+{
+    while (p < end && (reinterpret_cast<quintptr>(p) & (sizeof(quintptr) - 1))) {
+        if (*p >= 0x80) {
+            return p;
+        }
+        ++p;
+    }
+
+    const quintptr mask = static_cast<quintptr>(Q_UINT64_C(0x8080808080808080));
+    while (end - p >= static_cast<int>(sizeof(quintptr))) {
+        quintptr word;
+        memcpy(&word, p, sizeof(word));
+        if (word & mask) {
+            break;
+        }
+        p += sizeof(quintptr);
+    }
+
+    while (p < end && *p < 0x80) {
+        ++p;
+    }
+    return p;
+}
+
+/**
+ * ファイルの先頭と末尾の一部分だけを読み込んで判定する
+ * マップできない場合は読込み位置を進めないpeekで先頭のみを使用する
+ */
+CodecDetector::Result CodecDetector::detect(QFile &file, QTextCodec *defaultCodec)
+{
+    const qint64 size = file.size();
+    const qint64 headSize = qMin<qint64>(size, SAMPLE_HEAD_SIZE);
+    QByteArray head;
+    QByteArray tail;
+
+    uchar *map = headSize > 0 ? file.map(0, headSize) : 0;
+    if (map) {
+        head = QByteArray(reinterpret_cast<const char *>(map), static_cast<int>(headSize));
+        file.unmap(map);
+
+        if (size > headSize) {
+            const qint64 tailOffset = qMax(headSize, size - SAMPLE_TAIL_SIZE);
+            map = file.map(tailOffset, size - tailOffset);
+            if (map) {
+                tail = QByteArray(reinterpret_cast<const char *>(map), static_cast<int>(size - tailOffset));
+                file.unmap(map);
+            }
+        }
+    } else {
+        head = file.peek(headSize);
+    }
+
+    return detect(head, tail, defaultCodec);
+}
+
+CodecDetector::Result CodecDetector::detect(const QByteArray &head, const QByteArray &tail, QTextCodec *defaultCodec)
+{
+    Result result;
+    result.codec = defaultCodec ? defaultCodec : QTextCodec::codecForLocale();
+    result.confidence = 0;
+    result.newLineCode = TextEditor::NewLineCodeUnknown;
+    result.crCount = 0;
+    result.lfCount = 0;
+    result.crlfCount = 0;
+
+    /* BOM付きのUTF-16/32は文字単位で改行を数える */
+    QTextCodec *bomCodec = QTextCodec::codecForUtfText(head, 0);
+    if (bomCodec) {
+        result.codec = bomCodec;
+        result.confidence = 100;
+        countNewLines(bomCodec->toUnicode(head), result);
+    } else {
+        /* 末尾の窓は文字の途中から始まるため、最初の改行の直後から判定する */
+        const int tailOffset = resyncOffset(tail.constData(), tail.size());
+        const char *tailData = tail.constData() + tailOffset;
+        const int tailSize = tail.size() - tailOffset;
+
+        countNewLines(head.constData(), head.size(), result);
+        countNewLines(tailData, tailSize, result);
+
+        if (isAscii(head.constData(), head.size()) && isAscii(tailData, tailSize)) {
+            /* ASCIIのみの場合はデフォルト文字コードで問題ない */
+            result.confidence = 100;
+        } else {
+            Score utf8 = { 0, 0, 0 };
+            Score sjis = { 0, 0, 0 };
+            Score euc = { 0, 0, 0 };
+            scoreUtf8(head.constData(), head.size(), utf8);
+            scoreUtf8(tailData, tailSize, utf8);
+            scoreShiftJis(head.constData(), head.size(), sjis);
+            scoreShiftJis(tailData, tailSize, sjis);
+            scoreEucJp(head.constData(), head.size(), euc);
+            scoreEucJp(tailData, tailSize, euc);
+
+            /* 同点の場合はUTF-8、EUC-JP、Shift_JISの順に優先する */
+            const char *name = "UTF-8";
+            int best = confidence(utf8);
+            if (confidence(euc) > best) {
+                name = "EUC-JP";
+                best = confidence(euc);
+            }
+            if (confidence(sjis) > best) {
+                name = "Shift_JIS";
+                best = confidence(sjis);
+            }
+
+            QTextCodec *codec = QTextCodec::codecForName(name);
+            if (codec && best >= CONFIDENCE_THRESHOLD) {
+                result.codec = codec;
+            }
+            result.confidence = best;
+        }
+    }
+
+    /* 最も多く使われている改行コードを採用する */
+    if (result.crlfCount > 0
+            && result.crlfCount >= result.lfCount && result.crlfCount >= result.crCount) {
+        result.newLineCode = TextEditor::NewLineCodeCRLF;
+    } else if (result.lfCount > 0 && result.lfCount >= result.crCount) {
+        result.newLineCode = TextEditor::NewLineCodeLF;
+    } else if (result.crCount > 0) {
+        result.newLineCode = TextEditor::NewLineCodeCR;
+    }
+
+    return result;
+}
+
+bool CodecDetector::isAscii(const char *data, int size)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    return skipAscii(p, p + size) == p + size;
+}
+
+/**
+ * CR、LF、CR+LFの数をmemchrで数える
+ */
+void CodecDetector::countNewLines(const char *data, int size, Result &result)
+{
+    const char *end = data + size;
+    const char *p = data;
+    int lf = 0;
+    int cr = 0;
+    int crlf = 0;
+
+    while (p < end && (p = static_cast<const char *>(memchr(p, '\n', end - p)))) {
+        ++lf;
+        ++p;
+    }
+
+    p = data;
+    while (p < end && (p = static_cast<const char *>(memchr(p, '\r', end - p)))) {
+        if (p + 1 < end && p[1] == '\n') {
+            ++crlf;
+        } else {
+            ++cr;
+        }
+        ++p;
+    }
+
+    result.crlfCount += crlf;
+    result.lfCount += lf - crlf;
+    result.crCount += cr;
+}
+
+void CodecDetector::countNewLines(const QString &text, Result &result)
+{
+    const QChar *p = text.constData();
+    const QChar *end = p + text.size();
+
+    for (; p < end; ++p) {
+        if (*p == QLatin1Char('\r')) {
+            if (p + 1 < end && p[1] == QLatin1Char('\n')) {
+                ++result.crlfCount;
+                ++p;
+            } else {
+                ++result.crCount;
+            }
+        } else if (*p == QLatin1Char('\n')) {
+            ++result.lfCount;
+        }
+    }
+}
+
+/**
+ * 判定を開始する位置(最初の改行の直後)を返す
+ * Shift_JISとEUC-JPの2バイト目に改行コードは現れないため、どの文字コードでも文字の境界になる
+ */
+int CodecDetector::resyncOffset(const char *data, int size)
+{
+    const char *p = static_cast<const char *>(memchr(data, '\n', size));
+    return p ? static_cast<int>(p - data) + 1 : size;
+}
+
+/**
+ * UTF-8として妥当なバイト列か検査する
+ * 冗長な表現とサロゲートは不正として扱う
+ */
+void CodecDetector::scoreUtf8(const char *data, int size, Score &score)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            p = skipAscii(p, end);
+            continue;
+        }
+
+        int length;
+        uchar min = 0x80;
+        uchar max = 0xBF;
+        if (*p >= 0xC2 && *p <= 0xDF) {
+            length = 2;
+        } else if (*p >= 0xE0 && *p <= 0xEF) {
+            length = 3;
+            if (*p == 0xE0) {
+                min = 0xA0;
+            } else if (*p == 0xED) {
+                max = 0x9F;
+            }
+        } else if (*p >= 0xF0 && *p <= 0xF4) {
+            length = 4;
+            if (*p == 0xF0) {
+                min = 0x90;
+            } else if (*p == 0xF4) {
+                max = 0x8F;
+            }
+        } else {
+            ++score.errors;
+            ++p;
+            continue;
+        }
+
+        /* 窓の終端で途切れた文字は判定しない */
+        if (end - p < length) {
+            break;
+        }
+
+        bool valid = p[1] >= min && p[1] <= max;
+        for (int i = 2; valid && i < length; ++i) {
+            valid = (p[i] & 0xC0) == 0x80;
+        }
+        if (valid) {
+            ++score.chars;
+            p += length;
+        } else {
+            ++score.errors;
+            ++p;
+        }
+    }
+}
+
+/**
+ * Shift_JISとして妥当なバイト列か検査する
+ * 半角カナは通常の文章では少ないため、多い場合は確度を下げる
+ */
+void CodecDetector::scoreShiftJis(const char *data, int size, Score &score)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            p = skipAscii(p, end);
+            continue;
+        }
+
+        if (*p >= 0xA1 && *p <= 0xDF) {
+            ++score.chars;
+            ++score.rareChars;
+            ++p;
+        } else if ((*p >= 0x81 && *p <= 0x9F) || (*p >= 0xE0 && *p <= 0xFC)) {
+            if (end - p < 2) {
+                break;
+            }
+            if ((p[1] >= 0x40 && p[1] <= 0x7E) || (p[1] >= 0x80 && p[1] <= 0xFC)) {
+                ++score.chars;
+                p += 2;
+            } else {
+                ++score.errors;
+                ++p;
+            }
+        } else {
+            ++score.errors;
+            ++p;
+        }
+    }
+}
+
+/**
+ * EUC-JPとして妥当なバイト列か検査する
+ * 半角カナ(SS2)と補助漢字(SS3)は通常の文章では少ないため、多い場合は確度を下げる
+ */
+void CodecDetector::scoreEucJp(const char *data, int size, Score &score)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+
+    while (p < end) {
+        if (*p < 0x80) {
+            p = skipAscii(p, end);
+            continue;
+        }
+
+        int length;
+        bool rare = false;
+        if (*p == 0x8E) {
+            length = 2;
+            rare = true;
+        } else if (*p == 0x8F) {
+            length = 3;
+            rare = true;
+        } else if (*p >= 0xA1 && *p <= 0xFE) {
+            length = 2;
+        } else {
+            ++score.errors;
+            ++p;
+            continue;
+        }
+
+        if (end - p < length) {
+            break;
+        }
+
+        bool valid = *p == 0x8E ? (p[1] >= 0xA1 && p[1] <= 0xDF) : (p[1] >= 0xA1 && p[1] <= 0xFE);
+        if (valid && length == 3) {
+            valid = p[2] >= 0xA1 && p[2] <= 0xFE;
+        }
+        if (valid) {
+            ++score.chars;
+            if (rare) {
+                ++score.rareChars;
+            }
+            p += length;
+        } else {
+            ++score.errors;
+            ++p;
+        }
+    }
+}
+
+/**
+ * 妥当な文字の割合から確度(0-100)を求める
+ * 不正なバイト列は妥当な文字よりも重く扱う
+ */
+int CodecDetector::confidence(const Score &score)
+{
+    const int valid = score.chars - score.rareChars / 2;
+    const int total = score.chars + score.errors * 8;
+    if (valid <= 0 || total <= 0) {
+        return 0;
+    }
+    return static_cast<int>(static_cast<qint64>(valid) * 100 / total);
+}
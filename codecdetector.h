@@ -0,0 +1,51 @@
+#ifndef CODECDETECTOR_H
+#define CODECDETECTOR_H
+
+#include "texteditor.h"
+
+class QFile;
+class QTextCodec;
+
+/**
+ * ファイルの生バイト列から文字コードと改行コードを判定する
+ */
+class CodecDetector
+{
+public:
+    enum {
+        SAMPLE_HEAD_SIZE = 64 * 1024,       // 判定に使用する先頭のサイズ
+        SAMPLE_TAIL_SIZE = 16 * 1024,       // 判定に使用する末尾のサイズ
+        CONFIDENCE_THRESHOLD = 60           // これ未満はデフォルト文字コードを使用する
+    };
+
+    typedef struct tagResult {
+        QTextCodec *codec;                  // 文字コード
+        int confidence;                     // 文字コードの確度(0-100)
+        TextEditor::NewLineCode newLineCode;// 改行コード
+        int crCount;                        // CRのみの改行数
+        int lfCount;                        // LFのみの改行数
+        int crlfCount;                      // CR+LFの改行数
+    } Result;
+
+public:
+    static Result detect(QFile &file, QTextCodec *defaultCodec);
+    static Result detect(const QByteArray &head, const QByteArray &tail, QTextCodec *defaultCodec);
+
+private:
+    typedef struct tagScore {
+        int chars;                          // マルチバイト文字数
+        int rareChars;                      // 通常の文章で使われにくい文字数
+        int errors;                         // 不正なバイト列の数
+    } Score;
+
+    static bool isAscii(const char *data, int size);
+    static void countNewLines(const char *data, int size, Result &result);
+    static void countNewLines(const QString &text, Result &result);
+    static int resyncOffset(const char *data, int size);
+    static void scoreUtf8(const char *data, int size, Score &score);
+    static void scoreShiftJis(const char *data, int size, Score &score);
+    static void scoreEucJp(const char *data, int size, Score &score);
+    static int confidence(const Score &score);
+};
+
+#endif // CODECDETECTOR_H
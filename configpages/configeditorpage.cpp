@@ -97,6 +97,7 @@ ConfigEditorPage::ConfigEditorPage(QWidget *parent) :
     connect(ui->endOfFileVisible, SIGNAL(clicked(bool)), this, SLOT(endOfFileVisibleChanged(bool)));
     connect(ui->endOfFileChar, SIGNAL(textChanged(QString)), this, SLOT(endOfFileCharChanged(QString)));
     connect(ui->defTextCodecName, SIGNAL(currentIndexChanged(QString)), this, SLOT(defTextCodecNameChanged(QString)));
+    connect(ui->largeFileSize, SIGNAL(valueChanged(int)), this, SLOT(largeFileSizeChanged(int)));
     connect(ui->textFormats, SIGNAL(currentItemChanged(QListWidgetItem*,QListWidgetItem*)), this, SLOT(textFormatItemChanged(QListWidgetItem*)));
     connect(ui->textFormats, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(textFormatItemChanged(QListWidgetItem*)));
     connect(ui->textFormatEnabled, SIGNAL(toggled(bool)), this, SLOT(textFormatEnabledChanged()));
@@ -547,6 +548,15 @@ void ConfigEditorPage::defTextCodecNameChanged(QString textCodecName)
     settings.endGroup();
 }
 
+void ConfigEditorPage::largeFileSizeChanged(int size)
+{
+    const TextEditor::ConfigType &config_type = currentConfigType();
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "MyEditor", "Editor");
+    settings.beginGroup(config_type.key);
+    settings.setValue("largeFileSize", size);
+    settings.endGroup();
+}
+
 void ConfigEditorPage::textFormatItemChanged(QListWidgetItem *current_item)
 {
     EditorFormatItem *item = dynamic_cast<EditorFormatItem *>(current_item);
@@ -1384,6 +1394,7 @@ void ConfigEditorPage::updateLayout()
 void ConfigEditorPage::updateBehavior()
 {
     ui->defTextCodecName->setCurrentIndex(ui->defTextCodecName->findText(configs.defTextCodecName));
+    ui->largeFileSize->setValue(configs.largeFileSize);
 }
 
 void ConfigEditorPage::updatedTextFormats()
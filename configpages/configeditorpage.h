@@ -62,6 +62,7 @@ private slots:
     void endOfFileVisibleChanged(bool visible);
     void endOfFileCharChanged(const QString &text);
     void defTextCodecNameChanged(QString textCodecName);
+    void largeFileSizeChanged(int size);
     void textFormatItemChanged(QListWidgetItem *item);
     void textFormatEnabledChanged();
     void textFormatNameChanged();
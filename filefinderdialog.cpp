@@ -0,0 +1,100 @@
+#include "filefinderdialog.h"
+#include "ui_filefinderdialog.h"
+#include <QDir>
+#include <QKeyEvent>
+#include <QtConcurrentRun>
+
+FileFinderDialog::FileFinderDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::FileFinderDialog)
+{
+    ui->setupUi(this);
+    ui->pattern->installEventFilter(this);
+
+    connect(ui->pattern, SIGNAL(textChanged(QString)), this, SLOT(updateFileList()));
+    connect(ui->pattern, SIGNAL(returnPressed()), this, SLOT(accept()));
+    connect(ui->fileList, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(accept()));
+    connect(&listWatcher, SIGNAL(finished()), this, SLOT(filesListed()));
+}
+
+FileFinderDialog::~FileFinderDialog()
+{
+    listCancelled.fetchAndStoreOrdered(1);
+    listWatcher.waitForFinished();
+    delete ui;
+}
+
+/**
+ * 検索するディレクトリを設定し、ファイル名の走査を開始する
+ * 走査が終わるまではGrepの索引に記録されたファイル名の一覧を表示する
+ */
+void FileFinderDialog::setDirPath(const QString &dirPath)
+{
+    this->dirPath = QDir(dirPath).absolutePath();
+    setWindowTitle(tr("ファイル名で開く - %1").arg(QDir::toNativeSeparators(this->dirPath)));
+
+    TrigramIndex index;
+    if (index.open(this->dirPath)) {
+        files = index.relativeFilePaths();
+    } else {
+        files.clear();
+    }
+    updateFileList();
+    ui->status->setText(tr("ファイル名を検索中..."));
+
+    listCancelled.fetchAndStoreOrdered(1);
+    listWatcher.waitForFinished();
+    listCancelled.fetchAndStoreOrdered(0);
+    listWatcher.setFuture(QtConcurrent::run(&TrigramIndex::listFiles, this->dirPath, &listCancelled));
+}
+
+QString FileFinderDialog::selectedFile() const
+{
+    const QListWidgetItem *item = ui->fileList->currentItem();
+    return item ? item->data(Qt::UserRole).toString() : QString();
+}
+
+void FileFinderDialog::updateFileList()
+{
+    ui->fileList->clear();
+    const QDir dir(dirPath);
+    foreach (int id, TrigramIndex::findFiles(files, ui->pattern->text(), MAX_RESULTS)) {
+        QListWidgetItem *item = new QListWidgetItem(QDir::toNativeSeparators(files.at(id)), ui->fileList);
+        item->setData(Qt::UserRole, dir.absoluteFilePath(files.at(id)));
+    }
+    ui->fileList->setCurrentRow(0);
+    ui->status->setText(tr("%1ファイル").arg(files.size()));
+}
+
+void FileFinderDialog::accept()
+{
+    if (selectedFile().isEmpty()) {
+        return;
+    }
+    QDialog::accept();
+}
+
+void FileFinderDialog::filesListed()
+{
+    if (listCancelled.fetchAndAddOrdered(0)) {
+        return;
+    }
+    files = listWatcher.result();
+    updateFileList();
+}
+
+/**
+ * 入力欄で上下キーを押した場合は一覧の選択を移動する
+ */
+bool FileFinderDialog::eventFilter(QObject *object, QEvent *event)
+{
+    if (object == ui->pattern && event->type() == QEvent::KeyPress) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        if (keyEvent->key() == Qt::Key_Up || keyEvent->key() == Qt::Key_Down
+                || keyEvent->key() == Qt::Key_PageUp || keyEvent->key() == Qt::Key_PageDown) {
+            QCoreApplication::sendEvent(ui->fileList, event);
+            return true;
+        }
+    }
+    return QDialog::eventFilter(object, event);
+}
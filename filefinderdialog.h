@@ -0,0 +1,48 @@
+#ifndef FILEFINDERDIALOG_H
+#define FILEFINDERDIALOG_H
+
+#include <QDialog>
+#include <QFutureWatcher>
+#include "trigramindex.h"
+
+namespace Ui {
+    class FileFinderDialog;
+}
+
+/**
+ * ファイル名のあいまい検索で開くファイルを選ぶダイアログ
+ * Grep のトライグラム索引があればそのファイル名の一覧をすぐに表示し、
+ * 別スレッドでファイル名だけを走査した一覧に置き換える(ファイルの内容は読まない)
+ */
+class FileFinderDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    enum { MAX_RESULTS = 200 };
+
+public:
+    explicit FileFinderDialog(QWidget *parent = 0);
+    ~FileFinderDialog();
+    void setDirPath(const QString &dirPath);
+    QString selectedFile() const;
+
+public slots:
+    void updateFileList();
+    void accept();
+
+private slots:
+    void filesListed();
+
+protected:
+    bool eventFilter(QObject *object, QEvent *event);
+
+private:
+    Ui::FileFinderDialog *ui;
+    QString dirPath;
+    QStringList files;                      // 相対パスの一覧
+    QFutureWatcher<QStringList> listWatcher;
+    QAtomicInt listCancelled;
+};
+
+#endif // FILEFINDERDIALOG_H
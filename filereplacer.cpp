@@ -0,0 +1,258 @@
+#include "filereplacer.h"
+#include "atomicfile.h"
+#include "codecdetector.h"
+#include "grepengine.h"
+#include "regexpcache.h"
+#include <QFile>
+#include <QTextCodec>
+#include <QtConcurrentMap>
+#include <string.h>
+
+/**
+ * 1ファイルを置換する関数オブジェクト(QtConcurrent::mapped に渡す)
+ */
+class ReplaceFileFunctor
+{
+public:
+    typedef FileReplacer::Result result_type;
+
+    ReplaceFileFunctor(const QRegExp &regexp, const QString &literal, const QString &after,
+                       bool regularExpression, QTextCodec *defaultCodec, bool write)
+        : regexp(regexp), literal(literal), after(after),
+          regularExpression(regularExpression), defaultCodec(defaultCodec), write(write)
+    {
+    }
+
+    FileReplacer::Result operator()(const QString &filePath) const
+    {
+        return FileReplacer::replaceFile(filePath, regexp, literal, after, regularExpression, defaultCodec, write);
+    }
+
+private:
+    QRegExp regexp;
+    QString literal;
+    QString after;
+    bool regularExpression;
+    QTextCodec *defaultCodec;
+    bool write;
+};
+
+/* 出力内容を溜め、一定量を超えたら一時ファイルへ書き込む */
+static bool appendOutput(AtomicFile &out, QByteArray &buffer, const char *begin, const char *end)
+{
+    buffer.append(begin, static_cast<int>(end - begin));
+    if (buffer.size() < FileReplacer::WRITE_CHUNK_SIZE) {
+        return true;
+    }
+    const bool ok = out.write(buffer);
+    buffer.clear();
+    return ok;
+}
+
+FileReplacer::FileReplacer(QObject *parent) :
+    QObject(parent),
+    writing(false)
+{
+    connect(&watcher, SIGNAL(finished()), this, SLOT(mapFinished()));
+}
+
+FileReplacer::~FileReplacer()
+{
+    watcher.cancel();
+    watcher.waitForFinished();
+}
+
+/**
+ * 置換する数を数える(結果は previewFinished() で通知する)
+ */
+bool FileReplacer::preview(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after, QTextCodec *defaultCodec)
+{
+    return start(files, keyword, after, defaultCodec, false);
+}
+
+/**
+ * 置換してファイルを書き換える(結果は applyFinished() で通知する)
+ */
+bool FileReplacer::apply(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after, QTextCodec *defaultCodec)
+{
+    return start(files, keyword, after, defaultCodec, true);
+}
+
+/**
+ * 中止する(書き換え中のファイルは最後まで処理し、未処理のファイルは変更しない)
+ */
+void FileReplacer::cancel()
+{
+    watcher.cancel();
+}
+
+bool FileReplacer::start(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after,
+                         QTextCodec *defaultCodec, bool write)
+{
+    if (isRunning() || keyword.text.isEmpty()) {
+        return false;
+    }
+    bool rejected = false;
+    const QRegExp regexp = RegExpCache::regExp(keyword.text, keyword.option, &rejected);
+    if (rejected) {
+        return false;
+    }
+
+    writing = write;
+    watcher.setFuture(QtConcurrent::mapped(files, ReplaceFileFunctor(regexp, GrepEngine::requiredLiteral(keyword), after,
+                                                                     keyword.option.regularExpression, defaultCodec, write)));
+    return true;
+}
+
+void FileReplacer::mapFinished()
+{
+    const QVector<Result> results = QVector<Result>::fromList(watcher.future().results());
+    if (writing) {
+        emit applyFinished(results, watcher.isCanceled());
+    } else {
+        emit previewFinished(results, watcher.isCanceled());
+    }
+}
+
+/**
+ * ファイルを置換する(write が偽の場合は数えるだけ)
+ * 絞り込み用の文字列がある場合はそのバイト列を含む行だけをデコードする。
+ * 置換した行だけを元の文字コードでエンコードし直し、それ以外(改行コード・BOMを含む)は元のバイト列を書き出す。
+ */
+FileReplacer::Result FileReplacer::replaceFile(const QString &filePath, QRegExp regexp, const QString &literal, const QString &after,
+                                               bool regularExpression, QTextCodec *defaultCodec, bool write)
+{
+    Result result;
+    result.filePath = filePath;
+    result.count = 0;
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly)) {
+        result.error = file.errorString();
+        return result;
+    }
+    const qint64 fileSize = file.size();
+    if (fileSize <= 0) {
+        return result;
+    }
+
+    /* マップできない場合(特殊ファイルなど)はまとめて読み込む */
+    QByteArray buffer;
+    uchar *mapped = file.map(0, fileSize);
+    const char *data = reinterpret_cast<const char *>(mapped);
+    qint64 size = fileSize;
+    if (!data) {
+        buffer = file.readAll();
+        data = buffer.constData();
+        size = buffer.size();
+    }
+    if (memchr(data, 0, qMin<qint64>(size, GrepEngine::BINARY_CHECK_SIZE))) {
+        return result;
+    }
+    const char *end = data + size;
+
+    const int headSize = static_cast<int>(qMin<qint64>(size, CodecDetector::SAMPLE_HEAD_SIZE));
+    const int tailSize = static_cast<int>(qMin<qint64>(size - headSize, CodecDetector::SAMPLE_TAIL_SIZE));
+    const CodecDetector::Result detected = CodecDetector::detect(QByteArray::fromRawData(data, headSize),
+                                                                 QByteArray::fromRawData(end - tailSize, tailSize),
+                                                                 defaultCodec);
+    QTextCodec *codec = detected.codec;
+    const QByteArray literalBytes = literal.isEmpty() ? QByteArray() : codec->fromUnicode(literal);
+    const bool caseSensitive = regexp.caseSensitivity() == Qt::CaseSensitive;
+
+    /* BOMはデコード時に除かれるため、行の内容に含めない */
+    const char *textBegin = data;
+    if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        textBegin += 3;
+    }
+
+    AtomicFile out(filePath);
+    bool opened = false;
+    QByteArray output;
+    const char *copied = data;              // 出力済みの位置
+    const char *p = textBegin;
+    while (p < end && result.error.isEmpty()) {
+        const char *lineBegin = p;
+        if (!literalBytes.isEmpty()) {
+            const char *hit = GrepEngine::findLiteral(p, end, literalBytes, caseSensitive);
+            if (!hit) {
+                break;
+            }
+            lineBegin = hit;
+            while (lineBegin > p && lineBegin[-1] != '\n') {
+                --lineBegin;
+            }
+        }
+        const char *lineEnd = reinterpret_cast<const char *>(memchr(lineBegin, '\n', end - lineBegin));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        p = lineEnd + 1;
+        const char *contentEnd = lineEnd;
+        if (contentEnd > lineBegin && contentEnd[-1] == '\r') {
+            --contentEnd;
+        }
+
+        const QString text = codec->toUnicode(lineBegin, static_cast<int>(contentEnd - lineBegin));
+        QString replaced;
+        int count = 0;
+        int last = 0;                       // 置換後の文字列へ複製済みの位置
+        int offset = 0;
+        while (offset <= text.size()) {
+            const int index = regexp.indexIn(text, offset);
+            if (index < 0) {
+                break;
+            }
+            const int length = regexp.matchedLength();
+            if (write) {
+                replaced.append(text.midRef(last, index - last));
+                replaced.append(TextEditor::replacementText(regexp, after, regularExpression));
+            }
+            last = index + length;
+            offset = index + qMax(1, length);
+            ++count;
+        }
+        if (count == 0) {
+            continue;
+        }
+        result.count += count;
+        if (!write) {
+            continue;
+        }
+
+        /* 最初に置換する行が見つかった時点で一時ファイルを作成する */
+        if (!opened) {
+            if (!out.open()) {
+                result.error = out.errorString();
+                break;
+            }
+            opened = true;
+        }
+        replaced.append(text.midRef(last));
+        const QByteArray encoded = codec->fromUnicode(replaced);
+        if (!appendOutput(out, output, copied, lineBegin)
+                || !appendOutput(out, output, encoded.constData(), encoded.constData() + encoded.size())) {
+            result.error = out.errorString();
+            break;
+        }
+        copied = contentEnd;
+    }
+
+    if (!write || result.count == 0 || !result.error.isEmpty()) {
+        return result;
+    }
+    if (!appendOutput(out, output, copied, end) || !out.write(output)) {
+        result.error = out.errorString();
+        return result;
+    }
+
+    /* 置き換える前に元のファイルを閉じる(マップしたままでは置き換えられない環境がある) */
+    if (mapped) {
+        file.unmap(mapped);
+    }
+    file.close();
+    if (!out.commit()) {
+        result.error = out.errorString();
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef FILEREPLACER_H
+#define FILEREPLACER_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QRegExp>
+#include <QStringList>
+#include <QVector>
+#include "texteditor.h"
+
+class QTextCodec;
+
+/**
+ * ファイル内の一致する文字列の一括置換(エディタで開かずに書き換える)
+ *
+ * ファイル毎に別スレッドで処理する。ファイルはメモリマップして行単位に読み、検索文字列のバイト列を含む行だけを
+ * 判定した文字コードでデコードして置換する。一致しない行は元のバイト列のまま書き出すため、改行コードやBOM、
+ * デコードできないバイト列も変わらない。書き込みは AtomicFile の一時ファイルへ順に出力してから置き換える。
+ * preview() は書き込まずに置換する数だけを数える。
+ */
+class FileReplacer : public QObject
+{
+    Q_OBJECT
+public:
+    enum {
+        WRITE_CHUNK_SIZE = 256 * 1024       // 一時ファイルへまとめて書き込むサイズ
+    };
+
+    typedef struct tagResult {
+        QString filePath;
+        int count;                          // 置換した(置換する)数
+        QString error;                      // 失敗した場合の理由
+    } Result;
+
+public:
+    explicit FileReplacer(QObject *parent = 0);
+    ~FileReplacer();
+    bool preview(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after, QTextCodec *defaultCodec);
+    bool apply(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after, QTextCodec *defaultCodec);
+    bool isRunning() const { return watcher.isRunning(); }
+    static Result replaceFile(const QString &filePath, QRegExp regexp, const QString &literal, const QString &after,
+                              bool regularExpression, QTextCodec *defaultCodec, bool write);
+
+public slots:
+    void cancel();
+
+signals:
+    void previewFinished(const QVector<FileReplacer::Result> &results, bool cancelled);
+    void applyFinished(const QVector<FileReplacer::Result> &results, bool cancelled);
+
+private slots:
+    void mapFinished();
+
+private:
+    bool start(const QStringList &files, const TextEditor::KeywordData &keyword, const QString &after,
+               QTextCodec *defaultCodec, bool write);
+
+private:
+    QFutureWatcher<Result> watcher;
+    bool writing;                           // 実行中の処理が書き込みを行う
+};
+
+#endif // FILEREPLACER_H
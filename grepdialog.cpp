@@ -1,3 +1,4 @@
+#include <QtGui>
 #include "grepdialog.h"
 #include "ui_grepdialog.h"
 
@@ -7,9 +8,27 @@ GrepDialog::GrepDialog(QWidget *parent) :
 {
     ui->setupUi(this);
 
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "MyEditor", "Geometry");
+    settings.beginGroup("GrepDialog");
+
+    restoreGeometry(settings.value("GrepDialog").toByteArray());
+    ui->findText->addItems(settings.value("findText").toStringList());
+    ui->filterText->addItems(settings.value("filterText", QStringList() << "*.c;*.cpp;*.h").toStringList());
+    ui->directoryPath->addItems(settings.value("directoryPath").toStringList());
+    ui->mode->setCurrentIndex(settings.value("mode", MODE_CURRENT_WINDOW).toInt());
+    ui->subDirTarget->setChecked(settings.value("subDirTarget", true).toBool());
+    ui->defaultCurrentDir->setChecked(settings.value("defaultCurrentDir", true).toBool());
+    ui->caseSensitively->setChecked(settings.value("caseSensitively", false).toBool());
+    ui->wholeWords->setChecked(settings.value("wholeWords", false).toBool());
+    ui->expr->setChecked(settings.value("regularExpression", false).toBool());
+    ui->findkeep->setChecked(settings.value("findkeep", true).toBool());
+    ui->output->setCurrentIndex(settings.value("output", OUTPUT_WIDGET).toInt());
+
     updateMode(ui->mode->currentIndex());
 
     connect(ui->mode, SIGNAL(currentIndexChanged(int)), this, SLOT(updateMode(int)));
+    connect(ui->backward, SIGNAL(clicked()), this, SLOT(startGrep()));
+    connect(ui->dirRef, SIGNAL(clicked()), this, SLOT(selectDir()));
 }
 
 GrepDialog::~GrepDialog()
@@ -35,3 +54,116 @@ void GrepDialog::updateMode(MODE mode)
 
     resize(0, 0);
 }
+
+void GrepDialog::setText(const QString &text)
+{
+    ui->findText->setEditText(text);
+}
+
+/**
+ * カレントディレクトリを検索対象の初期値にする(設定されている場合、または未入力の場合)
+ */
+void GrepDialog::setDefaultDirPath(const QString &dirPath)
+{
+    if (dirPath.isEmpty()) {
+        return;
+    }
+    if (ui->defaultCurrentDir->isChecked() || ui->directoryPath->currentText().isEmpty()) {
+        ui->directoryPath->setEditText(QDir::toNativeSeparators(dirPath));
+    }
+}
+
+void GrepDialog::startGrep()
+{
+    GrepParam param;
+    param.data.text = ui->findText->currentText();
+    param.data.option.caseSensitive = ui->caseSensitively->isChecked();
+    param.data.option.wholeWords = ui->wholeWords->isChecked();
+    param.data.option.regularExpression = ui->expr->isChecked();
+    param.data.highlightIndex = 0;
+    param.mode = static_cast<MODE>(ui->mode->currentIndex());
+    param.dirPath = QDir::fromNativeSeparators(ui->directoryPath->currentText());
+    param.nameFilters = ui->filterText->currentText().split(QRegExp("[;,\\s]+"), QString::SkipEmptyParts);
+    param.subDir = ui->subDirTarget->isChecked();
+    param.output = static_cast<OUTPUT>(ui->output->currentIndex());
+
+    if (param.data.text.isEmpty()) {
+        return;
+    }
+    if (param.mode == MODE_DIR && !QDir(param.dirPath).exists()) {
+        QMessageBox::warning(this, windowTitle(), tr("ディレクトリが見つかりません"));
+        return;
+    }
+
+    addHistory(ui->findText, param.data.text);
+    if (param.mode == MODE_DIR) {
+        addHistory(ui->filterText, ui->filterText->currentText());
+        addHistory(ui->directoryPath, ui->directoryPath->currentText());
+    }
+
+    emit grep(param);
+
+    if (ui->findkeep->isChecked()) {
+        close();
+    }
+}
+
+void GrepDialog::selectDir()
+{
+    QString dirPath = QFileDialog::getExistingDirectory(this, tr("ディレクトリ選択"),
+                                            ui->directoryPath->currentText(),
+                                            QFileDialog::ShowDirsOnly);
+    if (!dirPath.isEmpty())
+        ui->directoryPath->setEditText(QDir::toNativeSeparators(dirPath));
+}
+
+void GrepDialog::closeEvent(QCloseEvent *event)
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "MyEditor", "Geometry");
+    settings.beginGroup("GrepDialog");
+    settings.setValue("findText", history(ui->findText));
+    settings.setValue("filterText", history(ui->filterText));
+    settings.setValue("directoryPath", history(ui->directoryPath));
+    settings.setValue("mode", ui->mode->currentIndex());
+    settings.setValue("subDirTarget", ui->subDirTarget->isChecked());
+    settings.setValue("defaultCurrentDir", ui->defaultCurrentDir->isChecked());
+    settings.setValue("caseSensitively", ui->caseSensitively->isChecked());
+    settings.setValue("wholeWords", ui->wholeWords->isChecked());
+    settings.setValue("regularExpression", ui->expr->isChecked());
+    settings.setValue("findkeep", ui->findkeep->isChecked());
+    settings.setValue("output", ui->output->currentIndex());
+    settings.setValue("GrepDialog", saveGeometry());
+
+    QDialog::closeEvent(event);
+}
+
+/**
+ * 入力履歴の先頭に追加する(同じ文字列は先頭へ移動する)
+ */
+void GrepDialog::addHistory(QComboBox *comboBox, const QString &text)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    const int index = comboBox->findText(text);
+    if (index == 0) {
+        return;
+    }
+    if (index > 0) {
+        comboBox->removeItem(index);
+    }
+    comboBox->insertItem(0, text);
+    while (comboBox->count() > HISTORY_MAX) {
+        comboBox->removeItem(comboBox->count() - 1);
+    }
+    comboBox->setCurrentIndex(0);
+}
+
+QStringList GrepDialog::history(const QComboBox *comboBox)
+{
+    QStringList list;
+    for (int i = 0; i < comboBox->count(); ++i) {
+        list << comboBox->itemText(i);
+    }
+    return list;
+}
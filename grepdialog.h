@@ -2,6 +2,9 @@
 #define GREPDIALOG_H
 
 #include <QDialog>
+#include "texteditor.h"
+
+class QComboBox;
 
 namespace Ui {
     class GrepDialog;
@@ -17,16 +20,46 @@ public:
         MODE_DIR
     };
 
+    enum OUTPUT {
+        OUTPUT_EDITOR,
+        OUTPUT_WIDGET
+    };
+
+    enum { HISTORY_MAX = 20 };
+
+    typedef struct {
+        TextEditor::KeywordData data;
+        MODE mode;
+        QString dirPath;
+        QStringList nameFilters;            // 拡張子フィルタ(空の場合は全てのファイル)
+        bool subDir;
+        OUTPUT output;
+    } GrepParam;
+
 public:
     explicit GrepDialog(QWidget *parent = 0);
     ~GrepDialog();
     void updateMode(MODE mode);
+    void setText(const QString &text);
+    void setDefaultDirPath(const QString &dirPath);
 
 public slots:
     void updateMode(int mode)
     {
         updateMode(static_cast<MODE>(mode));
     }
+    void startGrep();
+    void selectDir();
+
+signals:
+    void grep(GrepDialog::GrepParam param);
+
+protected:
+    void closeEvent(QCloseEvent *event);
+
+private:
+    static void addHistory(QComboBox *comboBox, const QString &text);
+    static QStringList history(const QComboBox *comboBox);
 
 private:
     Ui::GrepDialog *ui;
@@ -0,0 +1,931 @@
+#include "grepengine.h"
+#include "codecdetector.h"
+#include "regexpcache.h"
+#include "trigramindex.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextCodec>
+#include <QTextDocument>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+/* 作業の種類 */
+enum GrepTaskType {
+    TASK_INDEX,                             // トライグラム索引の更新と候補ファイルの抽出
+    TASK_DIRECTORY,                         // ディレクトリの一覧作成
+    TASK_FILE,                              // ファイルの検索
+    TASK_TEXT                               // 文書の断片の検索
+};
+
+/* 作業単位 */
+typedef struct tagGrepTask {
+    GrepTaskType type;
+    QString path;
+    int firstBlock;                         // 断片の先頭のブロック番号
+    int serial;                             // 断片の番号(GrepJob::holdSnapshot())
+    QVector<QString> lines;                 // 断片のブロックのテキスト
+} GrepTask;
+
+/* 作業者毎のキュー(自分は末尾から取り、他の作業者は先頭から奪う) */
+typedef struct tagGrepQueue {
+    QMutex mutex;
+    QList<GrepTask> tasks;
+} GrepQueue;
+
+/**
+ * 1回の検索の共有状態
+ */
+class GrepJob
+{
+public:
+    GrepJob(GrepEngine *engine, int generation, int workerCount)
+        : engine(engine), generation(generation), recursive(false), defaultCodec(0), snapshotResume(0), heldSerial(0), flushPosted(false)
+    {
+        for (int i = 0; i < workerCount; ++i) {
+            queues.append(new GrepQueue);
+        }
+    }
+
+    ~GrepJob()
+    {
+        qDeleteAll(queues);
+    }
+
+    bool isCancelled()
+    {
+        return cancelled.fetchAndAddOrdered(0) != 0;
+    }
+
+    void push(int worker, const GrepTask &task)
+    {
+        pending.fetchAndAddOrdered(1);
+        GrepQueue *queue = queues.at(worker);
+        {
+            QMutexLocker locker(&queue->mutex);
+            queue->tasks.append(task);
+        }
+        idle.wakeOne();
+    }
+
+    bool take(int worker, GrepTask &task)
+    {
+        GrepQueue *own = queues.at(worker);
+        {
+            QMutexLocker locker(&own->mutex);
+            if (!own->tasks.isEmpty()) {
+                task = own->tasks.takeLast();
+                return true;
+            }
+        }
+        for (int i = 1; i < queues.size(); ++i) {
+            GrepQueue *other = queues.at((worker + i) % queues.size());
+            QMutexLocker locker(&other->mutex);
+            if (!other->tasks.isEmpty()) {
+                task = other->tasks.takeFirst();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* 作業の完了(全ての作業が終わった場合は待機中の作業者を起こし、処理待ちが減った場合は断片の作成を再開させる) */
+    void done()
+    {
+        const int remaining = pending.fetchAndAddOrdered(-1) - 1;
+        if (remaining == 0) {
+            idle.wakeAll();
+        }
+        if (remaining <= snapshotResume && snapshotWaiting.testAndSetOrdered(1, 0)) {
+            QMetaObject::invokeMethod(engine, "takeSnapshot", Qt::QueuedConnection);
+        }
+    }
+
+    /*
+     * 結果を追加する(取り出し中の文書の結果は保留し、捨てた断片の結果は無視する)
+     * 文書の結果は断片の番号と組にし、GUI スレッドで文書を設定する(作業者は文書に触れない)
+     */
+    void addMatches(const QVector<GrepEngine::Match> &matches, int serial = 0)
+    {
+        QMutexLocker locker(&resultMutex);
+        if (serial != 0 && discardedSerials.contains(serial)) {
+            return;
+        }
+        matchCount.fetchAndAddOrdered(matches.size());
+        if (serial == 0) {
+            results += matches;
+        } else if (serial == heldSerial) {
+            held += matches;
+            return;
+        } else {
+            documentResults.append(qMakePair(serial, matches));
+        }
+        postFlush();
+    }
+
+    /* 断片を取り出し始めた文書の結果を保留する */
+    void holdSnapshot(int serial)
+    {
+        QMutexLocker locker(&resultMutex);
+        heldSerial = serial;
+    }
+
+    /* 文書を取り出し終えたので保留した結果を通知する */
+    void commitSnapshot(int serial)
+    {
+        QMutexLocker locker(&resultMutex);
+        if (serial != heldSerial) {
+            return;
+        }
+        heldSerial = 0;
+        if (!held.isEmpty()) {
+            documentResults.append(qMakePair(serial, held));
+            held.clear();
+            postFlush();
+        }
+    }
+
+    /* 取り出しの途中で編集された文書の結果を捨てる(処理中の断片の結果も以降は無視する) */
+    void discardSnapshot(int serial)
+    {
+        QMutexLocker locker(&resultMutex);
+        discardedSerials.insert(serial);
+        if (serial == heldSerial) {
+            matchCount.fetchAndAddOrdered(-held.size());
+            held.clear();
+            heldSerial = 0;
+        }
+    }
+
+    QVector<GrepEngine::Match> takeMatches(QList<QPair<int, QVector<GrepEngine::Match> > > &documentMatches)
+    {
+        QMutexLocker locker(&resultMutex);
+        QVector<GrepEngine::Match> matches = results;
+        results.clear();
+        documentMatches = documentResults;
+        documentResults.clear();
+        flushPosted = false;
+        return matches;
+    }
+
+public:
+    GrepEngine *engine;
+    int generation;
+    QVector<GrepQueue *> queues;
+    QAtomicInt pending;                     // 未完了の作業数
+    QAtomicInt cancelled;
+    QAtomicInt activeWorkers;
+    QAtomicInt fileCount;                   // 検索したファイル数
+    QAtomicInt matchCount;
+    QAtomicInt snapshotWaiting;             // 断片の作成が処理待ちの減少を待っている
+    QMutex idleMutex;
+    QWaitCondition idle;
+
+    /* 検索条件(開始後は変更しない) */
+    QStringList nameFilters;
+    bool recursive;
+    QRegExp regexp;
+    QString literal;                        // 一致する行が必ず含む文字列(空の場合は絞り込まない)
+    bool caseSensitive;
+    QTextCodec *defaultCodec;
+    int snapshotResume;                     // 断片の作成を再開する処理待ちの作業数
+
+private:
+    void postFlush()
+    {
+        if (!flushPosted) {
+            flushPosted = true;
+            QMetaObject::invokeMethod(engine, "flushMatches", Qt::QueuedConnection);
+        }
+    }
+
+private:
+    QMutex resultMutex;
+    QVector<GrepEngine::Match> results;     // 未通知の結果
+    QList<QPair<int, QVector<GrepEngine::Match> > > documentResults;    // 未通知の文書の結果(断片の番号毎)
+    QVector<GrepEngine::Match> held;        // 取り出し中の文書の保留した結果
+    int heldSerial;                         // 結果を保留している断片の番号(0は保留なし)
+    QSet<int> discardedSerials;             // 捨てた断片の番号
+    bool flushPosted;
+};
+
+namespace {
+
+/* ASCIIの英字のみ大文字小文字を区別せずに比較する */
+bool equalsIgnoreCase(const char *data, const char *literal, int size)
+{
+    for (int i = 0; i < size; ++i) {
+        char a = data[i];
+        char b = literal[i];
+        if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+        if (a != b) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isAsciiAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+const char *findByte(const char *begin, const char *end, char c)
+{
+    return begin < end ? static_cast<const char *>(memchr(begin, c, end - begin)) : 0;
+}
+
+class GrepWorker : public QRunnable
+{
+public:
+    GrepWorker(GrepJob *job, int index) : job(job), index(index) {}
+    void run();
+
+private:
+    void indexDirectory(const QString &path);
+    void listDirectory(const QString &path);
+    bool matchesName(const QString &fileName) const;
+    void searchFile(const QString &path);
+    void searchText(const GrepTask &task);
+    void searchLine(const char *begin, const char *end, int line, QTextCodec *codec,
+                    const QString &path, QVector<GrepEngine::Match> &matches);
+
+private:
+    GrepJob *job;
+    int index;
+    QRegExp regexp;                         // 照合状態を持つため作業者毎に複製する
+    QVector<QRegExp> nameFilters;
+};
+
+void GrepWorker::run()
+{
+    regexp = job->regexp;
+    foreach (const QString &filter, job->nameFilters) {
+        nameFilters.append(QRegExp(filter, Qt::CaseInsensitive, QRegExp::Wildcard));
+    }
+
+    while (!job->isCancelled()) {
+        GrepTask task;
+        if (!job->take(index, task)) {
+            if (job->pending.fetchAndAddOrdered(0) == 0) {
+                break;
+            }
+            /* 他の作業者が作業を積むのを待つ */
+            QMutexLocker locker(&job->idleMutex);
+            job->idle.wait(&job->idleMutex, 10);
+            continue;
+        }
+        switch (task.type) {
+        case TASK_INDEX:
+            indexDirectory(task.path);
+            break;
+        case TASK_DIRECTORY:
+            listDirectory(task.path);
+            break;
+        case TASK_FILE:
+            searchFile(task.path);
+            break;
+        case TASK_TEXT:
+            searchText(task);
+            break;
+        }
+        job->done();
+    }
+
+    job->idle.wakeAll();
+    if (job->activeWorkers.fetchAndAddOrdered(-1) == 1) {
+        QMetaObject::invokeMethod(job->engine, "jobFinished", Qt::QueuedConnection, Q_ARG(int, job->generation));
+    }
+}
+
+/**
+ * トライグラム索引があれば、変わっていないファイルは検索文字列を含む可能性のあるものだけを作業に積み、
+ * 索引の作成後に追加・変更されたファイルはそのまま作業に積む(索引の作り直しは依頼する)
+ * 文字コードが分からないため、検索文字列を主な文字コードでエンコードしたいずれかを含むファイルを候補にする
+ * 索引がない場合はファイルの内容を読む索引の作成を待たずにディレクトリを走査し、索引の作成を依頼する
+ */
+void GrepWorker::indexDirectory(const QString &path)
+{
+    TrigramIndex trigramIndex;
+    QVector<bool> current;
+    QStringList changed;
+    if (!trigramIndex.open(path) || !trigramIndex.compareFiles(current, changed, &job->cancelled)) {
+        if (!job->isCancelled()) {
+            QMetaObject::invokeMethod(job->engine, "updateIndex", Qt::QueuedConnection, Q_ARG(QString, path));
+            GrepTask task;
+            task.type = TASK_DIRECTORY;
+            task.path = path;
+            job->push(index, task);
+        }
+        return;
+    }
+
+    /* 索引の作成後に追加・変更されたファイルは直接検索し、索引は次回のために作り直す */
+    const bool stale = !changed.isEmpty() || current.count(false) > 0;
+    if (stale) {
+        QMetaObject::invokeMethod(job->engine, "updateIndex", Qt::QueuedConnection, Q_ARG(QString, path));
+    }
+    const QDir dir(path);
+    foreach (const QString &relativePath, changed) {
+        const int nameBegin = relativePath.lastIndexOf(QLatin1Char('/')) + 1;
+        if ((nameBegin > 0 && !job->recursive) || !matchesName(relativePath.mid(nameBegin))) {
+            continue;
+        }
+        GrepTask task;
+        task.type = TASK_FILE;
+        task.path = dir.filePath(relativePath);
+        job->push(index, task);
+    }
+
+    QList<QByteArray> literals;
+    QList<QTextCodec *> codecs;
+    codecs << QTextCodec::codecForName("UTF-8") << QTextCodec::codecForName("Shift_JIS")
+           << QTextCodec::codecForName("EUC-JP") << job->defaultCodec;
+    foreach (QTextCodec *codec, codecs) {
+        if (codec) {
+            const QByteArray literal = codec->fromUnicode(job->literal);
+            if (!literals.contains(literal)) {
+                literals.append(literal);
+            }
+        }
+    }
+
+    foreach (int id, trigramIndex.candidates(literals)) {
+        if (!current.at(id)) {
+            continue;                       // 変更・削除されたファイル
+        }
+        const QString relativePath = trigramIndex.relativeFilePath(id);
+        const int nameBegin = relativePath.lastIndexOf(QLatin1Char('/')) + 1;
+        if ((nameBegin > 0 && !job->recursive) || !matchesName(relativePath.mid(nameBegin))) {
+            continue;
+        }
+        GrepTask task;
+        task.type = TASK_FILE;
+        task.path = trigramIndex.filePath(id);
+        job->push(index, task);
+    }
+}
+
+bool GrepWorker::matchesName(const QString &fileName) const
+{
+    bool matched = nameFilters.isEmpty();
+    for (int i = 0; i < nameFilters.size() && !matched; ++i) {
+        matched = nameFilters.at(i).exactMatch(fileName);
+    }
+    return matched;
+}
+
+void GrepWorker::listDirectory(const QString &path)
+{
+    QDir::Filters filters = QDir::Files | QDir::NoDotAndDotDot | QDir::Readable;
+    if (job->recursive) {
+        filters |= QDir::Dirs;
+    }
+    const QFileInfoList entries = QDir(path).entryInfoList(filters, QDir::Unsorted);
+    foreach (const QFileInfo &info, entries) {
+        if (info.isDir()) {
+            /* シンボリックリンクのディレクトリは循環する恐れがあるため辿らない */
+            if (!info.isSymLink()) {
+                GrepTask task;
+                task.type = TASK_DIRECTORY;
+                task.path = info.filePath();
+                job->push(index, task);
+            }
+            continue;
+        }
+        if (matchesName(info.fileName())) {
+            GrepTask task;
+            task.type = TASK_FILE;
+            task.path = info.filePath();
+            job->push(index, task);
+        }
+    }
+}
+
+/**
+ * ファイルを検索する
+ * 絞り込み用の文字列がある場合はそのバイト列を含む行だけをデコードして照合する
+ */
+void GrepWorker::searchFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return;
+    }
+    job->fileCount.fetchAndAddOrdered(1);
+    const qint64 fileSize = file.size();
+    if (fileSize <= 0) {
+        return;
+    }
+
+    /* マップできない場合(特殊ファイルなど)はまとめて読み込む */
+    QByteArray buffer;
+    const char *data = reinterpret_cast<const char *>(file.map(0, fileSize));
+    qint64 size = fileSize;
+    if (!data) {
+        buffer = file.readAll();
+        data = buffer.constData();
+        size = buffer.size();
+    }
+    if (memchr(data, 0, qMin<qint64>(size, GrepEngine::BINARY_CHECK_SIZE))) {
+        return;
+    }
+    const char *end = data + size;
+
+    const int headSize = static_cast<int>(qMin<qint64>(size, CodecDetector::SAMPLE_HEAD_SIZE));
+    const int tailSize = static_cast<int>(qMin<qint64>(size - headSize, CodecDetector::SAMPLE_TAIL_SIZE));
+    const CodecDetector::Result detected = CodecDetector::detect(QByteArray::fromRawData(data, headSize),
+                                                                 QByteArray::fromRawData(end - tailSize, tailSize),
+                                                                 job->defaultCodec);
+    const QByteArray literal = job->literal.isEmpty() ? QByteArray() : detected.codec->fromUnicode(job->literal);
+
+    QVector<GrepEngine::Match> matches;
+    const char *counted = data;             // 行番号を数え終えた位置
+    int line = 1;
+    const char *p = data;
+    while (p < end && !job->isCancelled()) {
+        const char *lineBegin = p;
+        if (!literal.isEmpty()) {
+            const char *hit = GrepEngine::findLiteral(p, end, literal, job->caseSensitive);
+            if (!hit) {
+                break;
+            }
+            lineBegin = hit;
+            while (lineBegin > p && lineBegin[-1] != '\n') {
+                --lineBegin;
+            }
+        }
+        const char *lineEnd = findByte(lineBegin, end, '\n');
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+
+        line += static_cast<int>(std::count(counted, lineBegin, '\n'));
+        counted = lineBegin;
+        searchLine(lineBegin, lineEnd, line, detected.codec, path, matches);
+        p = lineEnd + 1;
+    }
+
+    if (!matches.isEmpty()) {
+        job->addMatches(matches);
+    }
+}
+
+void GrepWorker::searchLine(const char *begin, const char *end, int line, QTextCodec *codec,
+                            const QString &path, QVector<GrepEngine::Match> &matches)
+{
+    if (end > begin && end[-1] == '\r') {
+        --end;
+    }
+    const QString text = codec->toUnicode(begin, static_cast<int>(end - begin));
+    const int column = regexp.indexIn(text);
+    if (column < 0) {
+        return;
+    }
+    GrepEngine::Match match;
+    match.filePath = path;
+    match.line = line;
+    match.column = column;
+    match.length = regexp.matchedLength();
+    match.text = text.left(GrepEngine::MAX_LINE_TEXT);
+    matches.append(match);
+}
+
+/**
+ * 文書の断片を検索する
+ * 絞り込み用の文字列を含まないブロックは正規表現で照合しない
+ */
+void GrepWorker::searchText(const GrepTask &task)
+{
+    const Qt::CaseSensitivity cs = job->caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    QVector<GrepEngine::Match> matches;
+    for (int i = 0; i < task.lines.size(); ++i) {
+        const QString &text = task.lines.at(i);
+        if (!job->literal.isEmpty() && !text.contains(job->literal, cs)) {
+            continue;
+        }
+        const int column = regexp.indexIn(text);
+        if (column < 0) {
+            continue;
+        }
+        GrepEngine::Match match;
+        match.filePath = task.path;
+        match.line = task.firstBlock + i + 1;
+        match.column = column;
+        match.length = regexp.matchedLength();
+        match.text = text.left(GrepEngine::MAX_LINE_TEXT);
+        matches.append(match);
+    }
+    if (!matches.isEmpty()) {
+        job->addMatches(matches, task.serial);
+    }
+}
+
+}
+
+GrepEngine::GrepEngine(QObject *parent)
+    : QObject(parent), job(0), generation(0), snapshotIndex(0), snapshotBlock(0), snapshotRevision(0),
+      snapshotSerial(0), snapshotRestarts(0), snapshotChunks(0)
+{
+    connect(&snapshotTimer, SIGNAL(timeout()), this, SLOT(takeSnapshot()));
+}
+
+GrepEngine::~GrepEngine()
+{
+    blockSignals(true);
+    cancel();
+    indexCancelled.fetchAndStoreOrdered(1);
+    indexWatcher.waitForFinished();
+}
+
+/**
+ * ディレクトリの検索を開始する(実行中の検索は中止する)
+ */
+void GrepEngine::start(const QString &dirPath, const QStringList &nameFilters, bool recursive,
+                       const TextEditor::KeywordData &keyword, QTextCodec *defaultCodec)
+{
+    if (!createJob(keyword, defaultCodec)) {
+        return;
+    }
+    job->nameFilters = nameFilters;
+    job->recursive = recursive;
+
+    /* サブフォルダを含める場合は索引があれば候補を絞る(3バイト未満の文字列は絞り込めない) */
+    GrepTask root;
+    root.type = recursive && job->literal.toUtf8().size() >= 3 ? TASK_INDEX : TASK_DIRECTORY;
+    root.path = dirPath;
+    job->push(0, root);
+    startWorkers();
+}
+
+/**
+ * 開いている文書の検索を開始する(実行中の検索は中止する)
+ * 文書は GUI スレッドでしか読めないため、ブロックのテキストの断片をイベント処理の合間に作成して渡す
+ */
+void GrepEngine::start(const QList<QTextDocument *> &documents, const QStringList &names,
+                       const TextEditor::KeywordData &keyword)
+{
+    if (!createJob(keyword, 0)) {
+        return;
+    }
+    foreach (QTextDocument *document, documents) {
+        snapshotDocuments.append(document);
+    }
+    snapshotNames = names;
+    snapshotIndex = 0;
+    snapshotBlock = 0;
+    snapshotRestarts = 0;
+    snapshotChunks = 0;
+
+    /* 断片の作成中は作業者が終了しないよう、作成自体を1つの作業として数える */
+    job->pending.fetchAndAddOrdered(1);
+    job->snapshotResume = job->queues.size() * SNAPSHOT_BACKLOG;
+    startWorkers();
+    takeSnapshot();
+}
+
+/**
+ * 検索条件を準備する(検索できない場合は終了を通知して false を返す)
+ */
+bool GrepEngine::createJob(const TextEditor::KeywordData &keyword, QTextCodec *defaultCodec)
+{
+    cancel();
+    ++generation;
+
+    bool rejected = false;
+    const QRegExp regexp = RegExpCache::regExp(keyword.text, keyword.option, &rejected);
+    if (rejected || keyword.text.isEmpty()) {
+        emit finished(0, 0, false);
+        return false;
+    }
+
+    job = new GrepJob(this, generation, qMax(1, pool.maxThreadCount()));
+    job->regexp = regexp;
+    job->caseSensitive = keyword.option.caseSensitive;
+    job->defaultCodec = defaultCodec;
+    job->literal = requiredLiteral(keyword);
+    return true;
+}
+
+void GrepEngine::startWorkers()
+{
+    const int workerCount = job->queues.size();
+    job->activeWorkers.fetchAndStoreOrdered(workerCount);
+    for (int i = 0; i < workerCount; ++i) {
+        pool.start(new GrepWorker(job, i));
+    }
+}
+
+/**
+ * ディレクトリの索引を別スレッドで作成する(作成中の場合は何もしない)
+ */
+void GrepEngine::updateIndex(const QString &dirPath)
+{
+    if (indexWatcher.isRunning()) {
+        return;
+    }
+    indexCancelled.fetchAndStoreOrdered(0);
+    indexWatcher.setFuture(QtConcurrent::run(&GrepEngine::buildIndex, dirPath, &indexCancelled));
+}
+
+bool GrepEngine::buildIndex(const QString &dirPath, QAtomicInt *cancelled)
+{
+    TrigramIndex index;
+    index.open(dirPath);
+    return index.update(cancelled);
+}
+
+/**
+ * 文書のブロックのテキストを断片にして作業者へ渡す
+ * 処理待ちの断片が多い間は作成せず、複製したテキストが増え続けないようにする
+ */
+void GrepEngine::takeSnapshot()
+{
+    if (!job || snapshotIndex >= snapshotDocuments.size()) {
+        snapshotTimer.stop();
+        return;
+    }
+
+    /* 処理待ちが多い間はタイマーを止め、作業者の完了(GrepJob::done())で再開する */
+    if (job->pending.fetchAndAddOrdered(0) > job->snapshotResume) {
+        snapshotTimer.stop();
+        job->snapshotWaiting.fetchAndStoreOrdered(1);
+        /* 待機を設定する前に処理待ちが減っていた場合は、再開の通知を待たずに続ける */
+        if (job->pending.fetchAndAddOrdered(0) > job->snapshotResume || !job->snapshotWaiting.testAndSetOrdered(1, 0)) {
+            return;
+        }
+    }
+
+    QTextDocument *document = snapshotDocuments.at(snapshotIndex);
+    if (document) {
+        /* 取り出しの途中で編集された場合は、版が混ざらないよう最初から取り出し直す */
+        if (snapshotBlock > 0 && document->revision() != snapshotRevision) {
+            job->discardSnapshot(snapshotSerial);
+            snapshotBlock = 0;
+            ++snapshotRestarts;
+        }
+        if (snapshotBlock == 0) {
+            snapshotRevision = document->revision();
+            job->holdSnapshot(++snapshotSerial);
+            snapshotOwners.insert(snapshotSerial, document);
+        }
+
+        /* 何度も編集される場合は、残りをイベント処理を挟まずに取り出す */
+        int budget = snapshotRestarts < SNAPSHOT_RESTART_LIMIT ? SNAPSHOT_SLICE_BLOCKS : INT_MAX;
+        const int workerCount = job->queues.size();
+        QTextBlock block = document->findBlockByNumber(snapshotBlock);
+        while (budget > 0 && block.isValid()) {
+            GrepTask task;
+            task.type = TASK_TEXT;
+            task.path = snapshotNames.value(snapshotIndex);
+            task.firstBlock = snapshotBlock;
+            task.serial = snapshotSerial;
+            task.lines.reserve(SNAPSHOT_CHUNK_BLOCKS);
+            for (; block.isValid() && task.lines.size() < SNAPSHOT_CHUNK_BLOCKS; block = block.next()) {
+                task.lines.append(block.text());
+            }
+            snapshotBlock += task.lines.size();
+            budget -= task.lines.size();
+            job->push(snapshotChunks++ % workerCount, task);
+        }
+        if (block.isValid()) {
+            if (!snapshotTimer.isActive()) {
+                snapshotTimer.start(0);
+            }
+            return;
+        }
+        job->commitSnapshot(snapshotSerial);
+        job->fileCount.fetchAndAddOrdered(1);
+    } else if (snapshotBlock > 0) {
+        job->discardSnapshot(snapshotSerial);   // 取り出しの途中で閉じられた
+    }
+    ++snapshotIndex;
+    snapshotBlock = 0;
+    snapshotRestarts = 0;
+
+    if (snapshotIndex >= snapshotDocuments.size()) {
+        snapshotTimer.stop();
+        snapshotDocuments.clear();
+        snapshotNames.clear();
+        job->done();
+    } else if (!snapshotTimer.isActive()) {
+        snapshotTimer.start(0);
+    }
+}
+
+void GrepEngine::cancel()
+{
+    if (!job) {
+        return;
+    }
+    snapshotTimer.stop();
+    snapshotDocuments.clear();
+    snapshotNames.clear();
+    snapshotOwners.clear();
+    job->cancelled.fetchAndStoreOrdered(1);
+    job->idle.wakeAll();
+    pool.waitForDone();
+
+    const int files = job->fileCount.fetchAndAddOrdered(0);
+    const int matches = job->matchCount.fetchAndAddOrdered(0);
+    delete job;
+    job = 0;
+    ++generation;
+    emit finished(files, matches, true);
+}
+
+/**
+ * 正規表現に一致する文字列が必ず含む文字列を返す(絞り込みに使う)
+ * 選択(|)を含む場合や、確実に含まれる文字列がない場合は空を返す
+ * 大文字小文字を区別しない場合、ASCII以外の英字はバイト列で比較できないため空を返す
+ */
+QString GrepEngine::requiredLiteral(const TextEditor::KeywordData &keyword)
+{
+    const QString literal = keyword.option.regularExpression ? patternLiteral(keyword.text) : keyword.text;
+    if (!keyword.option.caseSensitive) {
+        foreach (const QChar &c, literal) {
+            if (c.unicode() >= 0x80 && c.toLower() != c.toUpper()) {
+                return QString();
+            }
+        }
+    }
+    return literal;
+}
+
+/**
+ * 正規表現のパターンから、選択やグループの外にある連続した通常の文字の最長のものを返す
+ */
+QString GrepEngine::patternLiteral(const QString &pattern)
+{
+    QString best;
+    QString run;
+    int depth = 0;
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern.at(i);
+        bool literal = false;
+        QChar value = c;
+
+        if (c == QLatin1Char('|')) {
+            return QString();
+        } else if (c == QLatin1Char('\\')) {
+            ++i;
+            if (i < pattern.size() && !pattern.at(i).isLetterOrNumber()) {
+                value = pattern.at(i);
+                literal = depth == 0;
+            } else if (i < pattern.size()) {
+                /* 文字コード指定(\x41、\0101、\u3042)の数字は文字列に含めない */
+                const QChar escape = pattern.at(i);
+                const int digits = escape == QLatin1Char('x') || escape == QLatin1Char('u') ? 4
+                                 : escape == QLatin1Char('0') ? 3 : 0;
+                for (int n = 0; n < digits && i + 1 < pattern.size(); ++n) {
+                    const QChar digit = pattern.at(i + 1);
+                    const bool valid = escape == QLatin1Char('0')
+                            ? digit >= QLatin1Char('0') && digit <= QLatin1Char('7')
+                            : digit.isDigit() || (digit.toLower() >= QLatin1Char('a') && digit.toLower() <= QLatin1Char('f'));
+                    if (!valid) {
+                        break;
+                    }
+                    ++i;
+                }
+            }
+        } else if (c == QLatin1Char('[')) {
+            ++i;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char('^')) {
+                ++i;
+            }
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char(']')) {
+                ++i;
+            }
+            while (i < pattern.size() && pattern.at(i) != QLatin1Char(']')) {
+                if (pattern.at(i) == QLatin1Char('\\')) {
+                    ++i;
+                }
+                ++i;
+            }
+        } else if (c == QLatin1Char('(')) {
+            ++depth;
+        } else if (c == QLatin1Char(')')) {
+            depth = qMax(0, depth - 1);
+        } else if (c == QLatin1Char('?') || c == QLatin1Char('*') || c == QLatin1Char('{')) {
+            /* 直前の文字は省略できる */
+            run.chop(1);
+            if (c == QLatin1Char('{')) {
+                while (i < pattern.size() && pattern.at(i) != QLatin1Char('}')) {
+                    ++i;
+                }
+            }
+        } else if (c == QLatin1Char('+')) {
+            /* 直前の文字は必ず含まれるが、以降の文字と連続するとは限らない */
+        } else if (c != QLatin1Char('.') && c != QLatin1Char('^') && c != QLatin1Char('$')) {
+            literal = depth == 0;
+        }
+
+        if (literal) {
+            run += value;
+            continue;
+        }
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    }
+    if (run.size() > best.size()) {
+        best = run;
+    }
+    return best;
+}
+
+/**
+ * バイト列を検索する
+ * 先頭のバイトを memchr(ライブラリ実装のベクトル命令)で探してから残りを比較する
+ * 大文字小文字を区別しない場合はASCIIの英字のみ同一視し、先頭が英字なら大文字・小文字の両方を探す
+ */
+const char *GrepEngine::findLiteral(const char *begin, const char *end, const QByteArray &literal, bool caseSensitive)
+{
+    const int size = literal.size();
+    if (size == 0) {
+        return begin;
+    }
+    if (end - begin < size) {
+        return 0;
+    }
+    const char *last = end - size + 1;      // 候補の先頭の上限
+    const char first = literal.at(0);
+
+    if (caseSensitive || !isAsciiAlpha(first)) {
+        for (const char *p = findByte(begin, last, first); p; p = findByte(p + 1, last, first)) {
+            if (caseSensitive ? memcmp(p + 1, literal.constData() + 1, size - 1) == 0
+                              : equalsIgnoreCase(p + 1, literal.constData() + 1, size - 1)) {
+                return p;
+            }
+        }
+        return 0;
+    }
+
+    const char lower = first | 0x20;
+    const char upper = first & ~0x20;
+    const char *nextLower = findByte(begin, last, lower);
+    const char *nextUpper = findByte(begin, last, upper);
+    while (nextLower || nextUpper) {
+        const char *p = !nextUpper || (nextLower && nextLower < nextUpper) ? nextLower : nextUpper;
+        if (equalsIgnoreCase(p + 1, literal.constData() + 1, size - 1)) {
+            return p;
+        }
+        if (p == nextLower) {
+            nextLower = findByte(p + 1, last, lower);
+        } else {
+            nextUpper = findByte(p + 1, last, upper);
+        }
+    }
+    return 0;
+}
+
+void GrepEngine::flushMatches()
+{
+    if (!job) {
+        return;
+    }
+    QList<QPair<int, QVector<Match> > > documentMatches;
+    QVector<Match> matches = job->takeMatches(documentMatches);
+
+    /* 文書の結果は検索中に閉じられていなければ文書を設定して通知する */
+    for (int i = 0; i < documentMatches.size(); ++i) {
+        QTextDocument *document = snapshotOwners.value(documentMatches.at(i).first);
+        if (!document) {
+            continue;
+        }
+        QVector<Match> owned = documentMatches.at(i).second;
+        for (int j = 0; j < owned.size(); ++j) {
+            owned[j].document = document;
+        }
+        matches += owned;
+    }
+    if (!matches.isEmpty()) {
+        emit found(matches);
+    }
+}
+
+void GrepEngine::jobFinished(int generation)
+{
+    if (!job || generation != this->generation) {
+        return;
+    }
+    flushMatches();
+    pool.waitForDone();
+    snapshotOwners.clear();
+
+    const int files = job->fileCount.fetchAndAddOrdered(0);
+    const int matches = job->matchCount.fetchAndAddOrdered(0);
+    delete job;
+    job = 0;
+    emit finished(files, matches, false);
+}
@@ -0,0 +1,103 @@
+#ifndef GREPENGINE_H
+#define GREPENGINE_H
+
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include "texteditor.h"
+
+class QTextCodec;
+class QTextDocument;
+class GrepJob;
+
+/**
+ * ディレクトリ内のファイルの検索(Grep)
+ *
+ * ディレクトリとファイルを作業単位として作業者スレッド毎のキューに積み、
+ * 自分のキューが空になった作業者は他のキューの反対側から作業を奪う(ワークスティーリング)。
+ * ファイルはメモリマップして読み、正規表現でない場合は検索文字列のバイト列を memchr で絞り込んでから
+ * 候補の行だけをデコードして照合する。見つかった結果は随時 found() で通知する。
+ * サブフォルダを含める場合、TrigramIndex があれば検索文字列を含む可能性のあるファイルに絞ってから検索する。
+ * 索引の作成後に追加・変更されたファイルは索引を使わずに検索し、索引は次回のために別スレッドで更新する。
+ * 索引がない場合は作成を待たずにディレクトリを走査して検索する。
+ *
+ * 開いている文書は toPlainText() で全体を複製せず、ブロックのテキストを一定数ずつ取り出した断片を
+ * 作業者へ渡す。断片はイベント処理の合間に少しずつ作成し、作業者の処理待ちが多い間は作成を止めて作業の完了を待つ
+ * (複製は処理待ちと1回分の断片に収まる)。断片は検索後に解放する。
+ * 取り出しの途中で文書が編集された(版が変わった)場合は、その文書の断片と結果を捨てて最初から取り出し直す。
+ * 文書の結果は取り出しが終わるまで保留し、捨てた版の結果は通知しない。
+ */
+class GrepEngine : public QObject
+{
+    Q_OBJECT
+public:
+    enum {
+        BINARY_CHECK_SIZE = 8000,           // NULを含む場合はバイナリとして読み飛ばす範囲
+        MAX_LINE_TEXT = 512,                // 結果に含める行の最大文字数
+        SNAPSHOT_CHUNK_BLOCKS = 2048,       // 文書の断片のブロック数
+        SNAPSHOT_SLICE_BLOCKS = 32768,      // 1回のイベント処理で取り出すブロック数
+        SNAPSHOT_RESTART_LIMIT = 3,         // 編集による取り出し直しの上限(超えた場合は残りを一度に取り出す)
+        SNAPSHOT_BACKLOG = 4                // 作業者1人当たりの処理待ちの断片数の上限
+    };
+
+    typedef struct tagMatch {
+        QString filePath;                   // ファイル名(文書の場合は文書のファイル名)
+        QPointer<QTextDocument> document;   // 検索した文書(ファイルの場合と、文書が閉じられた場合は0)
+        int line;                           // 行番号(1始まり、文書の場合はブロック番号+1)
+        int column;                         // 一致した位置(行頭からの文字数)
+        int length;                         // 一致した長さ
+        QString text;                       // 行の内容
+    } Match;
+
+public:
+    explicit GrepEngine(QObject *parent = 0);
+    ~GrepEngine();
+    void start(const QString &dirPath, const QStringList &nameFilters, bool recursive,
+               const TextEditor::KeywordData &keyword, QTextCodec *defaultCodec);
+    void start(const QList<QTextDocument *> &documents, const QStringList &names,
+               const TextEditor::KeywordData &keyword);
+    void cancel();
+    bool isRunning() const { return job != 0; }
+    static QString requiredLiteral(const TextEditor::KeywordData &keyword);
+    static const char *findLiteral(const char *begin, const char *end, const QByteArray &literal, bool caseSensitive);
+
+signals:
+    void found(const QVector<GrepEngine::Match> &matches);
+    void finished(int files, int matches, bool cancelled);
+
+private slots:
+    void flushMatches();
+    void jobFinished(int generation);
+    void takeSnapshot();
+    void updateIndex(const QString &dirPath);
+
+private:
+    static QString patternLiteral(const QString &pattern);
+    static bool buildIndex(const QString &dirPath, QAtomicInt *cancelled);
+    bool createJob(const TextEditor::KeywordData &keyword, QTextCodec *defaultCodec);
+    void startWorkers();
+
+private:
+    QThreadPool pool;
+    GrepJob *job;                           // 実行中の検索
+    int generation;                         // 中止した検索の通知を無視するための番号
+    QTimer snapshotTimer;
+    QList<QPointer<QTextDocument> > snapshotDocuments;  // 断片を作成する文書
+    QStringList snapshotNames;
+    int snapshotIndex;                      // 断片を作成中の文書
+    int snapshotBlock;                      // 次の断片の先頭ブロック
+    int snapshotRevision;                   // 取り出し始めた時の文書の版
+    int snapshotSerial;                     // 取り出し中の文書の断片に付ける番号(取り出し直す度に変える)
+    int snapshotRestarts;                   // 取り出し中の文書を取り出し直した回数
+    QHash<int, QPointer<QTextDocument> > snapshotOwners;    // 断片の番号毎の文書(結果に設定する)
+    int snapshotChunks;                     // 作成した断片の数(作業者へ順に振り分ける)
+    QFutureWatcher<bool> indexWatcher;      // 索引の作成(検索の中止では止めない)
+    QAtomicInt indexCancelled;
+};
+
+#endif // GREPENGINE_H
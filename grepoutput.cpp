@@ -0,0 +1,221 @@
+#include "grepoutput.h"
+#include <QAbstractTableModel>
+#include <QDir>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QSet>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+/**
+ * Grepの結果のモデル(末尾への追加のみ)
+ */
+class GrepResultModel : public QAbstractTableModel
+{
+public:
+    enum COLUMN {
+        COLUMN_FILE,
+        COLUMN_LINE,
+        COLUMN_TEXT,
+        COLUMN_MAX
+    };
+
+public:
+    explicit GrepResultModel(QObject *parent = 0) : QAbstractTableModel(parent) {}
+
+    void clear(const QString &dirPath)
+    {
+        beginResetModel();
+        matches.clear();
+        baseDir = QDir(dirPath);
+        endResetModel();
+    }
+
+    void append(const QVector<GrepEngine::Match> &appended)
+    {
+        if (appended.isEmpty()) {
+            return;
+        }
+        beginInsertRows(QModelIndex(), matches.size(), matches.size() + appended.size() - 1);
+        matches += appended;
+        endInsertRows();
+    }
+
+    const GrepEngine::Match &match(int row) const { return matches.at(row); }
+
+    /* 一致したファイル(開いている文書の結果を除く、重複なし) */
+    QStringList filePaths() const
+    {
+        QStringList paths;
+        QSet<QString> added;
+        foreach (const GrepEngine::Match &match, matches) {
+            if (!match.document && !added.contains(match.filePath)) {
+                added.insert(match.filePath);
+                paths.append(match.filePath);
+            }
+        }
+        return paths;
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : matches.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : COLUMN_MAX;
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const
+    {
+        if (!index.isValid() || index.row() >= matches.size()) {
+            return QVariant();
+        }
+        const GrepEngine::Match &match = matches.at(index.row());
+
+        switch (role) {
+        case Qt::DisplayRole:
+            switch (index.column()) {
+            case COLUMN_FILE:
+                if (match.document) {
+                    return QDir::toNativeSeparators(match.filePath);
+                }
+                return QDir::toNativeSeparators(baseDir.relativeFilePath(match.filePath));
+            case COLUMN_LINE:
+                return match.line;
+            case COLUMN_TEXT:
+                return match.text.trimmed();
+            default:
+                break;
+            }
+            break;
+        case Qt::ToolTipRole:
+            return QDir::toNativeSeparators(match.filePath);
+        default:
+            break;
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const
+    {
+        if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+            return QVariant();
+        }
+        switch (section) {
+        case COLUMN_FILE:
+            return QObject::tr("ファイル");
+        case COLUMN_LINE:
+            return QObject::tr("行番号");
+        case COLUMN_TEXT:
+            return QObject::tr("内容");
+        default:
+            return QVariant();
+        }
+    }
+
+private:
+    QVector<GrepEngine::Match> matches;
+    QDir baseDir;                           // ファイル名を相対パスで表示する基準
+};
+
+GrepOutput::GrepOutput(QWidget *parent) :
+    QDockWidget(parent),
+    replaceEnabled(false),
+    replaceRunning(false)
+{
+    setWindowTitle(tr("Grep"));
+
+    model = new GrepResultModel(this);
+    treeView = new QTreeView(this);
+    treeView->setRootIsDecorated(false);
+    treeView->setUniformRowHeights(true);
+    treeView->setModel(model);
+
+    replaceButton = new QPushButton(tr("ファイルを置換(&R)..."), this);
+    replaceButton->setEnabled(false);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(replaceButton);
+
+    QWidget *container = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(container);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(2);
+    layout->addWidget(treeView);
+    layout->addLayout(buttonLayout);
+    setWidget(container);
+
+    connect(treeView, SIGNAL(activated(QModelIndex)), this, SLOT(activateIndex(QModelIndex)));
+    connect(replaceButton, SIGNAL(clicked()), this, SLOT(replaceClicked()));
+}
+
+void GrepOutput::start(const QString &text, const QString &dirPath)
+{
+    model->clear(dirPath);
+    replaceEnabled = false;
+    updateReplaceButton();
+    setWindowTitle(tr("Grep - %1 (検索中)").arg(text));
+    show();
+    raise();
+}
+
+void GrepOutput::setReplaceEnabled(bool enabled)
+{
+    replaceEnabled = enabled;
+    updateReplaceButton();
+}
+
+/**
+ * 置換中はボタンを中止に切り替える
+ */
+void GrepOutput::setReplaceRunning(bool running)
+{
+    replaceRunning = running;
+    updateReplaceButton();
+}
+
+void GrepOutput::replaceClicked()
+{
+    if (replaceRunning) {
+        emit replaceCancelRequested();
+    } else {
+        emit replaceRequested();
+    }
+}
+
+void GrepOutput::updateReplaceButton()
+{
+    replaceButton->setText(replaceRunning ? tr("置換を中止(&R)") : tr("ファイルを置換(&R)..."));
+    replaceButton->setEnabled(replaceRunning || replaceEnabled);
+}
+
+QStringList GrepOutput::filePaths() const
+{
+    return model->filePaths();
+}
+
+void GrepOutput::appendMatches(const QVector<GrepEngine::Match> &matches)
+{
+    model->append(matches);
+}
+
+void GrepOutput::finish(int files, int matches, bool cancelled)
+{
+    QString title = tr("Grep - %1件 (%2ファイル)").arg(matches).arg(files);
+    if (cancelled) {
+        title += tr(" 中止");
+    }
+    setWindowTitle(title);
+}
+
+void GrepOutput::activateIndex(const QModelIndex &index)
+{
+    if (!index.isValid()) {
+        return;
+    }
+    emit activated(model->match(index.row()));
+}
@@ -0,0 +1,51 @@
+#ifndef GREPOUTPUT_H
+#define GREPOUTPUT_H
+
+#include <QDockWidget>
+#include <QModelIndex>
+#include "grepengine.h"
+
+class QPushButton;
+class QTreeView;
+class GrepResultModel;
+
+/**
+ * Grepの結果を表示するドック
+ * 検索中も見つかった結果から順に追加する
+ * ディレクトリの検索結果は、一致したファイルをまとめて置換できる(置換中はボタンで中止できる)
+ */
+class GrepOutput : public QDockWidget
+{
+    Q_OBJECT
+public:
+    explicit GrepOutput(QWidget *parent = 0);
+    void start(const QString &text, const QString &dirPath);
+    void setReplaceEnabled(bool enabled);
+    void setReplaceRunning(bool running);
+    QStringList filePaths() const;
+
+public slots:
+    void appendMatches(const QVector<GrepEngine::Match> &matches);
+    void finish(int files, int matches, bool cancelled);
+
+signals:
+    void activated(const GrepEngine::Match &match);
+    void replaceRequested();
+    void replaceCancelRequested();
+
+private slots:
+    void activateIndex(const QModelIndex &index);
+    void replaceClicked();
+
+private:
+    void updateReplaceButton();
+
+private:
+    QTreeView *treeView;
+    QPushButton *replaceButton;
+    bool replaceEnabled;                    // 結果のファイルを置換できる
+    bool replaceRunning;                    // 置換中(ボタンで中止できる)
+    GrepResultModel *model;
+};
+
+#endif // GREPOUTPUT_H
@@ -1,177 +1,783 @@
 #include <QtGui>
+#include <QtConcurrentRun>
+#include <climits>
 #include "highlighter.h"
+#include "regexpcache.h"
 
 Highlighter::Highlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent)
+    : QSyntaxHighlighter(parent), dirty(0), dirtyFindMask(0), flushScheduled(false), suspended(false),
+      nextBlock(-1), passFlags(0), passFindMask(0), visibleFirst(0), visibleLast(0),
+      visibleDoneFirst(-1), visibleDoneLast(-1), keepAfterBlock(-1),
+      passId(0), preparedUntil(INT_MAX), dispatchedUntil(0), runningJobs(0)
 {
-    memset(findwordsCount, 0, sizeof(findwordsCount));
+    backgroundTimer = new QTimer(this);
+    backgroundTimer->setInterval(0);
+    connect(backgroundTimer, SIGNAL(timeout()), this, SLOT(continueHighlight()));
+
+    ruleSet.generation = 0;
+    findRuleSet.generation = 0;
+    findRuleSet.rules.resize(10);
+
+    for (int i = 0; i < 10; ++i) {
+        findwords[i].option.caseSensitive = false;
+        findwords[i].option.wholeWords = false;
+        findwords[i].option.regularExpression = false;
+        findwords[i].highlightIndex = i;
+    }
 }
 
+/**
+ * 全ての規則を作り直し、ドキュメント全体を直ちに再強調する
+ */
 void Highlighter::rehighlight()
 {
-    keywordRules.clear();
+    ++passId;
+    backgroundTimer->stop();
+    nextBlock = -1;
+    passFlags = 0;
+    passFindMask = 0;
+    dirty = 0;
+    dirtyFindMask = 0;
+
+    updateKeywordRules();
+    updateFindRules();
+    updateFormatTables();
+    QSyntaxHighlighter::rehighlight();
+    emit finished();
+}
+
+/**
+ * 強調を一時停止する(ファイル読込み中など)
+ * 再開時に全体の再強調を予約する
+ */
+void Highlighter::setSuspended(bool suspended)
+{
+    if (this->suspended == suspended) {
+        return;
+    }
+    this->suspended = suspended;
+    if (suspended) {
+        ++passId;
+        backgroundTimer->stop();
+        nextBlock = -1;
+    } else {
+        markDirty(DirtyKeywords);
+    }
+}
+
+/**
+ * 表示中のブロック範囲を設定する
+ * 背景処理がまだ届いていない範囲が表示された場合は、その範囲を先に強調する
+ */
+void Highlighter::setVisibleBlocks(int first, int last)
+{
+    visibleFirst = first;
+    visibleLast = last;
+    if (nextBlock >= 0 && last >= nextBlock && keepAfterBlock < 0
+            && (first != visibleDoneFirst || last != visibleDoneLast)) {
+        highlightVisibleBlocks();
+    }
+}
+
+/**
+ * 強調色を更新する
+ * 有効・無効が変わらず色だけが変わった場合は、規則を作り直さず計算結果を使い回す
+ */
+void Highlighter::updateHighlightFormats(const QList<QVariant> &formats)
+{
+    const bool rulesChanged = !isSameEnabled(highlightFormats, formats);
+    highlightFormats = formats;
+    markDirty(rulesChanged ? DirtyKeywords : DirtyFormats);
+}
+
+void Highlighter::updateFindFormats(const QList<QVariant> &formats)
+{
+    const bool rulesChanged = !isSameEnabled(findFormats, formats);
+    findFormats = formats;
+    markDirty(rulesChanged ? DirtyFindwords : DirtyFindFormats, 0x3ff);
+}
+
+void Highlighter::updateKeywords(const QList<QVariant> &keywords)
+{
+    this->keywords = keywords;
+    markDirty(DirtyKeywords);
+}
+
+void Highlighter::updateBlockwords(const QList<QVariant> &blockwords)
+{
+    this->blockwords = blockwords;
+    markDirty(DirtyKeywords);
+}
+
+void Highlighter::updateFindwords(const TextEditor::KeywordData words[])
+{
+    int mask = 0;
+    for (int i = 0; i < 10; ++i) {
+        if (!isSameKeyword(findwords[i], words[i])) {
+            findwords[i] = words[i];
+            mask |= 1 << i;
+        }
+    }
+    if (mask) {
+        markDirty(DirtyFindwords, mask);
+    }
+}
+
+/**
+ * 検索文字列に一致した行番号を返す
+ * 背景処理中(isFinished()がfalse)は処理済みのブロックのみの部分的な結果となる
+ */
+QVector<int> Highlighter::findwordMatchLines(int index)
+{
+    flush();
+
+    QVector<int> lines;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        HighlighterBlockData *data = static_cast<HighlighterBlockData *>(block.userData());
+        if (data && data->findCount[index] > 0) {
+            lines.append(block.blockNumber() + 1);
+        }
+    }
+    return lines;
+}
+
+/**
+ * 検索文字列の一致数を返す
+ * 背景処理中(isFinished()がfalse)は処理済みのブロックのみの部分的な結果となる
+ */
+int Highlighter::findwordCount(int index)
+{
+    flush();
+
+    int count = 0;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        HighlighterBlockData *data = static_cast<HighlighterBlockData *>(block.userData());
+        if (data) {
+            count += data->findCount[index];
+        }
+    }
+    return count;
+}
+
+/**
+ * 溜まった変更をまとめて反映する
+ * キーワードの変更は全体を、検索文字列のみの変更は変更前後で一致するブロックだけを再強調する
+ * 表示中のブロックを先に強調し、残りは背景処理で少しずつ強調する
+ */
+void Highlighter::flush()
+{
+    flushScheduled = false;
+    if (suspended || !dirty || !document()) {
+        return;
+    }
+
+    if (dirty & DirtyKeywords) {
+        updateKeywordRules();
+    }
+    if (dirty & DirtyFindwords) {
+        updateFindRules();
+    }
+    updateFormatTables();
+
+    /* 実行中の再強調があれば対象を合わせて最初からやり直す */
+    passFlags |= dirty;
+    passFindMask |= dirtyFindMask;
+    dirty = 0;
+    dirtyFindMask = 0;
+    startPass();
+}
+
+/**
+ * 再強調を開始する
+ * 照合が必要な場合は、表示範囲以外の計算をワーカースレッドに依頼する
+ */
+void Highlighter::startPass()
+{
+    ++passId;
+    nextBlock = 0;
+    visibleDoneFirst = -1;
+    visibleDoneLast = -1;
+    preparedChunks.clear();
+    dispatchedUntil = 0;
+    preparedUntil = (passFlags & (DirtyKeywords | DirtyFindwords)) ? 0 : INT_MAX;
+
+    highlightVisibleBlocks();
+    if (preparedUntil == 0) {
+        dispatchJobs();
+    }
+    backgroundTimer->start();
+}
+
+/**
+ * 実行中のワーカーがスレッド数の2倍になるまで、続きのブロックの計算を依頼する
+ */
+void Highlighter::dispatchJobs()
+{
+    const int maxJobs = qMax(1, QThread::idealThreadCount()) * 2;
+    const int blockCount = document()->blockCount();
+    while (runningJobs < maxJobs && dispatchedUntil < blockCount) {
+        const int last = qMin(dispatchedUntil + TOKENIZE_CHUNK_BLOCKS, blockCount);
+        dispatchJob(dispatchedUntil, last);
+        dispatchedUntil = last;
+    }
+}
+
+/**
+ * ブロックの文字列を写してワーカーに計算を依頼する
+ * 先頭のブロックの前の状態は現在の状態を仮定し、違っていればGUIスレッドで計算し直す
+ */
+void Highlighter::dispatchJob(int first, int last)
+{
+    TokenizeJob job;
+    job.passId = passId;
+    job.revision = document()->revision();
+    job.firstBlock = first;
+    job.lastBlock = last;
+
+    QTextBlock block = document()->findBlockByNumber(first);
+    job.startState = block.previous().isValid() ? block.previous().userState() : -1;
+    for (int i = first; i < last && block.isValid(); ++i, block = block.next()) {
+        job.texts.append(block.text());
+    }
+    job.rules = cloneRuleSet();
+    job.findRules = cloneFindRuleSet();
+
+    QFutureWatcher<TokenizeResult> *watcher = new QFutureWatcher<TokenizeResult>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(applyTokenizeResult()));
+    watcher->setFuture(QtConcurrent::run(&Highlighter::runTokenizeJob, job));
+    ++runningJobs;
+}
+
+/**
+ * ワーカーの計算結果を各ブロックのキャッシュに格納する
+ * 計算中に編集された(版が変わった)結果は捨てて依頼し直す
+ */
+void Highlighter::applyTokenizeResult()
+{
+    QFutureWatcher<TokenizeResult> *watcher = static_cast<QFutureWatcher<TokenizeResult> *>(sender());
+    const TokenizeResult result = watcher->result();
+    watcher->deleteLater();
+    --runningJobs;
+
+    if (result.passId != passId || nextBlock < 0 || !document()) {
+        return;
+    }
+    if (result.revision != document()->revision()) {
+        dispatchJob(result.firstBlock, qMax(result.firstBlock, qMin(result.lastBlock, document()->blockCount())));
+        return;
+    }
+
+    QTextBlock block = document()->findBlockByNumber(result.firstBlock);
+    for (int i = 0; i < result.blocks.size() && block.isValid(); ++i, block = block.next()) {
+        const TokenizeBlock &r = result.blocks[i];
+        HighlighterBlockData *data = static_cast<HighlighterBlockData *>(block.userData());
+        if (!data) {
+            data = new HighlighterBlockData;
+            block.setUserData(data);
+        }
+        data->textHash = r.textHash;
+        data->textLength = r.textLength;
+        if (result.generation == ruleSet.generation) {
+            data->previousState = r.previousState;
+            data->state = r.state;
+            data->generation = result.generation;
+            data->ranges = r.ranges;
+        } else {
+            data->generation = -1;
+        }
+        if (result.findGeneration == findRuleSet.generation) {
+            /* 以前の検索文字列だけに一致していたブロックも強調し直す必要がある */
+            if (!isSameRanges(data->findRanges, r.findRanges)) {
+                data->findChanged = true;
+            }
+            data->findGeneration = result.findGeneration;
+            data->findRanges = r.findRanges;
+            memcpy(data->findCount, r.findCount, sizeof(data->findCount));
+        } else {
+            data->findGeneration = -1;
+        }
+    }
+
+    preparedChunks.insert(result.firstBlock, result.lastBlock);
+    while (preparedChunks.contains(preparedUntil)) {
+        preparedUntil = preparedChunks.take(preparedUntil);
+    }
+    dispatchJobs();
+    if (!backgroundTimer->isActive()) {
+        backgroundTimer->start();
+    }
+}
+
+/**
+ * ワーカースレッドで実行する(GUIのオブジェクトには触れない)
+ */
+Highlighter::TokenizeResult Highlighter::runTokenizeJob(const TokenizeJob &job)
+{
+    TokenizeResult result;
+    result.passId = job.passId;
+    result.revision = job.revision;
+    result.firstBlock = job.firstBlock;
+    result.lastBlock = job.lastBlock;
+    result.generation = job.rules.generation;
+    result.findGeneration = job.findRules.generation;
+    result.blocks.resize(job.texts.size());
+
+    int state = job.startState;
+    for (int i = 0; i < job.texts.size(); ++i) {
+        const QString &text = job.texts[i];
+        TokenizeBlock &r = result.blocks[i];
+        r.textHash = qHash(text);
+        r.textLength = text.length();
+        r.previousState = state;
+        r.state = tokenize(text, state, job.rules, r.ranges);
+        tokenizeFind(text, job.findRules, r.findRanges, r.findCount);
+        state = r.state;
+    }
+    return result;
+}
+
+/**
+ * ワーカー用に規則を複製する
+ * QRegExpは照合の状態を持つため、スレッド間で同じオブジェクトを共有しないよう要素毎に複製する
+ */
+Highlighter::RuleSet Highlighter::cloneRuleSet() const
+{
+    RuleSet rules;
+    rules.generation = ruleSet.generation;
+    rules.keywordMatcher = ruleSet.keywordMatcher;
+    foreach (const KeywordRule &rule, ruleSet.keywordRules) {
+        rules.keywordRules.append(rule);
+    }
+    foreach (const BlockwordRule &rule, ruleSet.blockwordRules) {
+        rules.blockwordRules.append(rule);
+    }
+    return rules;
+}
+
+Highlighter::FindRuleSet Highlighter::cloneFindRuleSet() const
+{
+    FindRuleSet rules;
+    rules.generation = findRuleSet.generation;
+    foreach (const KeywordRule &rule, findRuleSet.rules) {
+        rules.rules.append(rule);
+    }
+    return rules;
+}
+
+void Highlighter::highlightVisibleBlocks()
+{
+    visibleDoneFirst = visibleFirst;
+    visibleDoneLast = visibleLast;
+
+    keepAfterBlock = visibleLast;
+    QTextBlock block = document()->findBlockByNumber(qMax(visibleFirst, nextBlock));
+    while (block.isValid() && block.blockNumber() <= visibleLast) {
+        if (needsHighlight(block)) {
+            rehighlightBlock(block);
+        }
+        block = block.next();
+    }
+    keepAfterBlock = -1;
+}
+
+/**
+ * 背景処理(HIGHLIGHT_SLICE_MSEC毎に制御を返す)
+ * 複数行キーワードの状態変化が連鎖しても、処理範囲より後のブロックは次回に回す
+ */
+void Highlighter::continueHighlight()
+{
+    if (suspended || nextBlock < 0 || !document()) {
+        backgroundTimer->stop();
+        return;
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    QTextBlock block = document()->findBlockByNumber(nextBlock);
+    while (block.isValid()) {
+        /* ワーカーの計算が追い付いていなければ結果を待つ */
+        if (nextBlock >= preparedUntil) {
+            backgroundTimer->stop();
+            break;
+        }
+        keepAfterBlock = nextBlock;
+        if (needsHighlight(block)) {
+            rehighlightBlock(block);
+        }
+        block = block.next();
+        ++nextBlock;
+        if (elapsed.elapsed() >= HIGHLIGHT_SLICE_MSEC) {
+            break;
+        }
+    }
+    keepAfterBlock = -1;
+
+    if (!block.isValid()) {
+        backgroundTimer->stop();
+        nextBlock = -1;
+        passFlags = 0;
+        passFindMask = 0;
+        emit finished();
+    }
+}
+
+bool Highlighter::needsHighlight(const QTextBlock &block) const
+{
+    if (passFlags & (DirtyKeywords | DirtyFormats)) {
+        return true;
+    }
+
+    /* 一致数・強調範囲はワーカーが計算済み(ここでは照合しない) */
+    HighlighterBlockData *data = static_cast<HighlighterBlockData *>(block.userData());
+    if (!data) {
+        return false;
+    }
+    if (data->findChanged) {
+        return true;
+    }
+    for (int i = 0; i < findRuleSet.rules.size(); ++i) {
+        if ((passFindMask & (1 << i)) && data->findCount[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Highlighter::isSameRanges(const QVector<HighlightRange> &a, const QVector<HighlightRange> &b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); ++i) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length || a[i].slot != b[i].slot) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 現在のブロックの強調と状態をそのまま維持する
+ */
+void Highlighter::keepCurrentFormats()
+{
+    QTextLayout *layout = currentBlock().layout();
+    if (!layout) {
+        return;
+    }
+    foreach (const QTextLayout::FormatRange &range, layout->additionalFormats()) {
+        setFormat(range.start, range.length, range.format);
+    }
+}
+
+void Highlighter::markDirty(int flags, int findMask)
+{
+    dirty |= flags;
+    dirtyFindMask |= findMask;
+    if (!flushScheduled) {
+        flushScheduled = true;
+        QTimer::singleShot(0, this, SLOT(flush()));
+    }
+}
+
+/**
+ * キーワード・複数行キーワードの規則を作り直す(世代を進め、各ブロックの計算結果を無効にする)
+ */
+void Highlighter::updateKeywordRules()
+{
+    ++ruleSet.generation;
+
+    ruleSet.keywordRules.clear();
+    ruleSet.keywordMatcher.clear();
     foreach (const QVariant &keyword, keywords) {
         const TextEditor::KeywordData &data = keyword.value<TextEditor::KeywordData>();
         if ((unsigned int)highlightFormats.count() <= (unsigned int)data.highlightIndex) continue;
         const TextEditor::TextFormat &format = highlightFormats[data.highlightIndex].value<TextEditor::TextFormat>();
         if (!format.enabled) continue;
         Highlighter::KeywordRule rule;
-        rule.pattern = Highlighter::convertText(data.text, data.option);
-        rule.format = Highlighter::convertFormat(format);
-        keywordRules.append(rule);
+        rule.literal = !data.option.regularExpression;
+        if (rule.literal) {
+            ruleSet.keywordMatcher.addKeyword(data.text, ruleSet.keywordRules.size(),
+                                              data.option.caseSensitive, data.option.wholeWords);
+        } else {
+            rule.pattern = Highlighter::convertText(data.text, data.option);
+        }
+        rule.slot = data.highlightIndex;
+        ruleSet.keywordRules.append(rule);
     }
+    ruleSet.keywordMatcher.build();
 
-    blockwordRules.clear();
+    ruleSet.blockwordRules.clear();
     foreach (const QVariant &keyword, blockwords) {
         const TextEditor::BlockwordData &data = keyword.value<TextEditor::BlockwordData>();
         if ((unsigned int)highlightFormats.count() <= (unsigned int)data.highlightIndex) continue;
         const TextEditor::TextFormat &format = highlightFormats[data.highlightIndex].value<TextEditor::TextFormat>();
         if (!format.enabled) continue;
         Highlighter::BlockwordRule rule;
+        rule.index = ruleSet.blockwordRules.size();
+        rule.depth = 0;
         rule.beginPattern = Highlighter::convertText(data.beginText, data.option);
         rule.endPattern = Highlighter::convertText(data.endText, data.option);
-        rule.format = Highlighter::convertFormat(format);
-        blockwordRules.append(rule);
+        rule.slot = data.highlightIndex;
+        ruleSet.blockwordRules.append(rule);
     }
+}
+
+/**
+ * 検索文字列の規則を作り直す(世代を進め、各ブロックの計算結果を無効にする)
+ * 検索文字列の番号と一致数の添字を揃えるため、無効な規則も空のパターンとして残す
+ */
+void Highlighter::updateFindRules()
+{
+    ++findRuleSet.generation;
 
-    findRules.clear();
     for (int i = 0; i < 10; ++i) {
+        KeywordRule &rule = findRuleSet.rules[i];
+        rule.pattern = QRegExp();
+        rule.slot = i;
+        rule.literal = false;
+
         const TextEditor::KeywordData &data = findwords[i];
         if (findFormats.count() <= i) continue;
+        if (data.text.isEmpty()) continue;
         const TextEditor::TextFormat &format = findFormats[i].value<TextEditor::TextFormat>();
         if (!format.enabled) continue;
-        Highlighter::KeywordRule rule;
         rule.pattern = Highlighter::convertText(data.text, data.option);
-        rule.format = Highlighter::convertFormat(format);
-        findRules.append(rule);
-        findwordsCount[i] = 0;
-        findwordsLine[i].clear();
     }
-
-    QSyntaxHighlighter::rehighlight();
 }
 
-void Highlighter::updateHighlightFormats(const QList<QVariant> &formats)
+/**
+ * スロット毎の書式を作り直す
+ */
+void Highlighter::updateFormatTables()
 {
-    highlightFormats = formats;
-    rehighlight();
+    highlightFormatTable.clear();
+    foreach (const QVariant &format, highlightFormats) {
+        highlightFormatTable.append(Highlighter::convertFormat(format.value<TextEditor::TextFormat>()));
+    }
+
+    findFormatTable.clear();
+    foreach (const QVariant &format, findFormats) {
+        findFormatTable.append(Highlighter::convertFormat(format.value<TextEditor::TextFormat>()));
+    }
 }
 
-void Highlighter::updateFindFormats(const QList<QVariant> &formats)
+bool Highlighter::isSameKeyword(const TextEditor::KeywordData &a, const TextEditor::KeywordData &b)
 {
-    findFormats = formats;
-    rehighlight();
+    return a.text == b.text
+            && a.option.caseSensitive == b.option.caseSensitive
+            && a.option.wholeWords == b.option.wholeWords
+            && a.option.regularExpression == b.option.regularExpression
+            && a.highlightIndex == b.highlightIndex;
 }
 
-void Highlighter::updateKeywords(const QList<QVariant> &keywords)
+/**
+ * 書式の有効・無効が全て同じか(同じなら規則は変わらない)
+ */
+bool Highlighter::isSameEnabled(const QList<QVariant> &a, const QList<QVariant> &b)
 {
-    this->keywords = keywords;
-    rehighlight();
+    if (a.count() != b.count()) {
+        return false;
+    }
+    for (int i = 0; i < a.count(); ++i) {
+        if (a[i].value<TextEditor::TextFormat>().enabled != b[i].value<TextEditor::TextFormat>().enabled) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void Highlighter::updateBlockwords(const QList<QVariant> &blockwords)
+/**
+ * ブロックを強調する
+ * 文字列・前のブロックの状態・規則の世代が前回と同じなら、パターンを照合せず前回の強調範囲を使う
+ */
+void Highlighter::highlightBlock(const QString &text)
 {
-    this->blockwords = blockwords;
-    rehighlight();
+    if (suspended) {
+        return;
+    }
+    if (keepAfterBlock >= 0 && currentBlock().blockNumber() > keepAfterBlock) {
+        keepCurrentFormats();
+        return;
+    }
+
+    HighlighterBlockData *data = static_cast<HighlighterBlockData *>(currentBlockUserData());
+    if (!data) {
+        data = new HighlighterBlockData;
+        setCurrentBlockUserData(data);
+    }
+
+    const uint hash = qHash(text);
+    const bool sameText = data->textHash == hash && data->textLength == text.length();
+    const int previousState = previousBlockState();
+    QList<int> slowRules;
+
+    if (!sameText || data->previousState != previousState || data->generation != ruleSet.generation) {
+        data->state = tokenize(text, previousState, ruleSet, data->ranges, &slowRules);
+        data->previousState = previousState;
+        data->generation = ruleSet.generation;
+        foreach (int index, slowRules) {
+            ruleSet.keywordRules[index].pattern = QRegExp();
+        }
+    }
+
+    if (!sameText || data->findGeneration != findRuleSet.generation) {
+        slowRules.clear();
+        tokenizeFind(text, findRuleSet, data->findRanges, data->findCount, &slowRules);
+        data->findGeneration = findRuleSet.generation;
+        foreach (int index, slowRules) {
+            findRuleSet.rules[index].pattern = QRegExp();
+        }
+    }
+
+    data->textHash = hash;
+    data->textLength = text.length();
+
+    applyRanges(data->ranges, highlightFormatTable);
+    setCurrentBlockState(data->state);
+    applyRanges(data->findRanges, findFormatTable);
+    data->findChanged = false;
 }
 
-void Highlighter::updateFindwords(const TextEditor::KeywordData words[])
+void Highlighter::applyRanges(const QVector<HighlightRange> &ranges, const QVector<QTextCharFormat> &formats)
 {
-    memcpy(findwords, words, sizeof(findwords));
-    rehighlight();
+    foreach (const HighlightRange &range, ranges) {
+        if ((unsigned int)range.slot < (unsigned int)formats.size()) {
+            setFormat(range.start, range.length, formats[range.slot]);
+        }
+    }
 }
 
-QVector<int> Highlighter::findwordMatchLines(int index) const
+/**
+ * 正規表現に一致する範囲を追加する
+ * 1行の照合が制限時間を超えた正規表現は拒否し、falseを返す
+ * (時間は一致の合間に確認するため、1回の indexIn が長引く場合は止められない)
+ */
+static bool matchRegExp(const QRegExp &expression, const QString &text, int slot,
+                        QVector<HighlightRange> &ranges, int *count)
 {
-    return findwordsLine[index];
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    int index = expression.indexIn(text);
+    while (index >= 0) {
+        const int length = expression.matchedLength();
+        if (!length) break;
+        HighlightRange range = { index, length, slot };
+        ranges.append(range);
+        if (count) {
+            ++*count;
+        }
+        if (elapsed.elapsed() > RegExpCache::TIME_LIMIT_MSEC) {
+            qWarning("Highlighter: regular expression too slow, disabled: %s", qPrintable(expression.pattern()));
+            RegExpCache::reject(expression);
+            return false;
+        }
+        index = expression.indexIn(text, index + length);
+    }
+    return true;
 }
 
-void Highlighter::highlightBlock(const QString &text)
+/**
+ * 1ブロック分の文字列からキーワード・複数行キーワードの強調範囲を求め、ブロックの状態を返す
+ * 書式を直接設定せず、メンバも参照しないため、文字列の写しに対してどこからでも呼べる
+ * 範囲は適用する順(後の範囲が優先)に並ぶ
+ */
+int Highlighter::tokenize(const QString &text, int previousState, const RuleSet &rules,
+                          QVector<HighlightRange> &ranges, QList<int> *slowRules)
 {
-    foreach (const KeywordRule &rule, keywordRules) {
-        if (!rule.pattern.isValid()) { continue; }
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while (index >= 0) {
-            int length = expression.matchedLength();
-            if (!length) break;
-            setFormat(index, length, rule.format);
-            index = expression.indexIn(text, index + length);
+    ranges.clear();
+
+    /* 正規表現でないキーワードは1回の走査でまとめて照合し、規則の順に並べる */
+    QVector<KeywordMatcher::Match> matches;
+    rules.keywordMatcher.match(text, matches);
+    int matchIndex = 0;
+    for (int i = 0; i < rules.keywordRules.size(); ++i) {
+        const KeywordRule &rule = rules.keywordRules[i];
+        if (rule.literal) {
+            for (; matchIndex < matches.size() && matches[matchIndex].rule == i; ++matchIndex) {
+                HighlightRange range = { matches[matchIndex].start, matches[matchIndex].length, rule.slot };
+                ranges.append(range);
+            }
+            continue;
+        }
+        if (rule.pattern.isEmpty() || !rule.pattern.isValid()) { continue; }
+        if (!matchRegExp(rule.pattern, text, rule.slot, ranges, 0) && slowRules) {
+            slowRules->append(i);
         }
     }
 
-    for (int i = 0; i < blockwordRules.size(); ++i)
+    int state = -1;
+    for (int i = 0; i < rules.blockwordRules.size(); ++i)
     {
-        if (!blockwordRules[i].beginPattern.isValid()) { continue; }
-        if (!blockwordRules[i].endPattern.isValid()) { continue; }
-        setCurrentBlockState(0);
+        const BlockwordRule &rule = rules.blockwordRules[i];
+        if (!rule.beginPattern.isValid()) { continue; }
+        if (!rule.endPattern.isValid()) { continue; }
+        state = 0;
 
         int startIndex = 0;
         int addLen = 0;
-        if (previousBlockState() != (i+1))
+        if (previousState != (i+1))
         {
-            startIndex = text.indexOf(blockwordRules[i].beginPattern);
-            addLen = blockwordRules[i].beginPattern.matchedLength();
+            startIndex = rule.beginPattern.indexIn(text);
+            addLen = rule.beginPattern.matchedLength();
         }
 
         while (startIndex >= 0)
         {
-            int endIndex = text.indexOf(blockwordRules[i].endPattern, startIndex + addLen);
+            int endIndex = rule.endPattern.indexIn(text, startIndex + addLen);
             int length;
             if (endIndex >= addLen)
             {
-                setCurrentBlockState(0);
+                state = 0;
                 length = endIndex - startIndex
-                        + blockwordRules[i].endPattern.matchedLength();
+                        + rule.endPattern.matchedLength();
             }
             else
             {
-                setCurrentBlockState(i+1);
+                state = i+1;
                 length = text.length() - startIndex;
             }
             if (!length) break;
-            setFormat(startIndex, length, blockwordRules[i].format);
-            startIndex = text.indexOf(blockwordRules[i].beginPattern,
-                                      startIndex + length);
+            HighlightRange range = { startIndex, length, rule.slot };
+            ranges.append(range);
+            startIndex = rule.beginPattern.indexIn(text, startIndex + length);
         }
-        if (currentBlockState() == (i+1) )
+        if (state == (i+1))
         {
             break;
         }
     }
 
-    int coun_index = -1;
-    foreach (const KeywordRule &rule, findRules) {
-        ++coun_index;
-        if (!rule.pattern.isValid()) { continue; }
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while (index >= 0) {
-            int length = expression.matchedLength();
-            if (!length) break;
-            setFormat(index, length, rule.format);
-            index = expression.indexIn(text, index + length);
-            ++findwordsCount[coun_index];
-            findwordsLine[coun_index].append(currentBlock().blockNumber() + 1);
+    return state;
+}
+
+/**
+ * 1ブロック分の文字列から検索文字列の強調範囲と一致数を求める
+ */
+void Highlighter::tokenizeFind(const QString &text, const FindRuleSet &rules,
+                               QVector<HighlightRange> &ranges, int counts[10], QList<int> *slowRules)
+{
+    ranges.clear();
+    memset(counts, 0, sizeof(int) * 10);
+    for (int i = 0; i < rules.rules.size() && i < 10; ++i) {
+        const KeywordRule &rule = rules.rules[i];
+        if (rule.pattern.isEmpty() || !rule.pattern.isValid()) { continue; }
+        if (!matchRegExp(rule.pattern, text, rule.slot, ranges, &counts[i]) && slowRules) {
+            slowRules->append(i);
         }
     }
 }
 
+/**
+ * 検索文字列とオプションから正規表現を作成する(作成済みのものは共有キャッシュから返す)
+ */
 QRegExp Highlighter::convertText(QString text, const TextEditor::KeywordOption &option)
 {
-    Qt::CaseSensitivity cs = Qt::CaseInsensitive;
-
-    if (option.caseSensitive) {
-        cs = Qt::CaseSensitive;
-    }
-    if (!option.regularExpression) {
-        text = QRegExp::escape(text);
-    }
-    if (option.wholeWords) {
-        text = "\\b" + text + "\\b";
-    }
-    return QRegExp(text, cs);
+    return RegExpCache::regExp(text, option);
 }
+
 QTextCharFormat Highlighter::convertFormat(const TextEditor::TextFormat &format)
 {
     QTextCharFormat toFormat;
@@ -2,7 +2,45 @@
 #define HIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QTextBlockUserData>
+#include <QMap>
+#include <QTimer>
+#include <string.h>
 #include "texteditor.h"
+#include "keywordmatcher.h"
+
+/**
+ * 強調範囲
+ * 書式はスロット番号(強調色・検索色の番号)で参照し、色の変更だけなら計算結果を使い回せるようにする
+ */
+typedef struct tagHighlightRange {
+    int start;
+    int length;
+    int slot;
+} HighlightRange;
+
+/**
+ * ブロック毎の強調結果のキャッシュと検索文字列の一致数
+ */
+class HighlighterBlockData : public QTextBlockUserData
+{
+public:
+    HighlighterBlockData()
+        : textHash(0), textLength(-1), previousState(-1), state(-1), generation(-1), findGeneration(-1), findChanged(false)
+    {
+        memset(findCount, 0, sizeof(findCount));
+    }
+    uint textHash;                      // ブロックの文字列のハッシュ値
+    int textLength;                     // ブロックの文字列の長さ
+    int previousState;                  // 計算時の前のブロックの状態
+    int state;                          // 計算したブロックの状態
+    int generation;                     // 計算時のキーワード規則の世代
+    QVector<HighlightRange> ranges;     // キーワード・複数行キーワードの強調範囲
+    int findGeneration;                 // 計算時の検索文字列規則の世代
+    QVector<HighlightRange> findRanges; // 検索文字列の強調範囲
+    int findCount[10];
+    bool findChanged;                   // 強調した後に検索文字列の強調範囲が変わった
+};
 
 class Highlighter : public QSyntaxHighlighter
 {
@@ -11,7 +49,8 @@ public:
     typedef struct tagKeywordRule
     {
         QRegExp pattern;
-        QTextCharFormat format;
+        int slot;                       // 書式のスロット番号
+        bool literal;                   // 正規表現を使わずKeywordMatcherで照合する
     } KeywordRule;
 
     typedef struct tagBlockwordRule
@@ -20,20 +59,91 @@ public:
         int depth;
         QRegExp beginPattern;
         QRegExp endPattern;
-        QTextCharFormat format;
+        int slot;                       // 書式のスロット番号
     } BlockwordRule;
+
+    typedef struct tagRuleSet
+    {
+        int generation;                 // 規則を作り直す度に増える
+        QVector<KeywordRule> keywordRules;
+        KeywordMatcher keywordMatcher;  // keywordRulesの正規表現でないキーワード
+        QVector<BlockwordRule> blockwordRules;
+    } RuleSet;
+
+    typedef struct tagFindRuleSet
+    {
+        int generation;                 // 規則を作り直す度に増える
+        QVector<KeywordRule> rules;     // 検索文字列の番号順(無効な規則は空のパターン)
+    } FindRuleSet;
+
+    typedef struct tagTokenizeJob
+    {
+        int passId;                     // 依頼した再強調の番号
+        int revision;                   // 文字列を写した時のドキュメントの版
+        int firstBlock;                 // 先頭のブロック番号
+        int lastBlock;                  // 末尾の次のブロック番号
+        int startState;                 // 先頭のブロックの前の状態(想定値)
+        QVector<QString> texts;         // ブロックの文字列の写し
+        RuleSet rules;                  // ワーカー専用に複製した規則
+        FindRuleSet findRules;
+    } TokenizeJob;
+
+    typedef struct tagTokenizeBlock
+    {
+        uint textHash;
+        int textLength;
+        int previousState;
+        int state;
+        QVector<HighlightRange> ranges;
+        QVector<HighlightRange> findRanges;
+        int findCount[10];
+    } TokenizeBlock;
+
+    typedef struct tagTokenizeResult
+    {
+        int passId;
+        int revision;
+        int firstBlock;
+        int lastBlock;
+        int generation;
+        int findGeneration;
+        QVector<TokenizeBlock> blocks;
+    } TokenizeResult;
+
+    enum {
+        DirtyKeywords = 0x01,           // キーワード・複数行キーワードの規則の作り直しが必要
+        DirtyFindwords = 0x02,          // 検索文字列の規則の作り直しが必要
+        DirtyFormats = 0x04,            // 強調色のみ変更(計算結果を使い回せる)
+        DirtyFindFormats = 0x08         // 検索色のみ変更(計算結果を使い回せる)
+    };
+
+    enum {
+        HIGHLIGHT_SLICE_MSEC = 5,       // 1回のイベントループで背景処理に使う時間
+        TOKENIZE_CHUNK_BLOCKS = 1000    // ワーカーに1回で依頼するブロック数
+    };
+
     explicit Highlighter(QTextDocument *parent = 0);
     void rehighlight();
+    void setSuspended(bool suspended);
+    void setVisibleBlocks(int first, int last);
+    bool isFinished() const { return nextBlock < 0 && !dirty; }
     void updateHighlightFormats(const QList<QVariant> &formats);
     void updateFindFormats(const QList<QVariant> &formats);
     void updateKeywords(const QList<QVariant> &words);
     void updateBlockwords(const QList<QVariant> &words);
     void updateFindwords(const TextEditor::KeywordData words[]);
-    QVector<int> findwordMatchLines(int index) const;
-    inline int findwordCount(int index) const
-    {
-        return findwordsCount[index];
-    }
+    QVector<int> findwordMatchLines(int index);
+    int findwordCount(int index);
+
+public slots:
+    void flush();
+
+private slots:
+    void continueHighlight();
+    void applyTokenizeResult();
+
+signals:
+    void finished();
 
 protected:
     void highlightBlock(const QString &text);
@@ -41,6 +151,29 @@ protected:
 public:
     static QRegExp convertText(QString text, const TextEditor::KeywordOption &option);
     static QTextCharFormat convertFormat(const TextEditor::TextFormat &format);
+    static int tokenize(const QString &text, int previousState, const RuleSet &rules,
+                        QVector<HighlightRange> &ranges, QList<int> *slowRules = 0);
+    static void tokenizeFind(const QString &text, const FindRuleSet &rules,
+                             QVector<HighlightRange> &ranges, int counts[10], QList<int> *slowRules = 0);
+    static TokenizeResult runTokenizeJob(const TokenizeJob &job);
+
+private:
+    void markDirty(int flags, int findMask = 0);
+    void updateKeywordRules();
+    void updateFindRules();
+    void updateFormatTables();
+    void startPass();
+    void dispatchJobs();
+    void dispatchJob(int first, int last);
+    RuleSet cloneRuleSet() const;
+    FindRuleSet cloneFindRuleSet() const;
+    void highlightVisibleBlocks();
+    bool needsHighlight(const QTextBlock &block) const;
+    void keepCurrentFormats();
+    void applyRanges(const QVector<HighlightRange> &ranges, const QVector<QTextCharFormat> &formats);
+    static bool isSameKeyword(const TextEditor::KeywordData &a, const TextEditor::KeywordData &b);
+    static bool isSameEnabled(const QList<QVariant> &a, const QList<QVariant> &b);
+    static bool isSameRanges(const QVector<HighlightRange> &a, const QVector<HighlightRange> &b);
 
 private:
     QList<QVariant> highlightFormats;
@@ -48,11 +181,28 @@ private:
     QList<QVariant> keywords;
     QList<QVariant> blockwords;
     TextEditor::KeywordData findwords[10];
-    QVector<KeywordRule> keywordRules;
-    QVector<BlockwordRule> blockwordRules;
-    QVector<KeywordRule> findRules;
-    int findwordsCount[10];
-    QVector<int> findwordsLine[10];
+    RuleSet ruleSet;
+    FindRuleSet findRuleSet;
+    QVector<QTextCharFormat> highlightFormatTable;  // 強調色のスロット毎の書式
+    QVector<QTextCharFormat> findFormatTable;       // 検索色のスロット毎の書式
+    int dirty;                          // 未反映の変更(Dirty*の組合せ)
+    int dirtyFindMask;                  // 変更された検索文字列(ビット毎)
+    bool flushScheduled;
+    bool suspended;
+    QTimer *backgroundTimer;            // 背景処理用
+    int nextBlock;                      // 背景処理で次に強調するブロック(-1:処理なし)
+    int passFlags;                      // 実行中の再強調の対象(Dirty*の組合せ)
+    int passFindMask;                   // 実行中の再強調の対象となる検索文字列(ビット毎)
+    int visibleFirst;                   // 表示中の先頭ブロック
+    int visibleLast;                    // 表示中の末尾ブロック
+    int visibleDoneFirst;               // 実行中の再強調で強調済みの表示範囲
+    int visibleDoneLast;
+    int keepAfterBlock;                 // このブロックより後は既存の強調を維持する(-1:無効)
+    int passId;                         // 再強調の番号(古い再強調のワーカーの結果を捨てる)
+    int preparedUntil;                  // ワーカーが計算済みの範囲(このブロックより前)
+    int dispatchedUntil;                // ワーカーに依頼済みの範囲(このブロックより前)
+    QMap<int, int> preparedChunks;      // 計算済みで未連結の範囲(先頭 -> 末尾の次)
+    int runningJobs;                    // 実行中のワーカーの数
 };
 
 #endif // HIGHLIGHTER_H
@@ -6,7 +6,7 @@
 
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = MyEditor
 TEMPLATE = app
@@ -23,7 +23,21 @@ SOURCES += main.cpp\
     outline.cpp \
     replacedialog.cpp \
     grepdialog.cpp \
-    tagsmakedialog.cpp
+    tagsmakedialog.cpp \
+    lineindex.cpp \
+    atomicfile.cpp \
+    codecdetector.cpp \
+    keywordmatcher.cpp \
+    regexpcache.cpp \
+    tagsindex.cpp \
+    tagsmaker.cpp \
+    symbolscanner.cpp \
+    outlinemodel.cpp \
+    grepengine.cpp \
+    grepoutput.cpp \
+    trigramindex.cpp \
+    filefinderdialog.cpp \
+    filereplacer.cpp
 
 HEADERS  += mainwindow.h \
     texteditor.h \
@@ -36,7 +50,21 @@ HEADERS  += mainwindow.h \
     outline.h \
     replacedialog.h \
     grepdialog.h \
-    tagsmakedialog.h
+    tagsmakedialog.h \
+    lineindex.h \
+    atomicfile.h \
+    codecdetector.h \
+    keywordmatcher.h \
+    regexpcache.h \
+    tagsindex.h \
+    tagsmaker.h \
+    symbolscanner.h \
+    outlinemodel.h \
+    grepengine.h \
+    grepoutput.h \
+    trigramindex.h \
+    filefinderdialog.h \
+    filereplacer.h
 
 FORMS    += configdialog.ui \
     configpages/configeditorpage.ui \
@@ -44,7 +72,8 @@ FORMS    += configdialog.ui \
     finddialog.ui \
     replacedialog.ui \
     grepdialog.ui \
-    tagsmakedialog.ui
+    tagsmakedialog.ui \
+    filefinderdialog.ui
 
 RESOURCES += \
     res.qrc
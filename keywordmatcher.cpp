@@ -0,0 +1,235 @@
+#include "keywordmatcher.h"
+#include <QtAlgorithms>
+
+static inline bool lessThanMatch(const KeywordMatcher::Match &a, const KeywordMatcher::Match &b)
+{
+    if (a.rule != b.rule) {
+        return a.rule < b.rule;
+    }
+    return a.start < b.start;
+}
+
+/* QRegExpの\bと同じ単語構成文字 */
+static inline bool isWordChar(const QChar &c)
+{
+    return c.isLetterOrNumber() || c.isMark() || c == QLatin1Char('_');
+}
+
+KeywordMatcher::Automaton::Automaton()
+{
+    clear();
+}
+
+void KeywordMatcher::Automaton::clear()
+{
+    nodes.clear();
+    edges.clear();
+
+    Node root;
+    root.fail = 0;
+    root.outputLink = -1;
+    nodes.append(root);
+    for (int i = 0; i < 128; ++i) {
+        rootAscii[i] = 0;
+    }
+}
+
+int KeywordMatcher::Automaton::child(int state, ushort c) const
+{
+    if (state == 0 && c < 128) {
+        return rootAscii[c] ? rootAscii[c] : -1;
+    }
+    return edges.value((static_cast<quint64>(state) << 16) | c, -1);
+}
+
+void KeywordMatcher::Automaton::add(const QString &text, int pattern)
+{
+    int state = 0;
+    for (int i = 0; i < text.size(); ++i) {
+        const ushort c = text.at(i).unicode();
+        int next = child(state, c);
+        if (next < 0) {
+            Node node;
+            node.fail = 0;
+            node.outputLink = -1;
+            next = nodes.size();
+            nodes.append(node);
+            if (state == 0 && c < 128) {
+                rootAscii[c] = next;
+            } else {
+                edges.insert((static_cast<quint64>(state) << 16) | c, next);
+            }
+        }
+        state = next;
+    }
+    nodes[state].outputs.append(pattern);
+}
+
+/**
+ * 幅優先で失敗遷移と出力リンクを求める
+ */
+void KeywordMatcher::Automaton::build()
+{
+    /* 子ノードの一覧(根のASCII遷移を含む) */
+    QVector<QVector<QPair<ushort, int> > > children(nodes.size());
+    for (int c = 0; c < 128; ++c) {
+        if (rootAscii[c]) {
+            children[0].append(qMakePair(static_cast<ushort>(c), rootAscii[c]));
+        }
+    }
+    for (QHash<quint64, int>::const_iterator it = edges.constBegin(); it != edges.constEnd(); ++it) {
+        children[static_cast<int>(it.key() >> 16)].append(qMakePair(static_cast<ushort>(it.key() & 0xffff), it.value()));
+    }
+
+    QVector<int> queue;
+    queue.reserve(nodes.size());
+    foreach (const QPair<ushort, int> &edge, children[0]) {
+        nodes[edge.second].fail = 0;
+        queue.append(edge.second);
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int state = queue[head];
+        foreach (const QPair<ushort, int> &edge, children[state]) {
+            int fail = nodes[state].fail;
+            int target = child(fail, edge.first);
+            while (target < 0 && fail != 0) {
+                fail = nodes[fail].fail;
+                target = child(fail, edge.first);
+            }
+            const int to = edge.second;
+            nodes[to].fail = (target >= 0 && target != to) ? target : 0;
+            const Node &failNode = nodes[nodes[to].fail];
+            nodes[to].outputLink = failNode.outputs.isEmpty() ? failNode.outputLink : nodes[to].fail;
+            queue.append(to);
+        }
+    }
+}
+
+int KeywordMatcher::Automaton::next(int state, ushort c) const
+{
+    int target = child(state, c);
+    while (target < 0 && state != 0) {
+        state = nodes[state].fail;
+        target = child(state, c);
+    }
+    return target < 0 ? 0 : target;
+}
+
+KeywordMatcher::KeywordMatcher()
+{
+}
+
+void KeywordMatcher::clear()
+{
+    patterns.clear();
+    sensitive.clear();
+    insensitive.clear();
+}
+
+/**
+ * キーワードを登録する(登録後はbuild()を呼ぶこと)
+ * ruleは一致結果の並び順と重なりの判定に使う規則の番号
+ */
+void KeywordMatcher::addKeyword(const QString &text, int rule, bool caseSensitive, bool wholeWords)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+
+    Pattern pattern;
+    pattern.rule = rule;
+    pattern.length = text.size();
+    pattern.wholeWords = wholeWords;
+    patterns.append(pattern);
+
+    if (caseSensitive) {
+        sensitive.add(text, patterns.size() - 1);
+    } else {
+        /* 照合時と同じく1文字ずつ小文字にする(QString::toLowerは長さが変わる場合がある) */
+        QString folded(text);
+        for (int i = 0; i < folded.size(); ++i) {
+            folded[i] = folded.at(i).toLower();
+        }
+        insensitive.add(folded, patterns.size() - 1);
+    }
+}
+
+void KeywordMatcher::build()
+{
+    sensitive.build();
+    insensitive.build();
+}
+
+/**
+ * 全キーワードの一致位置を規則順・位置順に返す
+ * 規則毎にQRegExpで先頭から順に検索した場合と同じく、同じ規則内で重なる一致は除く
+ */
+void KeywordMatcher::match(const QString &text, QVector<Match> &matches) const
+{
+    matches.clear();
+    if (patterns.isEmpty() || text.isEmpty()) {
+        return;
+    }
+
+    QVector<Match> found;
+    if (!sensitive.isEmpty()) {
+        collect(sensitive, text, false, found);
+    }
+    if (!insensitive.isEmpty()) {
+        collect(insensitive, text, true, found);
+    }
+    qSort(found.begin(), found.end(), lessThanMatch);
+
+    int rule = -1;
+    int lastEnd = 0;
+    foreach (const Match &m, found) {
+        if (m.rule != rule) {
+            rule = m.rule;
+            lastEnd = 0;
+        }
+        if (m.start >= lastEnd) {
+            matches.append(m);
+            lastEnd = m.start + m.length;
+        }
+    }
+}
+
+void KeywordMatcher::collect(const Automaton &automaton, const QString &text, bool fold, QVector<Match> &matches) const
+{
+    const QChar *data = text.constData();
+    const int size = text.size();
+    int state = 0;
+
+    for (int i = 0; i < size; ++i) {
+        const ushort c = fold ? data[i].toLower().unicode() : data[i].unicode();
+        state = automaton.next(state, c);
+
+        int node = automaton.nodes[state].outputs.isEmpty() ? automaton.nodes[state].outputLink : state;
+        while (node > 0) {
+            foreach (int index, automaton.nodes[node].outputs) {
+                const Pattern &pattern = patterns[index];
+                const int start = i + 1 - pattern.length;
+                if (pattern.wholeWords
+                        && (!isWordBoundary(text, start) || !isWordBoundary(text, i + 1))) {
+                    continue;
+                }
+                Match m;
+                m.rule = pattern.rule;
+                m.start = start;
+                m.length = pattern.length;
+                matches.append(m);
+            }
+            node = automaton.nodes[node].outputLink;
+        }
+    }
+}
+
+/**
+ * QRegExpの\bと同じく、前後の文字の一方だけが単語構成文字である位置を境界とする
+ */
+bool KeywordMatcher::isWordBoundary(const QString &text, int pos)
+{
+    const bool before = pos > 0 && isWordChar(text.at(pos - 1));
+    const bool after = pos < text.size() && isWordChar(text.at(pos));
+    return before != after;
+}
@@ -0,0 +1,70 @@
+#ifndef KEYWORDMATCHER_H
+#define KEYWORDMATCHER_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * 正規表現でないキーワードをまとめて照合する(Aho-Corasick法)
+ *
+ * 大文字小文字を区別するキーワードと区別しないキーワードで別々のオートマトンを作り、
+ * 1行を各1回だけ走査して全キーワードの一致位置を求める。
+ */
+class KeywordMatcher
+{
+public:
+    typedef struct tagMatch {
+        int rule;                           // 規則の番号
+        int start;                          // 開始位置
+        int length;                         // 長さ
+    } Match;
+
+public:
+    KeywordMatcher();
+    void clear();
+    void addKeyword(const QString &text, int rule, bool caseSensitive, bool wholeWords);
+    void build();
+    bool isEmpty() const { return patterns.isEmpty(); }
+    void match(const QString &text, QVector<Match> &matches) const;
+
+private:
+    typedef struct tagPattern {
+        int rule;
+        int length;
+        bool wholeWords;
+    } Pattern;
+
+    typedef struct tagNode {
+        int fail;                           // 失敗時の遷移先
+        int outputLink;                     // 失敗遷移を辿って最初に出力を持つノード(-1:なし)
+        QVector<int> outputs;               // このノードで終わるパターン
+    } Node;
+
+    class Automaton
+    {
+    public:
+        Automaton();
+        void clear();
+        void add(const QString &text, int pattern);
+        void build();
+        bool isEmpty() const { return nodes.size() <= 1; }
+        int next(int state, ushort c) const;
+        int child(int state, ushort c) const;
+
+    public:
+        QVector<Node> nodes;
+        QHash<quint64, int> edges;          // (ノード << 16 | 文字) -> 遷移先
+        int rootAscii[128];                 // 根からのASCII文字の遷移(高速化用)
+    };
+
+    static bool isWordBoundary(const QString &text, int pos);
+    void collect(const Automaton &automaton, const QString &text, bool fold, QVector<Match> &matches) const;
+
+private:
+    QVector<Pattern> patterns;
+    Automaton sensitive;                    // 大文字小文字を区別する
+    Automaton insensitive;                  // 大文字小文字を区別しない(小文字に揃える)
+};
+
+#endif // KEYWORDMATCHER_H
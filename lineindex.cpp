@@ -0,0 +1,146 @@
+#include "lineindex.h"
+#include <string.h>
+#include <algorithm>
+
+LineIndex::LineIndex()
+    : data(0), size(0), scanned(0), count(0), separator('\n')
+{
+}
+
+LineIndex::~LineIndex()
+{
+    close();
+}
+
+bool LineIndex::open(const QString &fileName, char separator)
+{
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    size = file.size();
+    data = reinterpret_cast<const char *>(file.map(0, size));
+    if (!data) {
+        file.close();
+        return false;
+    }
+
+    this->separator = separator;
+    scanned = 0;
+    count = 1;
+    checkpoints.clear();
+    checkpoints.append(0);
+    return true;
+}
+
+void LineIndex::close()
+{
+    if (data) {
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+        data = 0;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    size = 0;
+    scanned = 0;
+    count = 0;
+    checkpoints.clear();
+}
+
+/**
+ * 最大maxBytes分だけ索引を作成する
+ * 索引の作成が完了した場合はtrueを返す
+ */
+bool LineIndex::buildStep(qint64 maxBytes)
+{
+    if (!data) {
+        return true;
+    }
+
+    const qint64 end = qMin(size, scanned + maxBytes);
+    const char *p = data + scanned;
+    const char *last = data + end;
+    while (p < last) {
+        const char *found = static_cast<const char *>(memchr(p, separator, last - p));
+        if (!found) {
+            break;
+        }
+        p = found + 1;
+        if (count % LINE_INDEX_STRIDE == 0) {
+            checkpoints.append(p - data);
+        }
+        ++count;
+    }
+    scanned = end;
+
+    return isBuilt();
+}
+
+/**
+ * 行頭のオフセットを返す(lineは0始まり)
+ */
+qint64 LineIndex::lineOffset(int line) const
+{
+    if (line <= 0 || !data) {
+        return 0;
+    }
+    if (line >= count) {
+        return size;
+    }
+
+    qint64 offset = checkpoints.at(line / LINE_INDEX_STRIDE);
+    for (int i = line % LINE_INDEX_STRIDE; i > 0; --i) {
+        const char *found = static_cast<const char *>(memchr(data + offset, separator, size - offset));
+        if (!found) {
+            return size;
+        }
+        offset = found - data + 1;
+    }
+    return offset;
+}
+
+/**
+ * オフセットを含む行を返す(0始まり)
+ * チェックポイントを二分探索し、残りは読み飛ばして求める
+ */
+int LineIndex::lineForOffset(qint64 offset) const
+{
+    if (offset <= 0 || !data) {
+        return 0;
+    }
+
+    const int checkpoint = static_cast<int>(std::upper_bound(checkpoints.constBegin(), checkpoints.constEnd(), offset)
+                                            - checkpoints.constBegin()) - 1;
+    int line = checkpoint * LINE_INDEX_STRIDE;
+    qint64 begin = checkpoints.at(checkpoint);
+    while (line < count - 1) {
+        const char *found = static_cast<const char *>(memchr(data + begin, separator, size - begin));
+        if (!found || found - data + 1 > offset) {
+            break;
+        }
+        begin = found - data + 1;
+        ++line;
+    }
+    return line;
+}
+
+/**
+ * 改行コードを除いた行データを返す
+ */
+QByteArray LineIndex::lineData(int line) const
+{
+    if (!data || line < 0 || line >= count) {
+        return QByteArray();
+    }
+
+    const qint64 begin = lineOffset(line);
+    const char *found = static_cast<const char *>(memchr(data + begin, separator, size - begin));
+    qint64 end = found ? (found - data) : size;
+    if (separator == '\n' && end > begin && data[end - 1] == '\r') {
+        --end;
+    }
+    return QByteArray::fromRawData(data + begin, static_cast<int>(end - begin));
+}
@@ -0,0 +1,44 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QFile>
+#include <QVector>
+
+/**
+ * メモリマップしたファイルの行頭オフセット索引
+ *
+ * 全行のオフセットを持つと巨大ファイルでは索引自体が肥大化するため、
+ * LINE_INDEX_STRIDE行毎のオフセットのみを保持し、残りは読み飛ばして求める。
+ */
+class LineIndex
+{
+public:
+    enum { LINE_INDEX_STRIDE = 16 };
+
+public:
+    LineIndex();
+    ~LineIndex();
+    bool open(const QString &fileName, char separator = '\n');
+    void close();
+    bool isOpen() const { return data != 0; }
+    bool buildStep(qint64 maxBytes);
+    bool isBuilt() const { return scanned >= size; }
+    qint64 scannedSize() const { return scanned; }
+    qint64 fileSize() const { return size; }
+    QString errorString() const { return file.errorString(); }
+    int lineCount() const { return count; }
+    qint64 lineOffset(int line) const;
+    int lineForOffset(qint64 offset) const;
+    QByteArray lineData(int line) const;
+
+private:
+    QFile file;
+    const char *data;
+    qint64 size;
+    qint64 scanned;
+    int count;
+    char separator;
+    QVector<qint64> checkpoints;
+};
+
+#endif // LINEINDEX_H
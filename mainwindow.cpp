@@ -3,9 +3,13 @@
 #include "addressbar.h"
 #include "texteditor.h"
 #include "highlighter.h"
+#include "regexpcache.h"
 #include "configdialog.h"
 #include "outline.h"
+#include "grepoutput.h"
+#include "filefinderdialog.h"
 #include "tagsmakedialog.h"
+#include "tagsindex.h"
 
 #define STATUS_MSG_TIMEOUT  (2000)
 
@@ -31,11 +35,23 @@ MainWindow::MainWindow(QWidget *parent)
     outlineDock->setObjectName("outline");
     outlineDock->setAllowedAreas(Qt::AllDockWidgetAreas);
     outlineDock->setFeatures(QDockWidget::AllDockWidgetFeatures);
+    grepOutputDock = new GrepOutput(this);
+    grepOutputDock->setObjectName("grepOutput");
+    grepOutputDock->setAllowedAreas(Qt::AllDockWidgetAreas);
+    grepOutputDock->setFeatures(QDockWidget::AllDockWidgetFeatures);
+    grepOutputDock->hide();
     findDialog = new FindDialog(this);
     replaceDialog = new ReplaceDialog(this);
     grepDialog = new GrepDialog(this);
+    grepEngine = new GrepEngine(this);
+    fileReplacer = new FileReplacer(this);
+    replacedOpenFiles = 0;
+    replacedOpenCount = 0;
+    markIndex = -1;
+    tagsIndex = new TagsIndex;
 
     addDockWidget(Qt::RightDockWidgetArea, outlineDock);
+    addDockWidget(Qt::BottomDockWidgetArea, grepOutputDock);
 
     createActions();
     createToolBar();
@@ -63,10 +79,21 @@ MainWindow::MainWindow(QWidget *parent)
     connect(dirOpenMapper, SIGNAL(mapped(QString)), this, SLOT(openDir(QString)));
     connect(outlineDock, SIGNAL(changedSelection(int)), this, SLOT(updateEditLine(int)));
     connect(findDialog, SIGNAL(find(FindDialog::FindParam)), SLOT(find(FindDialog::FindParam)));
+    connect(grepDialog, SIGNAL(grep(GrepDialog::GrepParam)), SLOT(grep(GrepDialog::GrepParam)));
+    connect(grepEngine, SIGNAL(found(QVector<GrepEngine::Match>)), this, SLOT(appendGrepMatches(QVector<GrepEngine::Match>)));
+    connect(grepEngine, SIGNAL(finished(int,int,bool)), this, SLOT(grepFinished(int,int,bool)));
+    connect(grepOutputDock, SIGNAL(activated(GrepEngine::Match)), this, SLOT(openGrepMatch(GrepEngine::Match)));
+    connect(grepOutputDock, SIGNAL(replaceRequested()), this, SLOT(replaceInFiles()));
+    connect(grepOutputDock, SIGNAL(replaceCancelRequested()), fileReplacer, SLOT(cancel()));
+    connect(fileReplacer, SIGNAL(previewFinished(QVector<FileReplacer::Result>,bool)),
+            this, SLOT(replacePreviewFinished(QVector<FileReplacer::Result>,bool)));
+    connect(fileReplacer, SIGNAL(applyFinished(QVector<FileReplacer::Result>,bool)),
+            this, SLOT(replaceApplyFinished(QVector<FileReplacer::Result>,bool)));
 }
 
 MainWindow::~MainWindow()
 {
+    delete tagsIndex;
 }
 
 QList<TextEditor *> MainWindow::textEditorList()
@@ -126,6 +153,33 @@ void MainWindow::openFile(QString fileName)
     }
 }
 
+/**
+ * ファイル名のあいまい検索で開く
+ * 最後にGrepしたディレクトリ(なければ編集中のファイルのディレクトリ、それもなければ選択したディレクトリ)を対象にする
+ */
+void MainWindow::findFile()
+{
+    QString dirPath = grepDirPath;
+    if (dirPath.isEmpty()) {
+        TextEditor *activeEdit = activeMdiChild();
+        if (activeEdit && !activeEdit->isUntitled()) {
+            dirPath = QFileInfo(activeEdit->currentFile()).absolutePath();
+        } else {
+            dirPath = QFileDialog::getExistingDirectory(this, tr("ファイル名で開く"),
+                                                        QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation));
+        }
+        if (dirPath.isEmpty()) {
+            return;
+        }
+    }
+
+    FileFinderDialog d(this);
+    d.setDirPath(dirPath);
+    if (d.exec() == QDialog::Accepted) {
+        openFile(d.selectedFile());
+    }
+}
+
 void MainWindow::openDir(QString path)
 {
     QString fileName = QFileDialog::getOpenFileName(this, tr("ファイルを開く"),
@@ -325,9 +379,38 @@ void MainWindow::marking(int index, const TextEditor::KeywordData &keyword)
     TextEditor *activeEdit = activeMdiChild();
     if (!activeEdit)
         return;
+    markIndex = index;
+    markText = keyword.text;
     activeEdit->setFindword(index, keyword);
     QVector<int> matchLines = activeEdit->findwordMatchLines(index);
     outlineDock->updateFindwordMatchLines(matchLines);
+    showFindwordCount(activeEdit);
+}
+
+/**
+ * 背景での強調処理の完了後に、確定した一致数・一致行で表示を更新する
+ */
+void MainWindow::updateFindwordMatchLines()
+{
+    TextEditor *activeEdit = activeMdiChild();
+    if (!activeEdit || activeEdit != sender() || markIndex < 0)
+        return;
+    outlineDock->updateFindwordMatchLines(activeEdit->findwordMatchLines(markIndex));
+    showFindwordCount(activeEdit);
+}
+
+/**
+ * マークした文字列の一致数を表示する(背景での強調処理中は途中までの数として表示する)
+ */
+void MainWindow::showFindwordCount(TextEditor *textEdit)
+{
+    if (markIndex < 0 || markText.isEmpty())
+        return;
+    QString message = tr("\"%1\" %2件").arg(markText).arg(textEdit->findwordsCount(markIndex));
+    if (!textEdit->isHighlightFinished()) {
+        message += tr(" (集計中)");
+    }
+    statusBar()->showMessage(message, STATUS_MSG_TIMEOUT);
 }
 
 void MainWindow::findNext()
@@ -336,7 +419,12 @@ void MainWindow::findNext()
     if (!activeEdit)
         return;
 
-    QRegExp pattern(Highlighter::convertText(lastSearch.data.text, lastSearch.data.option));
+    bool rejected;
+    QRegExp pattern(RegExpCache::regExp(lastSearch.data.text, lastSearch.data.option, &rejected));
+    if (rejected) {
+        statusBar()->showMessage(tr("\"%1\" は複雑すぎるため検索できません").arg(lastSearch.data.text), STATUS_MSG_TIMEOUT);
+        return;
+    }
     QTextCursor cursor = activeEdit->document()->find(pattern, activeEdit->textCursor());
     if (!cursor.isNull()) {
         activeEdit->setTextCursor(cursor);
@@ -369,7 +457,12 @@ void MainWindow::findPrev()
     if (!activeEdit)
         return;
 
-    QRegExp pattern(Highlighter::convertText(lastSearch.data.text, lastSearch.data.option));
+    bool rejected;
+    QRegExp pattern(RegExpCache::regExp(lastSearch.data.text, lastSearch.data.option, &rejected));
+    if (rejected) {
+        statusBar()->showMessage(tr("\"%1\" は複雑すぎるため検索できません").arg(lastSearch.data.text), STATUS_MSG_TIMEOUT);
+        return;
+    }
     QTextCursor cursor = activeEdit->document()->find(pattern, activeEdit->textCursor(), QTextDocument::FindBackward);
     if (!cursor.isNull()) {
         activeEdit->setTextCursor(cursor);
@@ -415,6 +508,15 @@ void MainWindow::replace()
 
 void MainWindow::grep()
 {
+    TextEditor *activeEdit = activeMdiChild();
+    if (activeEdit) {
+        const QString selected = activeEdit->textCursor().selectedText();
+        if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+            grepDialog->setText(selected);
+        }
+        grepDialog->setDefaultDirPath(QFileInfo(activeEdit->currentFile()).absolutePath());
+    }
+
     if (grepDialog->isHidden()) {
         grepDialog->show();
         grepDialog->exec();
@@ -424,6 +526,277 @@ void MainWindow::grep()
     }
 }
 
+/**
+ * Grepを実行する
+ * ディレクトリは GrepEngine で別スレッドから検索し、見つかった結果から順に出力する
+ */
+void MainWindow::grep(GrepDialog::GrepParam param)
+{
+    grepEngine->cancel();
+    lastGrep = param;
+
+    /* 出力先のエディタを作成すると作業中のウィンドウが変わるため、先に検索する文書を決めておく */
+    QList<TextEditor *> editors;
+    if (param.mode == GrepDialog::MODE_CURRENT_WINDOW) {
+        if (activeMdiChild() && activeMdiChild() != grepEditor) {
+            editors << activeMdiChild();
+        }
+    } else if (param.mode != GrepDialog::MODE_DIR) {
+        editors = textEditorList();
+        editors.removeAll(grepEditor);
+    }
+
+    const QString dirPath = QDir(param.dirPath).absolutePath();
+    if (param.output == GrepDialog::OUTPUT_EDITOR) {
+        grepEditor = createTextEditor();
+        grepEditor->newFile();
+        grepEditor->show();
+    } else {
+        grepEditor = 0;
+        grepOutputDock->start(param.data.text, param.mode == GrepDialog::MODE_DIR ? dirPath : QString());
+    }
+
+    if (param.mode == GrepDialog::MODE_DIR) {
+        grepDirPath = dirPath;
+        statusBar()->showMessage(tr("Grep検索中..."));
+        grepEngine->start(dirPath, param.nameFilters, param.subDir, param.data,
+                          QTextCodec::codecForName(TextEditor::configs(0).defTextCodecName));
+        return;
+    }
+
+    /* 開いている文書を検索する(保存していない内容も対象にする) */
+    QList<QTextDocument *> documents;
+    QStringList names;
+    foreach (TextEditor *textEdit, editors) {
+        documents << textEdit->document();
+        names << textEdit->currentFile();
+    }
+    statusBar()->showMessage(tr("Grep検索中..."));
+    grepEngine->start(documents, names, param.data);
+}
+
+void MainWindow::appendGrepMatches(const QVector<GrepEngine::Match> &matches)
+{
+    if (!grepEditor) {
+        grepOutputDock->appendMatches(matches);
+        return;
+    }
+
+    QString lines;
+    foreach (const GrepEngine::Match &match, matches) {
+        lines += QString("%1(%2,%3): %4\n").arg(QDir::toNativeSeparators(match.filePath))
+                .arg(match.line).arg(match.column + 1).arg(match.text);
+    }
+    QTextCursor cursor(grepEditor->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(lines);
+}
+
+void MainWindow::grepFinished(int files, int matches, bool cancelled)
+{
+    if (!grepEditor) {
+        grepOutputDock->finish(files, matches, cancelled);
+        grepOutputDock->setReplaceEnabled(lastGrep.mode == GrepDialog::MODE_DIR && !cancelled && matches > 0);
+    }
+    if (cancelled) {
+        statusBar()->showMessage(tr("Grepを中止しました"), STATUS_MSG_TIMEOUT);
+    } else {
+        statusBar()->showMessage(tr("Grep終了 %1件 (%2ファイル)").arg(matches).arg(files), STATUS_MSG_TIMEOUT);
+    }
+}
+
+/**
+ * Grepの結果の位置を開く
+ * 開いている文書の結果はファイルを開き直さず、その文書のブロックへ移動する
+ */
+void MainWindow::openGrepMatch(const GrepEngine::Match &match)
+{
+    QMdiSubWindow *window = 0;
+    if (match.document) {
+        foreach (QMdiSubWindow *subWindow, mdiArea->subWindowList()) {
+            TextEditor *textEdit = qobject_cast<TextEditor *>(subWindow->widget());
+            if (textEdit && textEdit->document() == match.document) {
+                window = subWindow;
+                break;
+            }
+        }
+    }
+    if (!window) {
+        openFile(match.filePath);
+        window = findMdiChild(match.filePath);
+    }
+    if (!window) {
+        return;
+    }
+    mdiArea->setActiveSubWindow(window);
+    TextEditor *textEdit = qobject_cast<TextEditor *>(window->widget());
+    textEdit->setCursorForPosition(match.line, match.column);
+    textEdit->setFocus();
+}
+
+/**
+ * ディレクトリのGrepで一致したファイルを置換する
+ * まず置換する数を数えて確認し、了承された場合に書き換える。
+ * 開いている文書はファイルを書き換えず、文書を置換する(保存はしない)。
+ */
+void MainWindow::replaceInFiles()
+{
+    if (fileReplacer->isRunning()) {
+        return;
+    }
+    bool ok = false;
+    const QString after = QInputDialog::getText(this, tr("ファイルを置換"),
+                                                tr("「%1」の置換後の文字列:").arg(lastGrep.data.text),
+                                                QLineEdit::Normal, replaceAfter, &ok);
+    if (!ok) {
+        return;
+    }
+    replaceAfter = after;
+    replaceOpenCounts.clear();
+    replaceReadOnlyFiles.clear();
+
+    bool rejected = false;
+    RegExpCache::regExp(lastGrep.data.text, lastGrep.data.option, &rejected);
+    if (rejected || lastGrep.data.text.isEmpty()) {
+        QMessageBox::warning(this, tr("ファイルを置換"), tr("この検索文字列では置換できません。"));
+        return;
+    }
+
+    QStringList files;
+    foreach (const QString &filePath, grepOutputDock->filePaths()) {
+        TextEditor *textEdit = findOpenEditor(filePath);
+        if (!textEdit) {
+            files << filePath;
+        } else if (textEdit->isReadOnly()) {
+            replaceReadOnlyFiles << filePath;
+        } else {
+            replaceOpenCounts.insert(filePath, textEdit->countMatches(lastGrep.data.text, lastGrep.data.option));
+        }
+    }
+
+    if (!fileReplacer->preview(files, lastGrep.data, after, QTextCodec::codecForName(TextEditor::configs(0).defTextCodecName))) {
+        QMessageBox::warning(this, tr("ファイルを置換"), tr("この検索文字列では置換できません。"));
+        return;
+    }
+    grepOutputDock->setReplaceRunning(true);
+    statusBar()->showMessage(tr("置換する箇所を数えています..."));
+}
+
+void MainWindow::replacePreviewFinished(const QVector<FileReplacer::Result> &results, bool cancelled)
+{
+    grepOutputDock->setReplaceRunning(false);
+    if (cancelled) {
+        statusBar()->showMessage(tr("置換を中止しました"), STATUS_MSG_TIMEOUT);
+        return;
+    }
+    statusBar()->clearMessage();
+
+    const QDir baseDir(grepDirPath);
+    QStringList lines;
+    int files = 0;
+    int total = 0;
+    foreach (const QString &filePath, replaceReadOnlyFiles) {
+        lines << tr("%1: 読み取り専用で開いているため置換しません")
+                 .arg(QDir::toNativeSeparators(baseDir.relativeFilePath(filePath)));
+    }
+    QMap<QString, int>::const_iterator it;
+    for (it = replaceOpenCounts.constBegin(); it != replaceOpenCounts.constEnd(); ++it) {
+        const QString name = QDir::toNativeSeparators(baseDir.relativeFilePath(it.key()));
+        if (it.value() > 0) {
+            lines << tr("%1: %2箇所 (開いている文書)").arg(name).arg(it.value());
+            ++files;
+            total += it.value();
+        }
+    }
+    foreach (const FileReplacer::Result &result, results) {
+        const QString name = QDir::toNativeSeparators(baseDir.relativeFilePath(result.filePath));
+        if (!result.error.isEmpty()) {
+            lines << tr("%1: %2").arg(name).arg(result.error);
+        } else if (result.count > 0) {
+            lines << tr("%1: %2箇所").arg(name).arg(result.count);
+            ++files;
+            total += result.count;
+        }
+    }
+    if (total == 0) {
+        QMessageBox::information(this, tr("ファイルを置換"), tr("置換する箇所がありません。"));
+        return;
+    }
+
+    QMessageBox box(QMessageBox::Question, tr("ファイルを置換"),
+                    tr("%1ファイル、%2箇所を置換します。よろしいですか?").arg(files).arg(total),
+                    QMessageBox::Ok | QMessageBox::Cancel, this);
+    box.setInformativeText(tr("開いている文書は文書を置換します(保存はしません)。"));
+    box.setDetailedText(lines.join("\n"));
+    if (box.exec() != QMessageBox::Ok) {
+        return;
+    }
+
+    /* 確認中に開いた(閉じた)ファイルもあるため、改めて開いているかを調べる */
+    QStringList targets;
+    for (it = replaceOpenCounts.constBegin(); it != replaceOpenCounts.constEnd(); ++it) {
+        if (it.value() > 0) {
+            targets << it.key();
+        }
+    }
+    foreach (const FileReplacer::Result &result, results) {
+        if (result.error.isEmpty() && result.count > 0) {
+            targets << result.filePath;
+        }
+    }
+    QStringList diskFiles;
+    replacedOpenFiles = 0;
+    replacedOpenCount = 0;
+    foreach (const QString &filePath, targets) {
+        TextEditor *textEdit = findOpenEditor(filePath);
+        if (!textEdit) {
+            diskFiles << filePath;
+            continue;
+        }
+        if (textEdit->isReadOnly()) {
+            continue;                       // 確認中に読み取り専用で開かれた
+        }
+        const int count = textEdit->replaceAll(lastGrep.data.text, replaceAfter, lastGrep.data.option, false);
+        if (count > 0) {
+            ++replacedOpenFiles;
+            replacedOpenCount += count;
+        }
+    }
+
+    /* 結果の行番号・内容は置換後と合わなくなる */
+    grepOutputDock->setReplaceEnabled(false);
+    if (!fileReplacer->apply(diskFiles, lastGrep.data, replaceAfter, QTextCodec::codecForName(TextEditor::configs(0).defTextCodecName))) {
+        return;
+    }
+    grepOutputDock->setReplaceRunning(true);
+    statusBar()->showMessage(tr("置換中..."));
+}
+
+void MainWindow::replaceApplyFinished(const QVector<FileReplacer::Result> &results, bool cancelled)
+{
+    grepOutputDock->setReplaceRunning(false);
+    int files = replacedOpenFiles;
+    int total = replacedOpenCount;
+    QStringList errors;
+    foreach (const FileReplacer::Result &result, results) {
+        if (!result.error.isEmpty()) {
+            errors << tr("%1: %2").arg(QDir::toNativeSeparators(result.filePath)).arg(result.error);
+        } else if (result.count > 0) {
+            ++files;
+            total += result.count;
+        }
+    }
+
+    QString message = tr("%1ファイル、%2箇所を置換しました").arg(files).arg(total);
+    if (cancelled) {
+        message += tr(" (中止)");
+    }
+    statusBar()->showMessage(message, STATUS_MSG_TIMEOUT);
+    if (!errors.isEmpty()) {
+        QMessageBox::warning(this, tr("ファイルを置換"), tr("置換できなかったファイルがあります。\n\n%1").arg(errors.join("\n")));
+    }
+}
+
 void MainWindow::ctagsMake()
 {
     TagsMakeDialog d(this);
@@ -455,36 +828,51 @@ void MainWindow::ctagsJump()
     QTextCursor textCursor = activeEdit->textCursor();
     textCursor.select(QTextCursor::WordUnderCursor);
     QString searchWord = textCursor.selectedText();
-    QFile file(tagsFile);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!tagsIndex->open(tagsFile)) {
+        statusBar()->showMessage(tagsIndex->errorString(), STATUS_MSG_TIMEOUT);
         return;
-    QTextStream in(&file);
-    QVector<QStringList> matchs;
-    while (!in.atEnd()) {
-        QStringList column = in.readLine().split("\t");
-        if (column.at(0).at(0) == QChar('!'))
-            continue;
-        if (column[0] == searchWord)
-            matchs.append(column);
     }
+    QVector<TagsIndex::Entry> matchs = tagsIndex->find(searchWord);
     if (matchs.isEmpty()) {
         statusBar()->showMessage(tr("タグは見つかりませんでした"));
         return;
     }
+
+    /* 複数一致した場合は選択させる */
+    TagsIndex::Entry entry = matchs.at(0);
     if (matchs.count() > 1) {
-        return;
+        QStringList items;
+        foreach (const TagsIndex::Entry &match, matchs) {
+            const QString fileName = QDir(dir).relativeFilePath(match.filePath);
+            items.append(QString("%1:%2  %3  %4").arg(fileName)
+                         .arg(match.lineNumber > 0 ? QString::number(match.lineNumber) : match.pattern.trimmed())
+                         .arg(match.kind).arg(match.name));
+        }
+        bool ok;
+        const QString item = QInputDialog::getItem(this, tr("タグジャンプ"), tr("ジャンプ先:"), items, 0, false, &ok);
+        if (!ok) {
+            return;
+        }
+        entry = matchs.at(items.indexOf(item));
     }
+
     TagsJumpStack stack;
     stack.filePath = activeEdit->currentFile();
     stack.lineNumber = activeEdit->cursorForLineNumber();
 
-    QString openFileName = QFileInfo(matchs.at(0).at(1)).canonicalFilePath();
-    QString line_str = matchs.at(0).at(2);
-    int line = line_str.replace(QRegExp("..$"), "").toInt();
+    QString openFileName = QFileInfo(entry.filePath).canonicalFilePath();
     openFile(openFileName);
     TextEditor *openEdior = activeMdiChild();
     if (openEdior) {
-        openEdior->setCursorForLineNumber(line);
+        if (entry.lineNumber > 0) {
+            openEdior->setCursorForLineNumber(entry.lineNumber);
+        } else {
+            /* 検索パターンの場合は文書の先頭から探す */
+            QTextCursor found = openEdior->document()->find(entry.pattern, 0, QTextDocument::FindCaseSensitively);
+            if (!found.isNull()) {
+                openEdior->setCursorForLineNumber(found.blockNumber() + 1);
+            }
+        }
         tagsJumpStacks.prepend(stack);
     }
     /*
@@ -517,13 +905,24 @@ void MainWindow::slotGoLine()
     if (!activeEdit)
         return;
     bool ok;
-    int line = QInputDialog::getInt(this, tr("指定行へジャンプ"),
-                                          tr("行番号:"), activeEdit->cursorForLineNumber(),
-                                          1, 2147483647, 1, &ok);
-    if (ok) {
-        activeEdit->setCursorForLineNumber(line);
-        activeEdit->setFocus();
+    const QString target = QInputDialog::getText(this, tr("指定行へジャンプ"),
+                                                 tr("行番号 (@を付けるとファイル先頭からのバイト位置):"), QLineEdit::Normal,
+                                                 QString::number(activeEdit->cursorForLineNumber()), &ok).trimmed();
+    if (!ok) {
+        return;
+    }
+    if (target.startsWith(QLatin1Char('@'))) {
+        const qint64 offset = target.mid(1).trimmed().toLongLong(&ok, 0);
+        if (ok && offset >= 0) {
+            activeEdit->setCursorForOffset(offset);
+        }
+    } else {
+        const int line = target.toInt(&ok);
+        if (ok && line >= 1) {
+            activeEdit->setCursorForLineNumber(line);
+        }
     }
+    activeEdit->setFocus();
 }
 
 void MainWindow::markAllClear()
@@ -601,12 +1000,14 @@ TextEditor *MainWindow::createTextEditor()
     connect(textEdit, SIGNAL(copyAvailable(bool)), delAct, SLOT(setEnabled(bool)));
     connect(textEdit, SIGNAL(copyAvailable(bool)), lowercaseAct, SLOT(setEnabled(bool)));
     connect(textEdit, SIGNAL(copyAvailable(bool)), uppercaseAct, SLOT(setEnabled(bool)));
-    //connect(textEdit, SIGNAL(textChanged()), this, SLOT(updateOutline()));
+    /* 編集中のアウトラインは Outline が文書の contentsChange を受けて部分的に更新する(ファイルの読込み中を除く) */
+    connect(textEdit, SIGNAL(loadingChanged(QTextDocument*,bool)), outlineDock, SLOT(setDocumentLoading(QTextDocument*,bool)));
     connect(textEdit, SIGNAL(cursorPositionChanged()), this, SLOT(updateOutlineCurrent()));
     connect(textEdit, SIGNAL(cursorPositionChanged()), this, SLOT(updateCurrentCharCode()));
     connect(textEdit, SIGNAL(selectionChanged()), this, SLOT(updateSelection()));
     connect(textEdit, SIGNAL(mouseClickRequest(QMouseEvent*)), mouseClickAct, SLOT(trigger()));
     connect(textEdit, SIGNAL(mouseDoubleClickRequest(QMouseEvent*)), mouseDoubleClickAct, SLOT(trigger()));
+    connect(textEdit, SIGNAL(highlightFinished()), this, SLOT(updateFindwordMatchLines()));
 
     return textEdit;
 }
@@ -670,16 +1071,7 @@ void MainWindow::updateOutline()
         return;
     }
 
-    QString fileName = QDesktopServices::storageLocation(QDesktopServices::TempLocation) + "/myeditor_outline";
-
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text))
-        return;
-
-    QTextStream out(&file);
-    out << activeEdit->toPlainText();
-    file.close();
-    outlineDock->reload(fileName);
+    outlineDock->reload(activeEdit->document(), activeEdit->isUntitled() ? QString() : activeEdit->currentFile());
 }
 
 void MainWindow::updateOutlineCurrent()
@@ -780,6 +1172,7 @@ void MainWindow::updateShortcut()
 {
     newFileAct->setShortcut(QKeySequence::New);
     openFileAct->setShortcut(QKeySequence::Open);
+    findFileAct->setShortcut(tr("Ctrl+Shift+O"));
     saveAct->setShortcut(QKeySequence::Save);
     saveAsAct->setShortcut(QKeySequence::SaveAs);
     closeAct->setShortcut(QKeySequence::Close);
@@ -978,6 +1371,10 @@ void MainWindow::createActions()
     openFileAct->setStatusTip(tr("ファイルを開く"));
     connect(openFileAct, SIGNAL(triggered()), this, SLOT(openFile()));
 
+    findFileAct = new QAction(tr("ファイル名で開く(&F)..."), this);
+    findFileAct->setStatusTip(tr("ファイル名の一部から開くファイルを探す"));
+    connect(findFileAct, SIGNAL(triggered()), this, SLOT(findFile()));
+
     saveAct = new QAction(tr("上書き保存(&O)"), this);
     saveAct->setIcon(QIcon(":/images/disk-return-black.png"));
     saveAct->setStatusTip(tr("上書き保存する"));
@@ -1164,6 +1561,7 @@ void MainWindow::createMenus()
     fileMenu = menuBar()->addMenu(tr("ファイル(&F)"));
     fileMenu->addAction(newFileAct);
     fileMenu->addAction(openFileAct);
+    fileMenu->addAction(findFileAct);
     fileMenu->addAction(saveAct);
     fileMenu->addAction(saveAllAct);
     fileMenu->addAction(saveAsAct);
@@ -1306,6 +1704,24 @@ QMdiSubWindow *MainWindow::findMdiChild(const QString &fileName)
     return 0;
 }
 
+/**
+ * ファイルを開いているエディタを探す(シンボリックリンクや大文字小文字、区切り文字の違いは同じファイルとみなす)
+ */
+TextEditor *MainWindow::findOpenEditor(const QString &filePath)
+{
+    const QString canonicalFilePath = QFileInfo(filePath).canonicalFilePath();
+    if (canonicalFilePath.isEmpty()) {
+        return 0;
+    }
+    foreach (TextEditor *textEdit, textEditorList()) {
+        if (textEdit && !textEdit->currentFile().isEmpty()
+                && QFileInfo(textEdit->currentFile()).canonicalFilePath() == canonicalFilePath) {
+            return textEdit;
+        }
+    }
+    return 0;
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     mdiArea->closeAllSubWindows();
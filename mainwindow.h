@@ -2,13 +2,19 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QMap>
+#include <QPointer>
 #include "finddialog.h"
 #include "replacedialog.h"
 #include "grepdialog.h"
+#include "grepengine.h"
+#include "filereplacer.h"
 #include "texteditor.h"
 
 class Outline;
+class GrepOutput;
 class TagsMakeDialog;
+class TagsIndex;
 class QMdiArea;
 class QMdiSubWindow;
 class QSettings;
@@ -29,6 +35,7 @@ public slots:
     void newFile();
     void openFile(QString fileName = "");
     void openDir(QString path = "");
+    void findFile();
     void save();
     void saveAll();
     void saveAs();
@@ -48,10 +55,18 @@ public slots:
     void find();
     void find(FindDialog::FindParam param);
     void marking(int index, const TextEditor::KeywordData &keyword);
+    void updateFindwordMatchLines();
     void findNext();
     void findPrev();
     void replace();
     void grep();
+    void grep(GrepDialog::GrepParam param);
+    void appendGrepMatches(const QVector<GrepEngine::Match> &matches);
+    void grepFinished(int files, int matches, bool cancelled);
+    void openGrepMatch(const GrepEngine::Match &match);
+    void replaceInFiles();
+    void replacePreviewFinished(const QVector<FileReplacer::Result> &results, bool cancelled);
+    void replaceApplyFinished(const QVector<FileReplacer::Result> &results, bool cancelled);
     void ctagsMake();
     void ctagsJump();
     void ctagsJumpBack();
@@ -87,6 +102,8 @@ public:
     void createStatusBar();
     TextEditor *activeMdiChild();
     QMdiSubWindow *findMdiChild(const QString &fileName);
+    TextEditor *findOpenEditor(const QString &filePath);
+    void showFindwordCount(TextEditor *textEdit);
 
 protected:
     void closeEvent(QCloseEvent *event);
@@ -103,6 +120,7 @@ private:
     QSignalMapper *fileOpenMapper;  //
     QSignalMapper *dirOpenMapper;   //
     Outline *outlineDock;           // アウトライン
+    GrepOutput *grepOutputDock;     // Grep結果
     QMenu *fileMenu;                // ファイル
     QMenu *editMenu;                // 編集
     QMenu *searchMenu;              // 検索
@@ -115,6 +133,7 @@ private:
     QAction *separator;             //
     QAction *newFileAct;            // 新規
     QAction *openFileAct;           // 開く
+    QAction *findFileAct;           // ファイル名で開く
     QAction *saveAct;               // 上書き保存
     QAction *saveAllAct;            // すべて保存
     QAction *saveAsAct;             // 名前を付けて保存
@@ -166,7 +185,18 @@ private:
     FindDialog::FindParam lastSearch;
     ReplaceDialog *replaceDialog;
     GrepDialog *grepDialog;
+    GrepEngine *grepEngine;
+    QPointer<TextEditor> grepEditor;        // Grep結果の出力先(エディタに出力する場合)
+    QString grepDirPath;                    // 最後にGrepしたディレクトリ
+    GrepDialog::GrepParam lastGrep;         // 最後に実行したGrep
+    FileReplacer *fileReplacer;
+    QString replaceAfter;                   // ファイルを置換する置換後の文字列
+    QMap<QString, int> replaceOpenCounts;   // 開いている文書の置換する数
+    QStringList replaceReadOnlyFiles;       // 読み取り専用で開いているため置換しないファイル
+    int replacedOpenFiles;                  // 開いている文書を置換したファイル数
+    int replacedOpenCount;                  // 開いている文書を置換した数
     int markIndex;
+    QString markText;                       // 最後にマークした文字列(一致数の表示に使う)
 
     struct TagsJumpStack {
         QString filePath;
@@ -174,6 +204,7 @@ private:
     };
 
     QVector<TagsJumpStack> tagsJumpStacks;
+    TagsIndex *tagsIndex;                   // タグの索引(最後に使ったtagsファイル)
 };
 
 #endif // MAINWINDOW_H
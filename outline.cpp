@@ -1,204 +1,357 @@
 #include "outline.h"
-#include <QTreeWidget>
+#include "outlinemodel.h"
+#include <QTreeView>
+#include <QHeaderView>
 #include <QFile>
-#include <QTextStream>
-#include <QProcess>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QTextDocument>
+#include <QDir>
 #include <QTimer>
 
+namespace {
 
-class TreeWidgetItem : public QTreeWidgetItem
+/* 簡易解析(SymbolScanner)で扱える C/C++ のファイルか(拡張子がない場合は ctags と同じく C++ とみなす) */
+bool isCppFile(const QString &fileName)
 {
-public:
-    enum COLUMN {
-        COLUMN_FILE_LINE,
-        COLUMN_FUNC_NAME,
-        COLUMN_FUNC_TYPE,
-        COLUMN_FILE_NAME,
-        COLUMN_FUNC_SCOPE,
-        COLUMN_MAX
+    static const char *const suffixes[] = {
+        "c", "cc", "cpp", "cxx", "c++", "h", "hh", "hpp", "hxx", "h++", "inl"
     };
-
-    TreeWidgetItem(QTreeWidget *parent, int type = Type)
-        : QTreeWidgetItem(parent, type)
-    {
-        bgeinScopeLine = 0;
-        endScopeLine = 0;
-    }
-
-    void setLineNumberScopeBegin(const int line)
-    {
-        bgeinScopeLine = line;
-    }
-
-    void setLineNumberScopeEnd(const int line)
-    {
-        endScopeLine = line;
-    }
-
-    bool isLineScopeRange(int line) const
-    {
-        return (bgeinScopeLine <= line) && (endScopeLine > line);
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix.isEmpty()) {
+        return true;
     }
-
-private:
-    bool operator< (const QTreeWidgetItem &other) const
-    {
-        int column = treeWidget()->sortColumn();
-        if (column == COLUMN_FILE_LINE) {
-            return text(column).toInt() < other.text(column).toInt();
-        } else {
-            return text(column).toAscii() < other.text(column).toAscii();
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+        if (suffix == QLatin1String(suffixes[i])) {
+            return true;
         }
     }
-private:
-    int bgeinScopeLine;
-    int endScopeLine;
-};
+    return false;
+}
+
+}
 
 Outline::Outline(QWidget *parent) :
     QDockWidget(parent),
+    document(0),
+    process(0),
+    source(0),
+    parsingDocument(0),
+    parsingRevision(-1),
     changedSelectionEnable(true)
 {
     setWindowTitle(tr("アウトライン"));
 
-    treeWidget = new QTreeWidget(this);
-    treeWidget->setSortingEnabled(true);
-    treeWidget->sortItems (TreeWidgetItem::COLUMN_FILE_LINE, Qt::AscendingOrder);
+    model = new OutlineModel(this);
+    treeView = new QTreeView(this);
+    treeView->setRootIsDecorated(false);
+    treeView->setUniformRowHeights(true);
+    treeView->setModel(model);
+    treeView->setSortingEnabled(true);
+    treeView->sortByColumn(OutlineModel::COLUMN_FILE_LINE, Qt::AscendingOrder);
     timer = new QTimer;
 
-    QTreeWidgetItem *treewidgetitem = treeWidget->headerItem();
-    treewidgetitem->setText(TreeWidgetItem::COLUMN_FILE_LINE, tr("行番号"));
-    treewidgetitem->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("種類"));
-    treewidgetitem->setText(TreeWidgetItem::COLUMN_FUNC_NAME, tr("関数名"));
-
-    setWidget(treeWidget);
+    setWidget(treeView);
 
     connect(timer, SIGNAL(timeout()), this, SLOT(updateOutlineItems()));
-    connect(treeWidget, SIGNAL(currentItemChanged(QTreeWidgetItem*,QTreeWidgetItem*)), this, SLOT(changeCurrentItem(QTreeWidgetItem*,QTreeWidgetItem*)));
+    connect(treeView->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(changeCurrentIndex(QModelIndex,QModelIndex)));
+}
+
+Outline::~Outline()
+{
+    qDeleteAll(scanners);
 }
 
 void Outline::clear()
 {
-    treeWidget->clear();
+    model->clear();
 }
 
-void Outline::reload(QString fileName)
+/**
+ * 文書のアウトラインを表示する
+ * 同じ版の解析結果があればすぐに表示し、なければ少し待ってから非同期に解析する
+ */
+void Outline::reload(QTextDocument *document, const QString &fileName)
 {
-    this->fileName = fileName;
+    /* 編集中の文書は表示中のモデルを解析結果として使うため、表示を切り替える時に保存する */
+    if (this->document && this->document != document) {
+        SymbolScanner *previous = scanners.value(this->document);
+        if (previous) {
+            OutlineCache cache;
+            cache.revision = previous->revision();
+            cache.table = model->table();
+            caches.insert(this->document, cache);
+        }
+    }
+
+    fileNames.insert(document, fileName);
+    if (document == this->document && scanners.contains(document)) {
+        return;     // 表示中のモデルが最新の解析結果
+    }
+    this->document = document;
+    timer->stop();
+    connect(document, SIGNAL(destroyed(QObject*)), this, SLOT(removeDocument(QObject*)), Qt::UniqueConnection);
+    connect(document, SIGNAL(contentsChange(int,int,int)), this, SLOT(documentContentsChange(int,int,int)), Qt::UniqueConnection);
+    if (!knownRevisions.contains(document)) {
+        knownRevisions.insert(document, document->revision());
+    }
+
+    /* 編集された文書は簡易解析の結果を使う */
+    SymbolScanner *scanner = scanners.value(document);
+    if (scanner && (!caches.contains(document) || caches.value(document).revision != scanner->revision())) {
+        OutlineCache cache;
+        cache.revision = scanner->revision();
+        cache.table = OutlineModel::createTable(scanner->symbols());
+        caches.insert(document, cache);
+    }
+
+    QHash<QTextDocument *, OutlineCache>::const_iterator it = caches.constFind(document);
+    if (it != caches.constEnd() && it.value().revision == document->revision()) {
+        model->setTable(it.value().table);
+        if (scanner) {
+            caches.remove(document);    // 編集で複製し直さないよう、表示中はモデルだけが持つ
+        }
+        return;
+    }
+
+    clear();
     timer->start(700);
 }
 
-void Outline::changeCurrentItem(QTreeWidgetItem *current, QTreeWidgetItem */*previous*/)
+void Outline::changeCurrentIndex(const QModelIndex &current, const QModelIndex &/*previous*/)
 {
-    if (!current) return;
+    if (!current.isValid()) return;
 
-    int line = current->text(TreeWidgetItem::COLUMN_FILE_LINE).toInt();
+    int line = model->lineAt(current);
 
     if (changedSelectionEnable)
         emit changedSelection(line);
 }
 
+/**
+ * 行を含む範囲のシンボルを選択する
+ */
 void Outline::selectionLineItem(int line)
 {
-    changedSelectionEnable = false;
-    int size = treeWidget->topLevelItemCount();
-    for (int i = 0; i < size; ++i) {
-        TreeWidgetItem *item = dynamic_cast<TreeWidgetItem *>(treeWidget->topLevelItem(i));
-        if (item && item->isLineScopeRange(line)) {
-            treeWidget->setCurrentItem(item);
-            break;
-        }
+    const QModelIndex index = model->indexForLine(line);
+    if (!index.isValid() || treeView->currentIndex().row() == index.row()) {
+        return;
     }
+    changedSelectionEnable = false;
+    treeView->setCurrentIndex(index);
     changedSelectionEnable = true;
 }
 
 void Outline::updateFindwordMatchLines(const QVector<int> &matchLines)
 {
-    int size = treeWidget->topLevelItemCount();
-    for (int i = 0; i < size; ++i) {
-        TreeWidgetItem *item = dynamic_cast<TreeWidgetItem *>(treeWidget->topLevelItem(i));
-        if (item) {
-            item->setBackgroundColor(TreeWidgetItem::COLUMN_FILE_LINE, "#ffffff");
-            item->setBackgroundColor(TreeWidgetItem::COLUMN_FUNC_NAME, "#ffffff");
-            item->setBackgroundColor(TreeWidgetItem::COLUMN_FUNC_TYPE, "#ffffff");
-            foreach (const int &line, matchLines) {
-                if (item->isLineScopeRange(line)) {
-                    item->setBackgroundColor(TreeWidgetItem::COLUMN_FILE_LINE, "#ffff00");
-                    item->setBackgroundColor(TreeWidgetItem::COLUMN_FUNC_NAME, "#ffff00");
-                    item->setBackgroundColor(TreeWidgetItem::COLUMN_FUNC_TYPE, "#ffff00");
+    model->setMatchLines(matchLines);
+}
+
+void Outline::updateOutlineItems()
+{
+    timer->stop();
+    if (!document) {
+        return;
+    }
+    if (process) {
+        return;     // 解析中の場合は終了後に改めて解析する
+    }
+    startParse();
+}
+
+/**
+ * 文書の内容を一時ファイルに書き出し、ctags を非同期に実行する
+ * ctags は解析対象の内容をファイルからしか読めない(-L - や --filter で標準入力から渡せるのはファイル名)ため、
+ * 保存していない内容も解析できるよう一時ファイルを使う。
+ * 一時ファイルには元のファイルと同じ拡張子を付け、言語は ctags に拡張子から判定させる。
+ */
+void Outline::startParse()
+{
+    parsingDocument = document;
+    parsingRevision = document->revision();
+
+    const QString suffix = QFileInfo(fileNames.value(document)).suffix();
+    QString fileTemplate = QDir::tempPath() + QDir::separator() + "myeditor_outline.XXXXXX";
+    if (!suffix.isEmpty()) {
+        fileTemplate += "." + suffix;
+    }
+    source = new QTemporaryFile(fileTemplate, this);
+    if (!source->open()) {
+        delete source;
+        source = 0;
+        return;
+    }
+    source->write(document->toPlainText().toUtf8());
+    source->close();
+
+    QStringList arguments;
+    arguments << "-n";
+    arguments << "-f" << "-";
+    arguments << "-u";
+    if (suffix.isEmpty()) {
+        arguments << "--language-force=C++";    // 無題の文書は拡張子から判定できない
+    }
+    arguments << source->fileName();
+
+    process = new QProcess(this);
+    connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(parseFinished(int,QProcess::ExitStatus)));
+    connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(parseError(QProcess::ProcessError)));
+    process->start("ctags", arguments);
+}
+
+void Outline::parseError(QProcess::ProcessError error)
+{
+    if (error != QProcess::FailedToStart) {
+        return;     // 終了は parseFinished() で扱う
+    }
+    process->deleteLater();
+    process = 0;
+    delete source;
+    source = 0;
+    parsingDocument = 0;
+}
+
+void Outline::parseFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    const QByteArray output = process->readAllStandardOutput();
+    process->deleteLater();
+    process = 0;
+    delete source;
+    source = 0;
+
+    if (exitStatus == QProcess::NormalExit && exitCode == 0 && parsingDocument && !scanners.contains(parsingDocument)) {
+        QVector<OutlineSymbol> symbols;
+        QList<QByteArray> lines = output.split('\n');
+        lines.removeLast();
+        foreach (const QByteArray &line, lines) {
+            QList<QByteArray> column = line.split('\t');
+            if (column.size() <= TAGS_FUNC_TYPE) {
+                continue;
+            }
+            OutlineSymbol symbol;
+            symbol.name = QString::fromUtf8(column[TAGS_FUNC_NAME]);
+            symbol.line = column[TAGS_FILE_LINE].left(column[TAGS_FILE_LINE].size() - 2).toInt();
+            symbol.kind = column[TAGS_FUNC_TYPE].isEmpty() ? 0 : column[TAGS_FUNC_TYPE].at(0);
+            for (int i = TAGS_FUNC_SCOPE; i < column.size(); ++i) {
+                const int colon = column[i].indexOf(':');
+                if (colon > 0 && column[i].left(colon) != "file" && column[i].left(colon) != "signature") {
+                    symbol.scope = QString::fromUtf8(column[i].mid(colon + 1));
                     break;
                 }
             }
+            symbols.append(symbol);
         }
+        OutlineCache cache;
+        cache.revision = parsingRevision;
+        cache.table = OutlineModel::createTable(symbols);
+        caches.insert(parsingDocument, cache);
+        if (parsingDocument == document && parsingRevision == document->revision()) {
+            model->setTable(cache.table);
+        }
+    }
+    parsingDocument = 0;
+
+    /* 解析中に表示する文書が変わった・編集された場合は改めて解析する */
+    if (document && !scanners.contains(document)
+            && (!caches.contains(document) || caches.value(document).revision != document->revision())) {
+        timer->start(0);
     }
 }
 
-void Outline::updateOutlineItems()
+void Outline::removeDocument(QObject *document)
 {
-    timer->stop();
-    clear();
+    QTextDocument *removed = static_cast<QTextDocument *>(document);
+    caches.remove(removed);
+    knownRevisions.remove(removed);
+    loadingDocuments.remove(removed);
+    fileNames.remove(removed);
+    delete scanners.take(removed);
+    if (this->document == removed) {
+        this->document = 0;
+        timer->stop();
+    }
+    if (parsingDocument == removed) {
+        parsingDocument = 0;
+    }
+}
 
-    QProcess proc(this);
-    QStringList arguments;
+/**
+ * ファイルの読込み(ビューアモードの表示範囲の展開を含む)の開始・終了
+ * 読込み中の変更は簡易解析せず、終了時に1回だけ解析結果を捨ててctagsで解析し直す
+ */
+void Outline::setDocumentLoading(QTextDocument *document, bool loading)
+{
+    if (loading) {
+        loadingDocuments.insert(document);
+        return;
+    }
+    loadingDocuments.remove(document);
+    knownRevisions.insert(document, document->revision());
+    delete scanners.take(document);
+    caches.remove(document);
+    if (document == this->document) {
+        reload(document, fileNames.value(document));
+    }
+}
 
-    arguments << "-n";
-    arguments << "-f -";
-    arguments << "-u";
-    arguments << "--languages=C++";
-    arguments << "--langmap=C++:(myeditor_outline)";
-    arguments << fileName;
+/**
+ * 文書の編集に合わせてアウトラインを更新する
+ * 編集された C/C++ の文書は以降ctagsを使わず、変更行を含む範囲だけを簡易解析する
+ * それ以外の言語は簡易解析できないため、編集が止まってからctagsで解析し直す
+ */
+void Outline::documentContentsChange(int position, int /*charsRemoved*/, int charsAdded)
+{
+    QTextDocument *changed = qobject_cast<QTextDocument *>(sender());
+    if (!changed || loadingDocuments.contains(changed)) {
+        return;
+    }
+    /* 強調表示などの書式のみの変更は版が変わらない */
+    if (changed->revision() == knownRevisions.value(changed, -1)) {
+        return;
+    }
+    knownRevisions.insert(changed, changed->revision());
 
-    proc.start("ctags", arguments);
-    if (!proc.waitForFinished(1000)) {
+    /* 文書全体の置き換え(ファイルの読込み)はctagsで解析し直す */
+    if (position == 0 && charsAdded >= changed->characterCount() - 1) {
+        delete scanners.take(changed);
+        caches.remove(changed);
+        if (changed == document) {
+            reload(changed, fileNames.value(changed));
+        }
         return;
     }
-    QStringList lines = QString::fromLatin1(proc.readAllStandardOutput()).split("\n");
-    lines.removeLast();
-
-    TreeWidgetItem *prev_item = 0;
-    foreach (const QString &line, lines) {
-        QStringList column = line.split("\t");
-        TreeWidgetItem *item = new TreeWidgetItem(treeWidget);
-        item->setText(TreeWidgetItem::COLUMN_FILE_LINE, column[TAGS_FILE_LINE].replace(QRegExp("..$"), ""));
-        item->setText(TreeWidgetItem::COLUMN_FUNC_NAME, column[TAGS_FUNC_NAME]);
-        switch (column[TAGS_FUNC_TYPE].at(0).toAscii()) {
-        case 'f':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("関数"));
-            break;
-        case 'd':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("定義"));
-            break;
-        case 's':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("構造体"));
-            break;
-        case 'm':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("メンバー"));
-            break;
-        case 'g':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("列挙体"));
-            break;
-        case 'e':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("列挙値"));
-            break;
-        case 'v':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("変数"));
-            break;
-        case 'c':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("クラス"));
-            break;
-        case 'n':
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("名前空間"));
-            break;
-        default:
-            item->setText(TreeWidgetItem::COLUMN_FUNC_TYPE, tr("不明"));
-            break;
+
+    if (!isCppFile(fileNames.value(changed))) {
+        delete scanners.take(changed);      // 名前を付けて保存で言語が変わった場合
+        caches.remove(changed);
+        if (changed == document) {
+            timer->start(700);
         }
-        item->setLineNumberScopeBegin(item->text(TreeWidgetItem::COLUMN_FILE_LINE).toInt());
-        if (prev_item)
-            prev_item->setLineNumberScopeEnd(item->text(TreeWidgetItem::COLUMN_FILE_LINE).toInt());
-        prev_item = item;
+        return;
+    }
+
+    SymbolScanner *scanner = scanners.value(changed);
+    SymbolScanner::Patch changes;
+    bool rescanned = false;
+    if (!scanner) {
+        scanner = new SymbolScanner;
+        scanners.insert(changed, scanner);
+        scanner->scan(changed);
+        rescanned = true;
+    } else {
+        scanner->update(changed, position, charsAdded, &changes);
     }
-    if (prev_item)
-        prev_item->setLineNumberScopeEnd(prev_item->text(TreeWidgetItem::COLUMN_FILE_LINE).toInt() + 999);
-}
 
+    /* 表示中でない文書は表示する時に作り直す */
+    if (changed != document) {
+        caches.remove(changed);
+        return;
+    }
+    timer->stop();
+    if (rescanned) {
+        model->setTable(OutlineModel::createTable(scanner->symbols()));
+    } else {
+        model->patch(changes);
+    }
+    caches.remove(changed);
+}
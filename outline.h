@@ -2,10 +2,18 @@
 #define OUTLINE_H
 
 #include <QDockWidget>
+#include <QHash>
+#include <QProcess>
+#include <QSet>
+#include <QVector>
+#include <QModelIndex>
+#include "symbolscanner.h"
+#include "outlinemodel.h"
 
-class QTreeWidget;
-class QTreeWidgetItem;
+class QTreeView;
 class QTimer;
+class QTextDocument;
+class QTemporaryFile;
 
 class Outline : public QDockWidget
 {
@@ -19,23 +27,53 @@ class Outline : public QDockWidget
         TAGS_MAX
     };
 
+public:
+    typedef SymbolScanner::Symbol OutlineSymbol;
+
+    /* 文書毎の解析結果(文書の版が同じ間は再解析しない) */
+    typedef struct tagOutlineCache {
+        int revision;
+        OutlineModel::SymbolTable table;
+    } OutlineCache;
+
 public:
     explicit Outline(QWidget *parent = 0);
+    ~Outline();
     void clear();
-    void reload(QString fileName);
+    void reload(QTextDocument *document, const QString &fileName);
     void selectionLineItem(int line);
     void updateFindwordMatchLines(const QVector<int> &matchLines);
 signals:
     void changedSelection(int);
 
 public slots:
-    void changeCurrentItem(QTreeWidgetItem * current, QTreeWidgetItem * previous);
+    void changeCurrentIndex(const QModelIndex &current, const QModelIndex &previous);
     void updateOutlineItems();
+    void setDocumentLoading(QTextDocument *document, bool loading);
+
+private slots:
+    void parseFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void parseError(QProcess::ProcessError error);
+    void removeDocument(QObject *document);
+    void documentContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    void startParse();
 
 private:
-    QTreeWidget *treeWidget;
+    QTreeView *treeView;
+    OutlineModel *model;
     QTimer *timer;
-    QString fileName;
+    QTextDocument *document;                // 表示中の文書
+    QHash<QTextDocument *, OutlineCache> caches;        // 表示中の編集された文書はモデルが解析結果を持つ
+    QHash<QTextDocument *, SymbolScanner *> scanners;   // 編集された文書の解析状態
+    QHash<QTextDocument *, int> knownRevisions;         // 反映済みの文書の版
+    QSet<QTextDocument *> loadingDocuments;             // ファイルの読込み中の文書
+    QHash<QTextDocument *, QString> fileNames;          // 文書のファイル名(言語の判定に使う)
+    QProcess *process;                      // 実行中の ctags
+    QTemporaryFile *source;                 // ctags へ渡す文書の内容
+    QTextDocument *parsingDocument;
+    int parsingRevision;
     bool changedSelectionEnable;
 
 };
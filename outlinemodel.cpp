@@ -0,0 +1,383 @@
+#include "outlinemodel.h"
+#include <QColor>
+#include <algorithm>
+
+namespace {
+
+/* 表示順の比較(同じ値の場合は行番号順) */
+class SymbolLess
+{
+public:
+    SymbolLess(const OutlineModel::SymbolTable &table, int column, const QVector<int> &ranks)
+        : table(table), column(column), ranks(ranks) {}
+    bool operator()(int a, int b) const
+    {
+        switch (column) {
+        case OutlineModel::COLUMN_FUNC_NAME:
+            if (ranks.at(table.nameIds.at(a)) != ranks.at(table.nameIds.at(b))) {
+                return ranks.at(table.nameIds.at(a)) < ranks.at(table.nameIds.at(b));
+            }
+            break;
+        case OutlineModel::COLUMN_FUNC_TYPE:
+            if (table.kinds.at(a) != table.kinds.at(b)) {
+                return table.kinds.at(a) < table.kinds.at(b);
+            }
+            break;
+        default:
+            break;
+        }
+        return a < b;
+    }
+
+private:
+    const OutlineModel::SymbolTable &table;
+    int column;
+    const QVector<int> &ranks;
+};
+
+class StringLess
+{
+public:
+    explicit StringLess(const QVector<QString> &strings) : strings(strings) {}
+    bool operator()(int a, int b) const
+    {
+        return strings.at(a) < strings.at(b);
+    }
+
+private:
+    const QVector<QString> &strings;
+};
+
+}
+
+OutlineModel::OutlineModel(QObject *parent)
+    : QAbstractItemModel(parent), sortColumn(COLUMN_FILE_LINE), sortOrder(Qt::AscendingOrder)
+{
+}
+
+/**
+ * シンボルの一覧(行番号順)から列毎の配列を作る
+ */
+OutlineModel::SymbolTable OutlineModel::createTable(const QVector<SymbolScanner::Symbol> &symbols)
+{
+    SymbolTable table;
+    table.nameIds.reserve(symbols.size());
+    table.scopeIds.reserve(symbols.size());
+    table.kinds.reserve(symbols.size());
+    table.lines.reserve(symbols.size());
+    foreach (const SymbolScanner::Symbol &symbol, symbols) {
+        table.nameIds.append(intern(table, symbol.name));
+        table.scopeIds.append(symbol.scope.isEmpty() ? -1 : intern(table, symbol.scope));
+        table.kinds.append(symbol.kind);
+        table.lines.append(symbol.line);
+    }
+    return table;
+}
+
+void OutlineModel::setTable(const SymbolTable &table)
+{
+    beginResetModel();
+    symbols = table;
+    matched.fill(false, symbols.lines.size());
+    updateOrder();
+    endResetModel();
+}
+
+/**
+ * 編集で変わった範囲のシンボルを入れ替え、以降の行番号をずらす
+ * 行番号順に表示している場合は該当行のみ削除・挿入する
+ */
+void OutlineModel::patch(const SymbolScanner::Patch &patch)
+{
+    const int first = std::lower_bound(symbols.lines.constBegin(), symbols.lines.constEnd(), patch.firstLine)
+            - symbols.lines.constBegin();
+    const int last = std::upper_bound(symbols.lines.constBegin() + first, symbols.lines.constEnd(), patch.lastLine)
+            - symbols.lines.constBegin();
+    const bool lineOrder = isLineOrder();
+
+    if (!lineOrder) {
+        beginResetModel();
+    }
+    if (last > first) {
+        if (lineOrder) {
+            beginRemoveRows(QModelIndex(), first, last - 1);
+        }
+        symbols.nameIds.remove(first, last - first);
+        symbols.scopeIds.remove(first, last - first);
+        symbols.kinds.remove(first, last - first);
+        symbols.lines.remove(first, last - first);
+        matched.remove(first, last - first);
+        if (lineOrder) {
+            updateOrder();
+            endRemoveRows();
+        }
+    }
+    if (patch.delta != 0) {
+        for (int i = first; i < symbols.lines.size(); ++i) {
+            symbols.lines[i] += patch.delta;
+        }
+        if (lineOrder && first < symbols.lines.size()) {
+            emit dataChanged(index(first, COLUMN_FILE_LINE), index(symbols.lines.size() - 1, COLUMN_FILE_LINE));
+        }
+    }
+    if (!patch.symbols.isEmpty()) {
+        if (lineOrder) {
+            beginInsertRows(QModelIndex(), first, first + patch.symbols.size() - 1);
+        }
+        for (int i = 0; i < patch.symbols.size(); ++i) {
+            const SymbolScanner::Symbol &symbol = patch.symbols.at(i);
+            symbols.nameIds.insert(first + i, intern(symbols, symbol.name));
+            symbols.scopeIds.insert(first + i, symbol.scope.isEmpty() ? -1 : intern(symbols, symbol.scope));
+            symbols.kinds.insert(first + i, symbol.kind);
+            symbols.lines.insert(first + i, symbol.line);
+            matched.insert(first + i, false);
+        }
+        if (lineOrder) {
+            updateOrder();
+            endInsertRows();
+        }
+    }
+    if (!lineOrder) {
+        updateOrder();
+        endResetModel();
+    }
+}
+
+void OutlineModel::clear()
+{
+    setTable(SymbolTable());
+}
+
+int OutlineModel::lineAt(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.row() >= order.size()) {
+        return 0;
+    }
+    return symbols.lines.at(order.at(index.row()));
+}
+
+/**
+ * 行を含む範囲(次のシンボルの行まで)のシンボルを二分探索で求める
+ */
+QModelIndex OutlineModel::indexForLine(int line) const
+{
+    const int symbol = std::upper_bound(symbols.lines.constBegin(), symbols.lines.constEnd(), line)
+            - symbols.lines.constBegin() - 1;
+    if (symbol < 0) {
+        return QModelIndex();
+    }
+    const int end = symbol + 1 < symbols.lines.size() ? symbols.lines.at(symbol + 1) : symbols.lines.at(symbol) + 999;
+    if (line >= end) {
+        return QModelIndex();
+    }
+    return index(rows.at(symbol), COLUMN_FILE_LINE);
+}
+
+/**
+ * 検索文字列を含む範囲のシンボルを強調する
+ * 一致行(昇順)とシンボル(行番号順)を先頭から突き合わせる
+ */
+void OutlineModel::setMatchLines(const QVector<int> &matchLines)
+{
+    QVector<int> lines = matchLines;
+    for (int i = 1; i < lines.size(); ++i) {
+        if (lines.at(i - 1) > lines.at(i)) {
+            std::sort(lines.begin(), lines.end());
+            break;
+        }
+    }
+
+    bool changed = false;
+    QVector<int>::const_iterator match = lines.constBegin();
+    for (int i = 0; i < symbols.lines.size(); ++i) {
+        const int begin = symbols.lines.at(i);
+        const int end = i + 1 < symbols.lines.size() ? symbols.lines.at(i + 1) : begin + 999;
+        while (match != lines.constEnd() && *match < begin) {
+            ++match;
+        }
+        const bool found = match != lines.constEnd() && *match < end;
+        if (matched.at(i) != found) {
+            matched[i] = found;
+            changed = true;
+        }
+    }
+    if (changed && !order.isEmpty()) {
+        emit dataChanged(index(0, 0), index(order.size() - 1, COLUMN_MAX - 1));
+    }
+}
+
+QModelIndex OutlineModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || row >= order.size() || column < 0 || column >= COLUMN_MAX) {
+        return QModelIndex();
+    }
+    return createIndex(row, column);
+}
+
+QModelIndex OutlineModel::parent(const QModelIndex &/*child*/) const
+{
+    return QModelIndex();
+}
+
+int OutlineModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : order.size();
+}
+
+int OutlineModel::columnCount(const QModelIndex &/*parent*/) const
+{
+    return COLUMN_MAX;
+}
+
+QVariant OutlineModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= order.size()) {
+        return QVariant();
+    }
+    const int symbol = order.at(index.row());
+
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case COLUMN_FILE_LINE:
+            return symbols.lines.at(symbol);
+        case COLUMN_FUNC_NAME:
+            return symbols.strings.at(symbols.nameIds.at(symbol));
+        case COLUMN_FUNC_TYPE:
+            return kindName(symbols.kinds.at(symbol));
+        default:
+            break;
+        }
+        break;
+    case Qt::ToolTipRole:
+        if (symbols.scopeIds.at(symbol) >= 0) {
+            return symbols.strings.at(symbols.scopeIds.at(symbol));
+        }
+        break;
+    case Qt::BackgroundRole:
+        if (matched.at(symbol)) {
+            return QColor("#ffff00");
+        }
+        break;
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QVariant OutlineModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    switch (section) {
+    case COLUMN_FILE_LINE:
+        return tr("行番号");
+    case COLUMN_FUNC_NAME:
+        return tr("関数名");
+    case COLUMN_FUNC_TYPE:
+        return tr("種類");
+    default:
+        return QVariant();
+    }
+}
+
+void OutlineModel::sort(int column, Qt::SortOrder order)
+{
+    emit layoutAboutToBeChanged();
+    const QModelIndexList persistent = persistentIndexList();
+    QVector<int> persistentSymbols;
+    foreach (const QModelIndex &index, persistent) {
+        persistentSymbols.append(this->order.at(index.row()));
+    }
+
+    sortColumn = column;
+    sortOrder = order;
+    updateOrder();
+
+    QModelIndexList moved;
+    for (int i = 0; i < persistent.size(); ++i) {
+        moved.append(index(rows.at(persistentSymbols.at(i)), persistent.at(i).column()));
+    }
+    changePersistentIndexList(persistent, moved);
+    emit layoutChanged();
+}
+
+int OutlineModel::intern(SymbolTable &table, const QString &text)
+{
+    QHash<QString, int>::const_iterator it = table.stringIds.constFind(text);
+    if (it != table.stringIds.constEnd()) {
+        return it.value();
+    }
+    const int id = table.strings.size();
+    table.strings.append(text);
+    table.stringIds.insert(text, id);
+    return id;
+}
+
+QString OutlineModel::kindName(char kind)
+{
+    switch (kind) {
+    case 'f':
+        return tr("関数");
+    case 'd':
+        return tr("定義");
+    case 's':
+        return tr("構造体");
+    case 'm':
+        return tr("メンバー");
+    case 'g':
+        return tr("列挙体");
+    case 'e':
+        return tr("列挙値");
+    case 'v':
+        return tr("変数");
+    case 'c':
+        return tr("クラス");
+    case 'n':
+        return tr("名前空間");
+    default:
+        return tr("不明");
+    }
+}
+
+bool OutlineModel::isLineOrder() const
+{
+    return sortColumn == COLUMN_FILE_LINE && sortOrder == Qt::AscendingOrder;
+}
+
+/**
+ * 表示順を作り直す(名前は文字列表の順位で比較する)
+ */
+void OutlineModel::updateOrder()
+{
+    const int size = symbols.lines.size();
+    order.resize(size);
+    for (int i = 0; i < size; ++i) {
+        order[i] = i;
+    }
+
+    if (!isLineOrder()) {
+        QVector<int> ranks;
+        if (sortColumn == COLUMN_FUNC_NAME) {
+            QVector<int> sorted(symbols.strings.size());
+            for (int i = 0; i < sorted.size(); ++i) {
+                sorted[i] = i;
+            }
+            std::sort(sorted.begin(), sorted.end(), StringLess(symbols.strings));
+            ranks.resize(sorted.size());
+            for (int i = 0; i < sorted.size(); ++i) {
+                ranks[sorted.at(i)] = i;
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), SymbolLess(symbols, sortColumn, ranks));
+        if (sortOrder == Qt::DescendingOrder) {
+            std::reverse(order.begin(), order.end());
+        }
+    }
+
+    rows.resize(size);
+    for (int i = 0; i < size; ++i) {
+        rows[order.at(i)] = i;
+    }
+}
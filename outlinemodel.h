@@ -0,0 +1,69 @@
+#ifndef OUTLINEMODEL_H
+#define OUTLINEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QVector>
+#include "symbolscanner.h"
+
+/**
+ * アウトラインのモデル
+ *
+ * シンボルは列毎の配列(名前・スコープは文字列表の番号、種類、行番号)に行番号順で保持し、
+ * 表示順は並べ替え用の番号の配列で持つ。並べ替えは文字列を比較せず整数で行う。
+ */
+class OutlineModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    enum COLUMN {
+        COLUMN_FILE_LINE,
+        COLUMN_FUNC_NAME,
+        COLUMN_FUNC_TYPE,
+        COLUMN_MAX
+    };
+
+    typedef struct tagSymbolTable {
+        QVector<int> nameIds;               // 名前(strings の番号)
+        QVector<int> scopeIds;              // スコープ(strings の番号、なしは-1)
+        QVector<char> kinds;                // 種類(ctags の kind)
+        QVector<int> lines;                 // 行番号(昇順)
+        QVector<QString> strings;           // 文字列表
+        QHash<QString, int> stringIds;
+    } SymbolTable;
+
+public:
+    explicit OutlineModel(QObject *parent = 0);
+    static SymbolTable createTable(const QVector<SymbolScanner::Symbol> &symbols);
+    const SymbolTable &table() const { return symbols; }
+    void setTable(const SymbolTable &table);
+    void patch(const SymbolScanner::Patch &patch);
+    void clear();
+    int lineAt(const QModelIndex &index) const;
+    QModelIndex indexForLine(int line) const;
+    void setMatchLines(const QVector<int> &matchLines);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &child) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+private:
+    static int intern(SymbolTable &table, const QString &text);
+    static QString kindName(char kind);
+    bool isLineOrder() const;
+    void updateOrder();
+
+private:
+    SymbolTable symbols;
+    QVector<int> order;                     // 表示行 → シンボル
+    QVector<int> rows;                      // シンボル → 表示行
+    QVector<bool> matched;                  // 検索文字列を含む範囲
+    int sortColumn;
+    Qt::SortOrder sortOrder;
+};
+
+#endif // OUTLINEMODEL_H
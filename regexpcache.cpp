@@ -0,0 +1,197 @@
+#include "regexpcache.h"
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QVector>
+
+static QMutex cacheMutex;
+static QCache<QString, QRegExp> cache(RegExpCache::CACHE_SIZE);
+static QSet<QString> rejectedPatterns;
+
+/**
+ * 検索文字列とオプションに対応する正規表現を返す
+ * 拒否したパターンは空のQRegExpを返し、rejectedにtrueを設定する
+ */
+QRegExp RegExpCache::regExp(const QString &text, const TextEditor::KeywordOption &option, bool *rejected)
+{
+    const QString key = cacheKey(text, option);
+    QMutexLocker locker(&cacheMutex);
+
+    if (rejected) {
+        *rejected = false;
+    }
+
+    QRegExp *cached = cache.object(key);
+    if (!cached) {
+        QString pattern = text;
+        if (!option.regularExpression) {
+            pattern = QRegExp::escape(pattern);
+        }
+        if (option.wholeWords) {
+            pattern = "\\b" + pattern + "\\b";
+        }
+        cached = new QRegExp(pattern, option.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive);
+
+        /* 利用者の正規表現のみ検査する(エスケープ済みの文字列は安全) */
+        if (option.regularExpression && !isSafePattern(pattern)) {
+            rejectedPatterns.insert(rejectKey(*cached));
+        }
+        cache.insert(key, cached);
+    }
+
+    if (rejectedPatterns.contains(rejectKey(*cached))) {
+        if (rejected) {
+            *rejected = true;
+        }
+        return QRegExp();
+    }
+    return *cached;
+}
+
+/**
+ * 実行時に制限時間を超えたパターンを以降使用しないようにする
+ */
+void RegExpCache::reject(const QRegExp &regexp)
+{
+    QMutexLocker locker(&cacheMutex);
+    rejectedPatterns.insert(rejectKey(regexp));
+}
+
+bool RegExpCache::isRejected(const QRegExp &regexp)
+{
+    QMutexLocker locker(&cacheMutex);
+    return rejectedPatterns.contains(rejectKey(regexp));
+}
+
+/* グループの検査状態 */
+typedef struct tagGroupState {
+    bool unbounded;                         // 上限のない量指定子を含む(入れ子のグループを含む)
+    bool alternation;                       // 選択(|)を含む
+    bool nonLiteral;                        // 文字列以外(メタ文字・文字クラス・量指定子・グループ)を含む
+} GroupState;
+
+/**
+ * position の量指定子の長さを返す(量指定子でない場合は0)
+ * 上限のない量指定子(*、+、{n,})の場合は unbounded に true を設定する
+ */
+static int quantifierLength(const QString &pattern, int position, bool *unbounded)
+{
+    *unbounded = false;
+    if (position >= pattern.size()) {
+        return 0;
+    }
+    const QChar c = pattern.at(position);
+    if (c == QLatin1Char('*') || c == QLatin1Char('+')) {
+        *unbounded = true;
+        return 1;
+    }
+    if (c == QLatin1Char('?')) {
+        return 1;
+    }
+    if (c != QLatin1Char('{')) {
+        return 0;
+    }
+    const int close = pattern.indexOf(QLatin1Char('}'), position);
+    if (close < 0) {
+        return 0;
+    }
+    const QString range = pattern.mid(position + 1, close - position - 1);
+    if (!QRegExp("\\d*(,\\d*)?").exactMatch(range) || range.isEmpty() || range == QLatin1String(",")) {
+        return 0;                           // 量指定子でない { は文字として扱う
+    }
+    *unbounded = range.endsWith(QLatin1Char(','));
+    return close - position + 1;
+}
+
+/**
+ * 破滅的なバックトラックを起こしやすいパターンでないか検査する
+ * 危険なグループ(上限のない量指定子を含む、または文字列以外の選択肢を持つ選択を含む)に
+ * 上限のない量指定子が付いたもの((a+)+、(.*)*、(a|.b)*など)を拒否する。
+ * 上限のある繰り返し((\d{1,3}\.){3})や文字列だけの選択((foo|bar)+)は受け付ける。
+ * 字面による簡易な検査のため、全ての危険なパターンを見つけられるわけではない
+ */
+bool RegExpCache::isSafePattern(const QString &pattern)
+{
+    if (pattern.size() > MAX_PATTERN_LENGTH) {
+        return false;
+    }
+
+    QVector<GroupState> groups;
+    GroupState top = { false, false, false };
+    groups.append(top);
+
+    for (int i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern.at(i);
+        bool unbounded = false;
+        int length = 0;
+
+        if (c == QLatin1Char('\\')) {
+            ++i;
+            if (i < pattern.size() && pattern.at(i).isLetterOrNumber()) {
+                groups.last().nonLiteral = true;    // \d、\w、後方参照など
+            }
+        } else if (c == QLatin1Char('[')) {
+            /* 文字クラスは読み飛ばす */
+            groups.last().nonLiteral = true;
+            ++i;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char('^')) {
+                ++i;
+            }
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char(']')) {
+                ++i;
+            }
+            while (i < pattern.size() && pattern.at(i) != QLatin1Char(']')) {
+                if (pattern.at(i) == QLatin1Char('\\')) {
+                    ++i;
+                }
+                ++i;
+            }
+        } else if (c == QLatin1Char('(')) {
+            groups.last().nonLiteral = true;
+            const GroupState group = { false, false, false };
+            groups.append(group);
+            if (i + 2 < pattern.size() && pattern.at(i + 1) == QLatin1Char('?')) {
+                i += 2;                     // (?: (?= (?! の記号は読み飛ばす
+            }
+        } else if (c == QLatin1Char(')')) {
+            if (groups.size() > 1) {
+                const GroupState group = groups.last();
+                groups.pop_back();
+                const bool dangerous = group.unbounded || (group.alternation && group.nonLiteral);
+                length = quantifierLength(pattern, i + 1, &unbounded);
+                /* 危険なグループ自体を上限なく繰り返す */
+                if (dangerous && unbounded) {
+                    return false;
+                }
+                groups.last().unbounded = groups.last().unbounded || dangerous || unbounded;
+                i += length;
+            }
+        } else if (c == QLatin1Char('|')) {
+            groups.last().alternation = true;
+        } else if (c == QLatin1Char('.')) {
+            groups.last().nonLiteral = true;
+        } else if ((length = quantifierLength(pattern, i, &unbounded)) > 0) {
+            groups.last().nonLiteral = true;
+            groups.last().unbounded = groups.last().unbounded || unbounded;
+            i += length - 1;
+        }
+    }
+
+    return true;
+}
+
+QString RegExpCache::cacheKey(const QString &text, const TextEditor::KeywordOption &option)
+{
+    QString key(text);
+    key += QLatin1Char('\0');
+    key += QLatin1Char(option.caseSensitive ? '1' : '0');
+    key += QLatin1Char(option.wholeWords ? '1' : '0');
+    key += QLatin1Char(option.regularExpression ? '1' : '0');
+    return key;
+}
+
+QString RegExpCache::rejectKey(const QRegExp &regexp)
+{
+    return regexp.pattern() + QLatin1Char(regexp.caseSensitivity() == Qt::CaseSensitive ? '1' : '0');
+}
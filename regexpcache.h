@@ -0,0 +1,36 @@
+#ifndef REGEXPCACHE_H
+#define REGEXPCACHE_H
+
+#include <QRegExp>
+#include "texteditor.h"
+
+/**
+ * 検索文字列とオプションから作成した正規表現の共有キャッシュ
+ *
+ * 強調表示・検索・置換で同じパターンを毎回組み立て直さないよう、作成済みのQRegExpを共有する。
+ * 破滅的なバックトラックを起こす恐れのあるパターン(量指定子の入れ子など)と、
+ * 実行時に制限時間を超えたパターンは拒否し、空のQRegExpを返す(何にも一致しない)。
+ * いずれも最善努力の対策であり、制限時間は一致の合間にしか確認できないため、
+ * 検査を通り抜けたパターンの1回の照合(indexIn)が長時間掛かることは防げない。
+ */
+class RegExpCache
+{
+public:
+    enum {
+        CACHE_SIZE = 128,                   // キャッシュするパターン数
+        MAX_PATTERN_LENGTH = 1024,          // 受け付けるパターンの最大長
+        TIME_LIMIT_MSEC = 200               // 1行の照合に掛けてよい時間
+    };
+
+public:
+    static QRegExp regExp(const QString &text, const TextEditor::KeywordOption &option, bool *rejected = 0);
+    static void reject(const QRegExp &regexp);
+    static bool isRejected(const QRegExp &regexp);
+    static bool isSafePattern(const QString &pattern);
+
+private:
+    static QString cacheKey(const QString &text, const TextEditor::KeywordOption &option);
+    static QString rejectKey(const QRegExp &regexp);
+};
+
+#endif // REGEXPCACHE_H
@@ -1,7 +1,8 @@
 #include "replacedialog.h"
 #include "ui_replacedialog.h"
 #include <QTextCursor>
-#include "highlighter.h"
+#include <QMessageBox>
+#include "regexpcache.h"
 
 ReplaceDialog::ReplaceDialog(QWidget *parent) :
     QDialog(parent),
@@ -13,6 +14,7 @@ ReplaceDialog::ReplaceDialog(QWidget *parent) :
     connect(ui->findPrev, SIGNAL(released()), this, SLOT(findPrev()));
     connect(ui->findNext, SIGNAL(released()), this, SLOT(findNext()));
     connect(ui->replace, SIGNAL(released()), this, SLOT(replace()));
+    connect(ui->replaceAll, SIGNAL(released()), this, SLOT(replaceAll()));
 }
 
 ReplaceDialog::~ReplaceDialog()
@@ -23,17 +25,25 @@ ReplaceDialog::~ReplaceDialog()
 void ReplaceDialog::setCurrentTextEditor(TextEditor *textEditor)
 {
     this->textEditor = textEditor;
-    ui->before->setEditText(textEditor->textCursor().selectedText());
+    setWindowTitle(tr("置換"));
+
+    /* 複数行を選択している場合は選択範囲内を置換する */
+    const QString selected = textEditor->textCursor().selectedText();
+    ui->inSelection->setChecked(selected.contains(QChar::ParagraphSeparator));
+    if (!ui->inSelection->isChecked()) {
+        ui->before->setEditText(selected);
+    }
 }
 
 bool ReplaceDialog::replace(const QString &before, const QString &after,
                            TextEditor::KeywordOption option)
 {
     QTextCursor cursor = textCursor();
-    QRegExp regexp = Highlighter::convertText(before, option);
+    QRegExp regexp = RegExpCache::regExp(before, option);
 
-    if (regexp.exactMatch(cursor.selectedText())) {
-        cursor.insertText(after);
+    /* すべて置換と同じく、正規表現では \1〜\9 を一致した部分に置き換える */
+    if (!regexp.isEmpty() && regexp.exactMatch(cursor.selectedText())) {
+        cursor.insertText(TextEditor::replacementText(regexp, after, option.regularExpression));
         return true;
     }
 
@@ -50,7 +60,12 @@ void ReplaceDialog::findPrev()
     option.wholeWords = ui->wholeWords->isChecked();
     option.regularExpression = ui->regularExpression->isChecked();
 
-    QRegExp regexp = Highlighter::convertText(ui->before->currentText(), option);
+    bool rejected;
+    QRegExp regexp = RegExpCache::regExp(ui->before->currentText(), option, &rejected);
+    if (rejected) {
+        QMessageBox::warning(this, windowTitle(), tr("'%1'は複雑すぎるため検索できません。").arg(ui->before->currentText()));
+        return;
+    }
 
     QTextCursor cursor = textEditor->document()->find(regexp, textEditor->textCursor(), QTextDocument::FindBackward);
     if (!cursor.isNull()) {
@@ -82,7 +97,12 @@ void ReplaceDialog::findNext()
     option.wholeWords = ui->wholeWords->isChecked();
     option.regularExpression = ui->regularExpression->isChecked();
 
-    QRegExp regexp = Highlighter::convertText(ui->before->currentText(), option);
+    bool rejected;
+    QRegExp regexp = RegExpCache::regExp(ui->before->currentText(), option, &rejected);
+    if (rejected) {
+        QMessageBox::warning(this, windowTitle(), tr("'%1'は複雑すぎるため検索できません。").arg(ui->before->currentText()));
+        return;
+    }
 
     QTextCursor cursor = textEditor->document()->find(regexp, textEditor->textCursor());
     if (!cursor.isNull()) {
@@ -117,6 +137,39 @@ void ReplaceDialog::replace()
     }
 }
 
+/**
+ * 全て置換する(選択範囲内のみの指定がある場合は選択範囲内)
+ */
+void ReplaceDialog::replaceAll()
+{
+    if (!textEditor)
+        return;
+
+    TextEditor::KeywordOption option;
+    option.caseSensitive = ui->caseSensitively->isChecked();
+    option.wholeWords = ui->wholeWords->isChecked();
+    option.regularExpression = ui->regularExpression->isChecked();
+
+    const int count = textEditor->replaceAll(ui->before->currentText(), ui->after->currentText(), option,
+                                             ui->inSelection->isChecked());
+    if (count < 0) {
+        QMessageBox::warning(this, windowTitle(), tr("'%1'は複雑すぎるため検索できません。").arg(ui->before->currentText()));
+        return;
+    }
+    if (count == 0) {
+        if (ui->warningNavi->isChecked()) {
+            QMessageBox::information(this, windowTitle(), tr("'%1'が見つかりません。").arg(ui->before->currentText()));
+        }
+        return;
+    }
+
+    if (ui->findkeep->isChecked()) {
+        close();
+    } else {
+        setWindowTitle(tr("置換 - %1件置換しました").arg(count));
+    }
+}
+
 QTextCursor ReplaceDialog::textCursor() const
 {
     return textEditor->textCursor();
@@ -22,6 +22,7 @@ public slots:
     void findPrev();
     void findNext();
     void replace();
+    void replaceAll();
 
 protected:
     QTextCursor textCursor() const;
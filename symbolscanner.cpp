@@ -0,0 +1,530 @@
+#include "symbolscanner.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+bool isIdentifier(const QString &text)
+{
+    return !text.isEmpty() && (text.at(0).isLetter() || text.at(0) == QLatin1Char('_'));
+}
+
+bool isAccessSpecifier(const QString &text)
+{
+    return text == "public" || text == "protected" || text == "private"
+            || text == "signals" || text == "slots" || text == "Q_SIGNALS" || text == "Q_SLOTS";
+}
+
+bool isControlKeyword(const QString &text)
+{
+    return text == "if" || text == "for" || text == "while" || text == "switch" || text == "catch"
+            || text == "return" || text == "sizeof" || text == "do" || text == "else";
+}
+
+bool lineLess(const SymbolScanner::Symbol &a, const SymbolScanner::Symbol &b)
+{
+    return a.line < b.line;
+}
+
+/**
+ * template<...> を読み飛ばした位置を返す
+ */
+int skipTemplate(const QVector<SymbolScanner::Token> &tokens)
+{
+    if (tokens.isEmpty() || tokens.at(0).text != "template") {
+        return 0;
+    }
+    int depth = 0;
+    for (int i = 1; i < tokens.size(); ++i) {
+        if (tokens.at(i).text == "<") {
+            ++depth;
+        } else if (tokens.at(i).text == ">" && --depth <= 0) {
+            return i + 1;
+        }
+    }
+    return tokens.size();
+}
+
+}
+
+SymbolScanner::SymbolScanner()
+    : documentRevision(-1)
+{
+}
+
+/**
+ * 文書全体を解析する
+ */
+void SymbolScanner::scan(const QTextDocument *document)
+{
+    lineStates.clear();
+    lineStates.reserve(document->blockCount());
+    symbolList.clear();
+
+    ScanState state;
+    state.comment = false;
+    state.preprocessor = false;
+    state.ignoreStatement = false;
+    int line = 0;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next(), ++line) {
+        lineStates.append(state);
+        scanLine(block.text(), line + 1, state, symbolList);
+    }
+    documentRevision = document->revision();
+}
+
+/**
+ * 編集された範囲を含むトップレベルから再解析する
+ * contentsChange の position, charsAdded を渡す(編集後の文書に対して呼ぶ)
+ */
+bool SymbolScanner::update(const QTextDocument *document, int position, int charsAdded, Patch *patch)
+{
+    if (lineStates.isEmpty()) {
+        scan(document);
+        patch->firstLine = 1;
+        patch->lastLine = INT_MAX;
+        patch->delta = 0;
+        patch->symbols = symbolList;
+        return true;
+    }
+
+    const int oldCount = lineStates.size();
+    const int newCount = document->blockCount();
+    const int delta = newCount - oldCount;
+    const int firstChanged = document->findBlock(position).blockNumber();
+    const int lastChanged = document->findBlock(position + charsAdded).blockNumber();
+
+    /* 変更行を含むトップレベルの先頭まで戻る */
+    int start = qBound(0, firstChanged, oldCount - 1);
+    while (start > 0 && !isBoundary(lineStates.at(start))) {
+        --start;
+    }
+
+    /* 変更行より後で状態が編集前と一致するまで解析する */
+    ScanState state = lineStates.at(start);
+    QVector<ScanState> states;
+    QVector<Symbol> symbols;
+    int line = start;
+    QTextBlock block = document->findBlockByNumber(start);
+    for (; block.isValid(); block = block.next(), ++line) {
+        if (line > lastChanged && line - delta < oldCount && isSameState(state, lineStates.at(line - delta))) {
+            break;
+        }
+        states.append(state);
+        scanLine(block.text(), line + 1, state, symbols);
+    }
+    const int stopOld = block.isValid() ? line - delta : oldCount;
+
+    /* 行の状態とシンボルの置き換え */
+    if (states.size() == stopOld - start) {
+        for (int i = 0; i < states.size(); ++i) {
+            lineStates[start + i] = states.at(i);
+        }
+    } else {
+        lineStates = lineStates.mid(0, start) + states + lineStates.mid(stopOld);
+    }
+
+    Symbol first;
+    first.line = start + 1;
+    Symbol last;
+    last.line = stopOld;
+    QVector<Symbol>::iterator begin = std::lower_bound(symbolList.begin(), symbolList.end(), first, lineLess);
+    QVector<Symbol>::iterator end = std::upper_bound(begin, symbolList.end(), last, lineLess);
+    const int insertAt = begin - symbolList.begin();
+    symbolList.erase(begin, end);
+    for (int i = insertAt; i < symbolList.size(); ++i) {
+        symbolList[i].line += delta;
+    }
+    for (int i = 0; i < symbols.size(); ++i) {
+        symbolList.insert(insertAt + i, symbols.at(i));
+    }
+    documentRevision = document->revision();
+
+    patch->firstLine = start + 1;
+    patch->lastLine = stopOld;
+    patch->delta = delta;
+    patch->symbols = symbols;
+    return true;
+}
+
+/**
+ * 1行分を解析する(文字列・文字定数とコメントは読み飛ばす)
+ */
+void SymbolScanner::scanLine(const QString &text, int line, ScanState &state, QVector<Symbol> &symbols)
+{
+    const int size = text.size();
+    int i = 0;
+
+    if (state.preprocessor) {
+        state.preprocessor = text.endsWith(QLatin1Char('\\'));
+        return;
+    }
+    if (!state.comment) {
+        while (i < size && text.at(i).isSpace()) {
+            ++i;
+        }
+        if (i < size && text.at(i) == QLatin1Char('#')) {
+            /* #define のみ取り出す */
+            ++i;
+            while (i < size && text.at(i).isSpace()) {
+                ++i;
+            }
+            if (text.mid(i, 6) == "define") {
+                i += 6;
+                while (i < size && text.at(i).isSpace()) {
+                    ++i;
+                }
+                int end = i;
+                while (end < size && (text.at(end).isLetterOrNumber() || text.at(end) == QLatin1Char('_'))) {
+                    ++end;
+                }
+                if (end > i) {
+                    Symbol symbol = { text.mid(i, end - i), line, 'd' };
+                    symbols.append(symbol);
+                }
+            }
+            state.preprocessor = text.endsWith(QLatin1Char('\\'));
+            return;
+        }
+    }
+
+    while (i < size) {
+        if (state.comment) {
+            const int end = text.indexOf("*/", i);
+            if (end < 0) {
+                return;
+            }
+            i = end + 2;
+            state.comment = false;
+            continue;
+        }
+
+        const QChar c = text.at(i);
+        const QChar next = i + 1 < size ? text.at(i + 1) : QChar();
+        if (c == QLatin1Char('/') && next == QLatin1Char('/')) {
+            return;
+        }
+        if (c == QLatin1Char('/') && next == QLatin1Char('*')) {
+            state.comment = true;
+            i += 2;
+            continue;
+        }
+        if (c == QLatin1Char('"') || c == QLatin1Char('\'')) {
+            for (++i; i < size && text.at(i) != c; ++i) {
+                if (text.at(i) == QLatin1Char('\\')) {
+                    ++i;
+                }
+            }
+            ++i;
+            continue;
+        }
+        if (c.isSpace()) {
+            ++i;
+            continue;
+        }
+        if (c.isLetter() || c == QLatin1Char('_')) {
+            int end = i + 1;
+            while (end < size && (text.at(end).isLetterOrNumber() || text.at(end) == QLatin1Char('_'))) {
+                ++end;
+            }
+            if (isCollecting(state)) {
+                const QString word = text.mid(i, end - i);
+                if (word != "Q_OBJECT") {
+                    Token token = { word, line };
+                    state.tokens.append(token);
+                }
+            }
+            i = end;
+            continue;
+        }
+        if (c.isDigit()) {
+            while (i < size && (text.at(i).isLetterOrNumber() || text.at(i) == QLatin1Char('.'))) {
+                ++i;
+            }
+            continue;
+        }
+
+        switch (c.unicode()) {
+        case '{':
+            openBrace(state, symbols);
+            break;
+        case '}':
+            closeBrace(state, symbols);
+            break;
+        case ';':
+            if (isCollecting(state)) {
+                endStatement(state, symbols);
+            }
+            break;
+        case ',':
+            if (!state.contexts.isEmpty() && state.contexts.at(state.contexts.size() - 1) == 'g') {
+                endStatement(state, symbols);
+            } else if (isCollecting(state)) {
+                Token token = { QString(c), line };
+                state.tokens.append(token);
+            }
+            break;
+        case ':':
+            if (next == QLatin1Char(':')) {
+                if (isCollecting(state)) {
+                    Token token = { QString("::"), line };
+                    state.tokens.append(token);
+                }
+                ++i;
+                break;
+            }
+            /* public: などのアクセス指定子は宣言文に含めない */
+            if (isCollecting(state)) {
+                bool access = !state.tokens.isEmpty();
+                foreach (const Token &token, state.tokens) {
+                    access = access && isAccessSpecifier(token.text);
+                }
+                if (access) {
+                    state.tokens.clear();
+                } else {
+                    Token token = { QString(c), line };
+                    state.tokens.append(token);
+                }
+            }
+            break;
+        default:
+            if (isCollecting(state)) {
+                Token token = { QString(c), line };
+                state.tokens.append(token);
+            }
+            break;
+        }
+        ++i;
+    }
+}
+
+/**
+ * { の直前までの宣言文から、クラス・列挙体・名前空間・関数を取り出す
+ */
+void SymbolScanner::openBrace(ScanState &state, QVector<Symbol> &symbols)
+{
+    if (!isCollecting(state) || state.contexts.endsWith('g')) {
+        state.contexts.append('o');
+        return;
+    }
+
+    const QVector<Token> &tokens = state.tokens;
+    const int begin = skipTemplate(tokens);
+
+    /* class / struct / union / enum / namespace */
+    for (int i = begin; i < tokens.size() && tokens.at(i).text != "(" && tokens.at(i).text != "="; ++i) {
+        const QString &word = tokens.at(i).text;
+        char kind = 0;
+        if (word == "class" || word == "struct" || word == "union") {
+            kind = word == "class" ? 'c' : (word == "struct" ? 's' : 'u');
+        } else if (word == "enum") {
+            kind = 'g';
+        } else if (word == "namespace") {
+            kind = 'n';
+        }
+        if (!kind) {
+            continue;
+        }
+        int name = -1;
+        for (int j = i + 1; j < tokens.size() && tokens.at(j).text != ":" && tokens.at(j).text != "<"; ++j) {
+            if (isIdentifier(tokens.at(j).text) && tokens.at(j).text != "class" && tokens.at(j).text != "struct"
+                    && tokens.at(j).text != "final") {
+                name = j;
+            }
+        }
+        if (name >= 0) {
+            Symbol symbol = { tokens.at(name).text, tokens.at(name).line, kind };
+            symbols.append(symbol);
+        }
+        state.contexts.append(kind == 'n' ? 'n' : (kind == 'g' ? 'g' : 'c'));
+        state.tokens.clear();
+        state.ignoreStatement = false;
+        return;
+    }
+
+    /* extern "C" { は名前空間と同様に扱う */
+    if (tokens.size() == 1 && tokens.at(0).text == "extern") {
+        state.contexts.append('n');
+        state.tokens.clear();
+        return;
+    }
+
+    /* 関数(初期化子リストより前の最後の引数リストの直前が関数名) */
+    int end = tokens.size();
+    int depth = 0;
+    for (int i = begin; i < tokens.size(); ++i) {
+        const QString &text = tokens.at(i).text;
+        if (text == "(") {
+            ++depth;
+        } else if (text == ")") {
+            --depth;
+        } else if (text == ":" && depth == 0 && i > 0 && tokens.at(i - 1).text == ")") {
+            end = i;
+            break;
+        }
+    }
+    int paren = -1;
+    depth = 0;
+    for (int i = end - 1; i >= begin; --i) {
+        const QString &text = tokens.at(i).text;
+        if (text == ")") {
+            ++depth;
+        } else if (text == "(" && --depth == 0) {
+            paren = i;
+            if (i > begin && isIdentifier(tokens.at(i - 1).text) && tokens.at(i - 1).text != "noexcept"
+                    && tokens.at(i - 1).text != "throw") {
+                break;
+            }
+        }
+    }
+    if (paren > begin && !state.ignoreStatement) {
+        /* operator の場合は記号も名前に含める */
+        QString name;
+        int line = tokens.at(paren - 1).line;
+        for (int i = qMax(begin, paren - 4); i < paren; ++i) {
+            if (tokens.at(i).text == "operator") {
+                for (int j = i; j < paren; ++j) {
+                    name += tokens.at(j).text;
+                }
+                line = tokens.at(i).line;
+                break;
+            }
+        }
+        if (name.isEmpty() && isIdentifier(tokens.at(paren - 1).text)) {
+            name = tokens.at(paren - 1).text;
+            if (paren - 2 >= begin && tokens.at(paren - 2).text == "~") {
+                name.prepend(QLatin1Char('~'));
+            }
+        }
+        if (!name.isEmpty() && !isControlKeyword(name)) {
+            Symbol symbol = { name, line, 'f' };
+            symbols.append(symbol);
+            state.contexts.append('f');
+            state.tokens.clear();
+            return;
+        }
+    }
+
+    /* 初期化子など(閉じた後の ; で変数として扱うため宣言文は残す) */
+    state.contexts.append('o');
+}
+
+void SymbolScanner::closeBrace(ScanState &state, QVector<Symbol> &symbols)
+{
+    if (state.contexts.isEmpty()) {
+        return;
+    }
+    const char context = state.contexts.at(state.contexts.size() - 1);
+    if (context == 'g') {
+        endStatement(state, symbols);   // 最後の列挙値
+    }
+    state.contexts.chop(1);
+
+    switch (context) {
+    case 'c':
+    case 'g':
+        state.tokens.clear();
+        state.ignoreStatement = true;
+        break;
+    case 'f':
+    case 'n':
+        state.tokens.clear();
+        state.ignoreStatement = false;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * ; (列挙体の中では ,) で終わる宣言文から変数・メンバー・列挙値を取り出す
+ */
+void SymbolScanner::endStatement(ScanState &state, QVector<Symbol> &symbols)
+{
+    const QVector<Token> tokens = state.tokens;
+    const bool ignore = state.ignoreStatement;
+    state.tokens.clear();
+    state.ignoreStatement = false;
+    if (tokens.isEmpty()) {
+        return;
+    }
+
+    const char context = state.contexts.isEmpty() ? 0 : state.contexts.at(state.contexts.size() - 1);
+    if (context == 'g') {
+        if (isIdentifier(tokens.at(0).text)) {
+            Symbol symbol = { tokens.at(0).text, tokens.at(0).line, 'e' };
+            symbols.append(symbol);
+        }
+        return;
+    }
+    if (ignore) {
+        return;
+    }
+
+    const QString &first = tokens.at(0).text;
+    if (first == "typedef" || first == "using" || first == "friend" || first == "extern" || first == "template"
+            || first == "class" || first == "struct" || first == "union" || first == "enum" || first == "namespace"
+            || first == "return") {
+        return;
+    }
+
+    /* 関数宣言・マクロ呼出しは除く。型名の後の最初の宣言子の名前を取り出す */
+    int name = -1;
+    int angle = 0;
+    for (int i = 0; i < tokens.size(); ++i) {
+        const QString &text = tokens.at(i).text;
+        if (text == "(") {
+            return;
+        }
+        if (text == "<") {
+            ++angle;
+        } else if (text == ">") {
+            --angle;
+        } else if (angle == 0 && (text == "=" || text == "[" || text == ":" || text == ",")) {
+            break;
+        } else if (isIdentifier(text) && text != "const" && text != "volatile") {
+            name = i;
+        }
+    }
+    if (name <= 0) {
+        return;     // 型名のみ
+    }
+    Symbol symbol = { tokens.at(name).text, tokens.at(name).line, context == 'c' ? 'm' : 'v' };
+    symbols.append(symbol);
+}
+
+/**
+ * 宣言文を集める文脈(トップレベル・名前空間・クラス・列挙体の直下)か
+ */
+bool SymbolScanner::isCollecting(const ScanState &state)
+{
+    if (state.contexts.isEmpty()) {
+        return true;
+    }
+    const char context = state.contexts.at(state.contexts.size() - 1);
+    return context == 'n' || context == 'c' || context == 'g';
+}
+
+/**
+ * トップレベル(名前空間の直下を含む)の宣言の区切りか
+ */
+bool SymbolScanner::isBoundary(const ScanState &state)
+{
+    if (state.comment || state.preprocessor || state.ignoreStatement || !state.tokens.isEmpty()) {
+        return false;
+    }
+    for (int i = 0; i < state.contexts.size(); ++i) {
+        if (state.contexts.at(i) != 'n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SymbolScanner::isSameState(const ScanState &a, const ScanState &b)
+{
+    return a.tokens.isEmpty() && b.tokens.isEmpty() && a.comment == b.comment && a.preprocessor == b.preprocessor
+            && a.ignoreStatement == b.ignoreStatement && a.contexts == b.contexts;
+}
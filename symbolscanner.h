@@ -0,0 +1,70 @@
+#ifndef SYMBOLSCANNER_H
+#define SYMBOLSCANNER_H
+
+#include <QString>
+#include <QVector>
+
+class QTextDocument;
+
+/**
+ * アウトライン用の簡易シンボル解析(C/C++)
+ *
+ * 行毎に解析開始時の状態(括弧の入れ子・宣言文の途中・コメント中か)を保持し、
+ * 編集時は変更行を含むトップレベルの範囲から再解析して、状態が編集前と一致した行で打ち切る。
+ * シンボルの種類は ctags の kind と同じ文字を使う。
+ */
+class SymbolScanner
+{
+public:
+    typedef struct tagSymbol {
+        QString name;                       // シンボル名
+        int line;                           // 行番号(1始まり)
+        char kind;                          // 種類(ctags の kind)
+        QString scope;                      // スコープ(ctags の class: など、不明な場合は空)
+    } Symbol;
+
+    /* 編集による変更内容(編集前の firstLine〜lastLine 行のシンボルを symbols で置き換え、以降の行は delta ずらす) */
+    typedef struct tagPatch {
+        int firstLine;
+        int lastLine;
+        int delta;
+        QVector<Symbol> symbols;
+    } Patch;
+
+    typedef struct tagToken {
+        QString text;
+        int line;
+    } Token;
+
+    /* 行の解析開始時の状態 */
+    typedef struct tagScanState {
+        QByteArray contexts;                // 括弧の種類('n' 名前空間, 'c' クラス, 'g' 列挙体, 'f' 関数, 'o' その他)
+        QVector<Token> tokens;              // 途中の宣言文
+        bool comment;                       // 複数行コメントの中
+        bool preprocessor;                  // プリプロセッサ行の継続
+        bool ignoreStatement;               // } の後の ; まで読み飛ばす
+    } ScanState;
+
+public:
+    SymbolScanner();
+    void scan(const QTextDocument *document);
+    bool update(const QTextDocument *document, int position, int charsAdded, Patch *patch);
+    const QVector<Symbol> &symbols() const { return symbolList; }
+    int revision() const { return documentRevision; }
+
+private:
+    static void scanLine(const QString &text, int line, ScanState &state, QVector<Symbol> &symbols);
+    static void openBrace(ScanState &state, QVector<Symbol> &symbols);
+    static void closeBrace(ScanState &state, QVector<Symbol> &symbols);
+    static void endStatement(ScanState &state, QVector<Symbol> &symbols);
+    static bool isCollecting(const ScanState &state);
+    static bool isBoundary(const ScanState &state);
+    static bool isSameState(const ScanState &a, const ScanState &b);
+
+private:
+    QVector<ScanState> lineStates;          // 各行の解析開始時の状態
+    QVector<Symbol> symbolList;             // 行番号順
+    int documentRevision;
+};
+
+#endif // SYMBOLSCANNER_H
@@ -0,0 +1,363 @@
+#include "tagsindex.h"
+#include "atomicfile.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFileInfo>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+const char INDEX_MAGIC[4] = { 'K', 'T', 'I', 'X' };
+const quint32 INDEX_VERSION = 1;
+
+/* 索引ファイルの先頭(以降にシンボル名順のオフセットが count 個続く) */
+typedef struct tagIndexHeader {
+    char magic[4];
+    quint32 version;
+    qint64 tagsSize;                        // 作成時のtagsファイルのサイズ
+    qint64 tagsModified;                    // 作成時のtagsファイルの更新日時
+    quint32 count;
+    quint32 reserved;
+} IndexHeader;
+
+/**
+ * オフセット位置の行のシンボル名(タブまで)を比較する
+ * ctags の整列(行全体のバイト比較)と同じ順序になるよう、短い方を小さいとみなす
+ */
+int compareName(const char *data, qint64 size, quint32 offset, const char *name, int length)
+{
+    const char *p = data + offset;
+    const char *end = data + size;
+    for (int i = 0; i < length; ++i, ++p) {
+        if (p >= end || *p == '\t' || *p == '\n' || *p == '\r') {
+            return -1;
+        }
+        const int c = static_cast<uchar>(*p) - static_cast<uchar>(name[i]);
+        if (c != 0) {
+            return c;
+        }
+    }
+    return (p >= end || *p == '\t' || *p == '\n' || *p == '\r') ? 0 : 1;
+}
+
+class NameLess
+{
+public:
+    NameLess(const char *data, qint64 size) : data(data), size(size) {}
+    bool operator()(quint32 a, quint32 b) const
+    {
+        const char *name = data + b;
+        const char *end = static_cast<const char *>(memchr(name, '\t', size - b));
+        return compareName(data, size, a, name, end ? static_cast<int>(end - name) : static_cast<int>(size - b)) < 0;
+    }
+
+private:
+    const char *data;
+    qint64 size;
+};
+
+}
+
+TagsIndex::TagsIndex()
+    : opened(false), tagsData(0), tagsSize(0), tagsModified(0), indexData(0), offsets(0), count(0)
+{
+}
+
+TagsIndex::~TagsIndex()
+{
+    close();
+}
+
+/**
+ * tagsファイルの索引ファイルをメモリマップする(索引が古い場合はtagsファイルを読んで作り直す)
+ * 既に同じtagsファイルを開いていて更新されていなければ何もしない
+ */
+bool TagsIndex::open(const QString &tagsFileName)
+{
+    const QFileInfo info(tagsFileName);
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    if (isOpen() && tagsFile.fileName() == tagsFileName && tagsSize == info.size() && tagsModified == modified) {
+        return true;
+    }
+
+    close();
+    tagsFile.setFileName(tagsFileName);
+    tagsSize = info.size();
+    tagsModified = modified;
+    if (tagsSize <= 0 || tagsSize > Q_INT64_C(0xffffffff)) {
+        error = QObject::tr("タグファイルのサイズが対応範囲外です");
+        return false;
+    }
+
+    const QString fileName = indexFileName(tagsFileName);
+    if (!mapIndex(fileName) || !isIndexValid()) {
+        if (!mapTags()) {
+            return false;
+        }
+        build(fileName);
+        unmapTags();
+    }
+    opened = true;
+    return true;
+}
+
+void TagsIndex::close()
+{
+    if (indexData) {
+        indexFile.unmap(const_cast<uchar *>(indexData));
+        indexData = 0;
+    }
+    if (indexFile.isOpen()) {
+        indexFile.close();
+    }
+    unmapTags();
+    opened = false;
+    offsets = 0;
+    count = 0;
+    memoryOffsets.clear();
+}
+
+/**
+ * シンボル名に一致するタグを全て返す
+ * tagsファイルは検索の間だけマップし、索引の作成後に変更されていた場合は何も返さない
+ */
+QVector<TagsIndex::Entry> TagsIndex::find(const QString &name)
+{
+    QVector<Entry> entries;
+    if (!isOpen() || name.isEmpty() || !mapTags()) {
+        return entries;
+    }
+
+    const QByteArray key = name.toLocal8Bit();
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        if (compareName(tagsData, tagsSize, offsets[middle], key.constData(), key.size()) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (int i = low; i < count && compareName(tagsData, tagsSize, offsets[i], key.constData(), key.size()) == 0; ++i) {
+        entries.append(entryAt(offsets[i]));
+    }
+    unmapTags();
+    return entries;
+}
+
+/**
+ * tagsファイルをメモリマップする(サイズが索引の作成時と異なる場合は失敗する)
+ */
+bool TagsIndex::mapTags()
+{
+    if (!tagsFile.open(QFile::ReadOnly)) {
+        error = tagsFile.errorString();
+        return false;
+    }
+    if (tagsFile.size() != tagsSize) {
+        error = QObject::tr("タグファイルが更新されています");
+        tagsFile.close();
+        return false;
+    }
+    tagsData = reinterpret_cast<const char *>(tagsFile.map(0, tagsSize));
+    if (!tagsData) {
+        error = tagsFile.errorString();
+        tagsFile.close();
+        return false;
+    }
+    return true;
+}
+
+void TagsIndex::unmapTags()
+{
+    if (tagsData) {
+        tagsFile.unmap(reinterpret_cast<uchar *>(const_cast<char *>(tagsData)));
+        tagsData = 0;
+    }
+    if (tagsFile.isOpen()) {
+        tagsFile.close();
+    }
+}
+
+bool TagsIndex::isIndexValid() const
+{
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(indexData);
+    return header->tagsSize == tagsSize && header->tagsModified == tagsModified;
+}
+
+/**
+ * 索引ファイルを作成する
+ * 作成できない場合はメモリ上の索引を使う
+ */
+bool TagsIndex::build(const QString &indexFileName)
+{
+    if (indexData) {
+        indexFile.unmap(const_cast<uchar *>(indexData));
+        indexData = 0;
+    }
+    indexFile.close();
+
+    /* 行頭のオフセットを集める(!で始まる疑似タグは除く) */
+    QVector<quint32> lines;
+    const char *p = tagsData;
+    const char *end = tagsData + tagsSize;
+    bool sorted = true;
+    NameLess less(tagsData, tagsSize);
+    while (p < end) {
+        const char *found = static_cast<const char *>(memchr(p, '\n', end - p));
+        const char *next = found ? found + 1 : end;
+        if (*p != '!' && *p != '\n' && *p != '\r') {
+            const quint32 offset = static_cast<quint32>(p - tagsData);
+            if (sorted && !lines.isEmpty() && less(offset, lines.last())) {
+                sorted = false;
+            }
+            lines.append(offset);
+        }
+        p = next;
+    }
+    /* 整列済みのtagsファイル(!_TAG_FILE_SORTED 1)はそのまま使える */
+    if (!sorted) {
+        std::stable_sort(lines.begin(), lines.end(), less);
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.tagsSize = tagsSize;
+    header.tagsModified = tagsModified;
+    header.count = lines.size();
+    header.reserved = 0;
+
+    QDir().mkpath(QFileInfo(indexFileName).path());
+    AtomicFile file(indexFileName);
+    if (file.open()
+            && file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(&header), sizeof(header)))
+            && file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(lines.constData()), lines.size() * sizeof(quint32)))
+            && file.commit()
+            && mapIndex(indexFileName)) {
+        return true;
+    }
+
+    memoryOffsets = lines;
+    offsets = memoryOffsets.constData();
+    count = memoryOffsets.size();
+    return true;
+}
+
+bool TagsIndex::mapIndex(const QString &indexFileName)
+{
+    indexFile.setFileName(indexFileName);
+    if (!indexFile.open(QFile::ReadOnly)) {
+        return false;
+    }
+    const qint64 size = indexFile.size();
+    if (size < static_cast<qint64>(sizeof(IndexHeader))) {
+        indexFile.close();
+        return false;
+    }
+    indexData = indexFile.map(0, size);
+    if (!indexData) {
+        indexFile.close();
+        return false;
+    }
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(indexData);
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 || header->version != INDEX_VERSION
+            || size != static_cast<qint64>(sizeof(IndexHeader) + header->count * sizeof(quint32))) {
+        indexFile.unmap(const_cast<uchar *>(indexData));
+        indexData = 0;
+        indexFile.close();
+        return false;
+    }
+    offsets = reinterpret_cast<const quint32 *>(indexData + sizeof(IndexHeader));
+    count = header->count;
+    return true;
+}
+
+QByteArray TagsIndex::nameAt(quint32 offset) const
+{
+    const char *name = tagsData + offset;
+    const char *end = static_cast<const char *>(memchr(name, '\t', tagsSize - offset));
+    return QByteArray(name, end ? static_cast<int>(end - name) : 0);
+}
+
+/**
+ * オフセット位置の行を解析する
+ * 形式: シンボル名<TAB>ファイル名<TAB>exコマンド;"<TAB>種類...
+ */
+TagsIndex::Entry TagsIndex::entryAt(quint32 offset) const
+{
+    const char *begin = tagsData + offset;
+    const char *found = static_cast<const char *>(memchr(begin, '\n', tagsSize - offset));
+    QByteArray line(begin, found ? static_cast<int>(found - begin) : static_cast<int>(tagsSize - offset));
+    if (line.endsWith('\r')) {
+        line.chop(1);
+    }
+
+    Entry entry;
+    entry.lineNumber = 0;
+    entry.name = QString::fromLocal8Bit(nameAt(offset));
+
+    const int fileBegin = line.indexOf('\t') + 1;
+    const int fileEnd = line.indexOf('\t', fileBegin);
+    if (fileBegin <= 0 || fileEnd < 0) {
+        return entry;
+    }
+    const QString fileName = QString::fromLocal8Bit(line.mid(fileBegin, fileEnd - fileBegin));
+    entry.filePath = QDir::cleanPath(QFileInfo(tagsFile.fileName()).dir().absoluteFilePath(fileName));
+
+    /* exコマンドは ;" で終わる(検索パターン内にタブを含む場合がある) */
+    const int addressBegin = fileEnd + 1;
+    int addressEnd = line.indexOf(";\"\t", addressBegin);
+    int extensionBegin = addressEnd + 3;
+    if (addressEnd < 0) {
+        addressEnd = line.endsWith(";\"") ? line.size() - 2 : line.size();
+        extensionBegin = line.size();
+    }
+    QByteArray address = line.mid(addressBegin, addressEnd - addressBegin);
+
+    bool ok;
+    entry.lineNumber = address.toInt(&ok);
+    if (!ok) {
+        entry.lineNumber = 0;
+        if (address.size() >= 2 && (address.at(0) == '/' || address.at(0) == '?')) {
+            const char delimiter = address.at(0);
+            address = address.mid(1, address.size() - (address.endsWith(delimiter) ? 2 : 1));
+        }
+        if (address.startsWith('^')) {
+            address.remove(0, 1);
+        }
+        if (address.endsWith('$')) {
+            address.chop(1);
+        }
+        address.replace("\\/", "/");
+        address.replace("\\?", "?");
+        address.replace("\\\\", "\\");
+        entry.pattern = QString::fromLocal8Bit(address);
+    }
+
+    if (extensionBegin < line.size()) {
+        int kindEnd = line.indexOf('\t', extensionBegin);
+        QByteArray kind = line.mid(extensionBegin, kindEnd < 0 ? -1 : kindEnd - extensionBegin);
+        if (kind.startsWith("kind:")) {
+            kind.remove(0, 5);
+        }
+        entry.kind = QString::fromLocal8Bit(kind);
+    }
+    return entry;
+}
+
+/**
+ * 索引ファイル名(キャッシュディレクトリ内、tagsファイルのパスのハッシュ値)
+ */
+QString TagsIndex::indexFileName(const QString &tagsFileName)
+{
+    const QByteArray hash = QCryptographicHash::hash(QFileInfo(tagsFileName).absoluteFilePath().toUtf8(),
+                                                     QCryptographicHash::Md5).toHex();
+    return QDesktopServices::storageLocation(QDesktopServices::CacheLocation)
+            + "/tags/" + QString::fromLatin1(hash) + ".idx";
+}
@@ -0,0 +1,61 @@
+#ifndef TAGSINDEX_H
+#define TAGSINDEX_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/**
+ * tagsファイルのシンボル索引
+ *
+ * tagsファイルの各行の先頭オフセットをシンボル名順に並べた索引ファイルを
+ * キャッシュディレクトリに作成してメモリマップし、二分探索でシンボルを検索する。
+ * 索引ファイルにはtagsファイルの更新日時とサイズを記録し、変わった場合のみ作り直す。
+ * tagsファイルは検索中だけマップする(開いたままではtagsファイルを置き換えられない環境がある)。
+ */
+class TagsIndex
+{
+public:
+    typedef struct tagEntry {
+        QString name;                       // シンボル名
+        QString filePath;                   // ファイル名(tagsファイルからの相対パスは絶対パスへ変換済み)
+        QString pattern;                    // 検索パターン(^ $ と区切り文字は除去済み、行番号の場合は空)
+        QString kind;                       // 種類
+        int lineNumber;                     // 行番号(検索パターンの場合は0)
+    } Entry;
+
+public:
+    TagsIndex();
+    ~TagsIndex();
+    bool open(const QString &tagsFileName);
+    void close();
+    bool isOpen() const { return opened; }
+    QString tagsFileName() const { return tagsFile.fileName(); }
+    QString errorString() const { return error; }
+    QVector<Entry> find(const QString &name);
+
+private:
+    bool mapTags();
+    void unmapTags();
+    bool isIndexValid() const;
+    bool build(const QString &indexFileName);
+    bool mapIndex(const QString &indexFileName);
+    QByteArray nameAt(quint32 offset) const;
+    Entry entryAt(quint32 offset) const;
+    static QString indexFileName(const QString &tagsFileName);
+
+private:
+    bool opened;
+    QFile tagsFile;
+    QFile indexFile;
+    const char *tagsData;                   // 検索中・索引の作成中のみマップする
+    qint64 tagsSize;
+    qint64 tagsModified;
+    const uchar *indexData;
+    const quint32 *offsets;
+    int count;
+    QVector<quint32> memoryOffsets;         // 索引ファイルを作成できない場合の索引
+    QString error;
+};
+
+#endif // TAGSINDEX_H
@@ -1,8 +1,8 @@
 #include "tagsmakedialog.h"
 #include "ui_tagsmakedialog.h"
+#include "tagsmaker.h"
 #include <QMenu>
 #include <QFileDialog>
-#include <QProcess>
 #include <QMessageBox>
 #include <QDesktopServices>
 
@@ -11,12 +11,17 @@ TagsMakeDialog::TagsMakeDialog(QWidget *parent) :
     ui(new Ui::TagsMakeDialog)
 {
     ui->setupUi(this);
+    ui->progressBar->hide();
+    maker = new TagsMaker(this);
 
     ui->lineEdit->setText(QDesktopServices::storageLocation(QDesktopServices::DocumentsLocation));
 
     connect(ui->pushButton_2, SIGNAL(clicked()), this, SLOT(dirSelection()));
     connect(ui->pushButton, SIGNAL(clicked()), this, SLOT(upperDirectory()));
     connect(ui->buttonBox, SIGNAL(accepted()), this, SLOT(makeTags()));
+    connect(ui->buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
+    connect(maker, SIGNAL(progress(int,int)), this, SLOT(makeProgress(int,int)));
+    connect(maker, SIGNAL(finished(bool,QString)), this, SLOT(makeFinished(bool,QString)));
 }
 
 TagsMakeDialog::~TagsMakeDialog()
@@ -46,41 +51,71 @@ void TagsMakeDialog::upperDirectory()
         ui->lineEdit->setText(dir.path());
 }
 
+/**
+ * tagsファイルの作成を開始する(作成中もダイアログは操作でき、キャンセルで中止する)
+ * 前回作成時の記録(tags.manifest)がある場合は変更されたファイルのみ作り直す
+ */
 void TagsMakeDialog::makeTags()
 {
     QDir dir(ui->lineEdit->text());
-    QProcess proc(this);
     QStringList arguments;
 
+    if (maker->isRunning()) {
+        return;
+    }
     if (!dir.exists()) {
         QMessageBox::warning(this, "", tr("対象のディレクトリが存在しません: %1").arg(dir.path()));
         return;
     }
-    if (QFile::exists(dir.path() + QDir::separator() + "tags")) {
+    if (QFile::exists(TagsMaker::tagsFileName(dir.path())) && !QFile::exists(TagsMaker::manifestFileName(dir.path()))) {
         QMessageBox::StandardButton ret;
         ret = QMessageBox::warning(this, "",
-                             tr("タグファイルはすでに存在します。:%1\n上書きしますか？").arg(dir.path() + QDir::separator() + "tags"),
+                             tr("タグファイルはすでに存在します。:%1\n上書きしますか？").arg(TagsMaker::tagsFileName(dir.path())),
                              QMessageBox::Ok | QMessageBox::Cancel);
         if (ret == QMessageBox::Cancel)
             return;
     }
 
     arguments << "-n";
-    if (ui->checkBox->isChecked())
-        arguments << "-R";
     if (ui->languageType->currentIndex())
         arguments << "--languages=" + ui->languageType->currentText();
     if (!ui->options->text().isEmpty())
-        arguments << ui->options->text();
+        arguments << TagsMaker::splitArguments(ui->options->text());
 
-    arguments << "-o " + dir.path() + QDir::separator() + "tags";
+    maker->setDirPath(dir.path());
+    maker->setRecursive(ui->checkBox->isChecked());
+    maker->setArguments(arguments);
 
-    foreach (const QString &fileName, dir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot)) {
-        arguments << dir.path() + QDir::separator() + fileName;
-    }
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+    ui->progressBar->show();
+    maker->start();
+}
 
-    proc.start("ctags", arguments);
-    if (!proc.waitForFinished()) {
+/**
+ * 作成中の場合は中止する
+ */
+void TagsMakeDialog::reject()
+{
+    if (maker->isRunning()) {
+        maker->cancel();
         return;
     }
+    QDialog::reject();
+}
+
+void TagsMakeDialog::makeProgress(int value, int maximum)
+{
+    ui->progressBar->setMaximum(maximum);
+    ui->progressBar->setValue(value);
+}
+
+void TagsMakeDialog::makeFinished(bool ok, const QString &message)
+{
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(true);
+    ui->progressBar->hide();
+    if (ok) {
+        accept();
+    } else {
+        QMessageBox::warning(this, "", message);
+    }
 }
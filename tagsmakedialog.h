@@ -6,6 +6,7 @@
 namespace Ui {
     class TagsMakeDialog;
 }
+class TagsMaker;
 
 class TagsMakeDialog : public QDialog
 {
@@ -20,9 +21,15 @@ public slots:
     void setDirPath(QString dirPath);
     void upperDirectory();
     void makeTags();
+    void reject();
+
+private slots:
+    void makeProgress(int value, int maximum);
+    void makeFinished(bool ok, const QString &message);
 
 private:
     Ui::TagsMakeDialog *ui;
+    TagsMaker *maker;
 };
 
 #endif // TAGSMAKEDIALOG_H
@@ -0,0 +1,460 @@
+#include "tagsmaker.h"
+#include "atomicfile.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QtConcurrentRun>
+#include <queue>
+#include <vector>
+
+namespace {
+
+const char MANIFEST_MAGIC[] = "!_TAGS_MANIFEST\t1";
+const char MANIFEST_ARGUMENTS[] = "!_ARGUMENTS\t";
+
+bool isCancelled(QAtomicInt *cancelled)
+{
+    return cancelled->fetchAndAddOrdered(0) != 0;
+}
+
+/* マージ中の入力(整列済みの ctags の出力) */
+typedef struct tagMergeInput {
+    QFile *file;
+    QByteArray line;
+    bool filter;                            // 変更・削除されたファイルの行を除く(前回のtagsファイル)
+} MergeInput;
+
+/**
+ * 次のタグ行を読み込む(疑似タグと除外するファイルの行は読み飛ばす)
+ */
+bool readTagLine(MergeInput &input, const QSet<QByteArray> &excludes)
+{
+    while (!input.file->atEnd()) {
+        input.line = input.file->readLine();
+        while (input.line.endsWith('\n') || input.line.endsWith('\r')) {
+            input.line.chop(1);
+        }
+        if (input.line.isEmpty() || input.line.at(0) == '!') {
+            continue;
+        }
+        if (input.filter) {
+            const int fileBegin = input.line.indexOf('\t') + 1;
+            const int fileEnd = input.line.indexOf('\t', fileBegin);
+            if (fileBegin > 0 && fileEnd > 0 && excludes.contains(input.line.mid(fileBegin, fileEnd - fileBegin))) {
+                continue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/* 行の小さい順に取り出すための比較(ctags --sort=yes と同じバイト順) */
+class MergeGreater
+{
+public:
+    explicit MergeGreater(const QVector<MergeInput> *inputs) : inputs(inputs) {}
+    bool operator()(int a, int b) const
+    {
+        return inputs->at(b).line < inputs->at(a).line;
+    }
+
+private:
+    const QVector<MergeInput> *inputs;
+};
+
+}
+
+TagsMaker::TagsMaker(QObject *parent)
+    : QObject(parent), recursive(false), jobCount(QThread::idealThreadCount()), running(false), taggedFiles(0)
+{
+    jobCount = qMax(1, jobCount);
+    connect(&scanWatcher, SIGNAL(finished()), this, SLOT(scanFinished()));
+    connect(&mergeWatcher, SIGNAL(finished()), this, SLOT(mergeFinished()));
+}
+
+TagsMaker::~TagsMaker()
+{
+    cancel();
+    scanWatcher.waitForFinished();
+    mergeWatcher.waitForFinished();
+    clear();
+}
+
+QString TagsMaker::tagsFileName(const QString &dirPath)
+{
+    return dirPath + QDir::separator() + "tags";
+}
+
+QString TagsMaker::manifestFileName(const QString &dirPath)
+{
+    return dirPath + QDir::separator() + "tags.manifest";
+}
+
+/**
+ * 入力されたオプションを引数に分割する
+ * 空白で区切り、引用符(" または ')で囲んだ部分は空白を含めて1つの引数にする。
+ * \ は引用符の前でだけエスケープとして扱う(Windowsのパス区切りはそのまま残す)。
+ */
+QStringList TagsMaker::splitArguments(const QString &text)
+{
+    QStringList result;
+    QString argument;
+    bool inArgument = false;                // 引数の途中(空の引用符も引数として数える)
+    QChar quote;                            // 囲んでいる引用符(囲んでいない場合は null)
+    for (int i = 0; i < text.size(); ++i) {
+        const QChar c = text.at(i);
+        if (c == '\\' && i + 1 < text.size() && quote != '\''
+                && (text.at(i + 1) == '"' || text.at(i + 1) == '\'')) {
+            argument += text.at(++i);
+            inArgument = true;
+        } else if (!quote.isNull()) {
+            if (c == quote) {
+                quote = QChar();
+            } else {
+                argument += c;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+            inArgument = true;
+        } else if (c.isSpace()) {
+            if (inArgument) {
+                result << argument;
+                argument.clear();
+                inArgument = false;
+            }
+        } else {
+            argument += c;
+            inArgument = true;
+        }
+    }
+    if (inArgument) {
+        result << argument;
+    }
+    return result;
+}
+
+/**
+ * 作成を開始する(対象ファイルの一覧は別スレッドで作成する)
+ */
+void TagsMaker::start()
+{
+    if (running) {
+        return;
+    }
+    running = true;
+    cancelled.fetchAndStoreOrdered(0);
+    clear();
+
+    emit progress(0, 0);
+    manifestKey = arguments;
+    if (recursive) {
+        manifestKey << "-R";
+    }
+    scanWatcher.setFuture(QtConcurrent::run(&TagsMaker::scan, dirPath, recursive, manifestKey, &cancelled));
+}
+
+void TagsMaker::cancel()
+{
+    if (!running) {
+        return;
+    }
+    cancelled.fetchAndStoreOrdered(1);
+    pendingBatches.clear();
+    foreach (QProcess *process, processes) {
+        process->disconnect(this);
+        process->kill();
+        process->waitForFinished();
+    }
+    if (!scanWatcher.isRunning() && !mergeWatcher.isRunning()) {
+        finish(false, tr("タグファイルの作成を中止しました"));
+    }
+}
+
+/**
+ * 対象ファイルの一覧を作成し、前回の記録と比較する
+ */
+TagsMaker::ScanResult TagsMaker::scan(const QString &dirPath, bool recursive, const QStringList &arguments, QAtomicInt *cancelled)
+{
+    ScanResult result;
+    result.incremental = false;
+
+    const QDir dir(dirPath);
+    const QString tagsFile = dir.absoluteFilePath("tags");
+    const QString manifestFile = dir.absoluteFilePath("tags.manifest");
+    QDirIterator it(dirPath, QDir::Files | QDir::NoDotAndDotDot,
+                    recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+    while (it.hasNext()) {
+        if (isCancelled(cancelled)) {
+            return result;
+        }
+        const QString filePath = it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.absoluteFilePath() == tagsFile || info.absoluteFilePath() == manifestFile) {
+            continue;
+        }
+        FileStat stat;
+        stat.path = dir.relativeFilePath(filePath);
+        stat.size = info.size();
+        stat.modified = info.lastModified().toMSecsSinceEpoch();
+        result.files.append(stat);
+    }
+
+    /* 前回の記録(引数が同じ場合のみ使う) */
+    QHash<QString, QPair<qint64, qint64> > previous;
+    QFile manifest(manifestFile);
+    if (QFile::exists(tagsFile) && manifest.open(QFile::ReadOnly)) {
+        const QByteArray argumentsLine = QByteArray(MANIFEST_ARGUMENTS) + QFile::encodeName(arguments.join("\t"));
+        if (manifest.readLine().trimmed() == MANIFEST_MAGIC && manifest.readLine().trimmed() == argumentsLine.trimmed()) {
+            result.incremental = true;
+            while (!manifest.atEnd()) {
+                const QList<QByteArray> fields = manifest.readLine().trimmed().split('\t');
+                if (fields.size() == 3) {
+                    previous.insert(QFile::decodeName(fields.at(2)), qMakePair(fields.at(0).toLongLong(), fields.at(1).toLongLong()));
+                }
+            }
+        }
+    }
+
+    foreach (const FileStat &stat, result.files) {
+        QHash<QString, QPair<qint64, qint64> >::iterator found = previous.find(stat.path);
+        if (found == previous.end()) {
+            result.changed.append(stat.path);
+            continue;
+        }
+        if (found.value().first != stat.size || found.value().second != stat.modified) {
+            result.changed.append(stat.path);
+        }
+        previous.erase(found);
+    }
+    result.removed = previous.keys();
+    return result;
+}
+
+void TagsMaker::scanFinished()
+{
+    scanResult = scanWatcher.result();
+    if (isCancelled(&cancelled)) {
+        finish(false, tr("タグファイルの作成を中止しました"));
+        return;
+    }
+    if (scanResult.incremental && scanResult.changed.isEmpty() && scanResult.removed.isEmpty()) {
+        finish(true, tr("タグファイルは最新です"));
+        return;
+    }
+
+    /* 実行数の数倍に分割し、空いた ctags から順に次の分割を割り当てる */
+    const QStringList &files = scanResult.changed;
+    const int batches = jobCount * TAGS_BATCHES_PER_JOB;
+    const int batchSize = qMax<int>(TAGS_MIN_BATCH_FILES, (files.size() + batches - 1) / batches);
+    for (int i = 0; i < files.size(); i += batchSize) {
+        pendingBatches.append(files.mid(i, batchSize));
+    }
+
+    taggedFiles = 0;
+    emit progress(0, files.size());
+    for (int i = 0; i < jobCount && !pendingBatches.isEmpty(); ++i) {
+        startBatch();
+    }
+    if (running && processes.isEmpty()) {
+        mergeWatcher.setFuture(QtConcurrent::run(&TagsMaker::merge, dirPath, outputs, scanResult, manifestKey, &cancelled));
+    }
+}
+
+/**
+ * 分割した1つ分のファイルを ctags で処理する(-L でファイル一覧を渡し、-f で一時ファイルへ出力する)
+ */
+void TagsMaker::startBatch()
+{
+    const QStringList batch = pendingBatches.takeFirst();
+
+    QTemporaryFile *list = new QTemporaryFile(QDir::tempPath() + QDir::separator() + "tagsmaker.XXXXXX");
+    QTemporaryFile *output = new QTemporaryFile(QDir::tempPath() + QDir::separator() + "tagsmaker.XXXXXX");
+    temporaryFiles << list << output;
+    if (!list->open() || !output->open()) {
+        finish(false, tr("一時ファイルを作成できません: %1").arg(list->errorString()));
+        return;
+    }
+    foreach (const QString &fileName, batch) {
+        list->write(QFile::encodeName(fileName));
+        list->write("\n");
+    }
+    list->close();
+    output->close();
+
+    QStringList batchArguments = arguments;
+    batchArguments << "--sort=yes" << "-f" << output->fileName() << "-L" << list->fileName();
+
+    QProcess *process = new QProcess(this);
+    process->setWorkingDirectory(dirPath);
+    process->setProperty("files", batch.size());
+    process->setProperty("output", output->fileName());
+    connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(batchFinished(int,QProcess::ExitStatus)));
+    connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(batchError(QProcess::ProcessError)));
+    processes.append(process);
+    process->start("ctags", batchArguments);
+}
+
+void TagsMaker::batchFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    processes.removeOne(process);
+    process->deleteLater();
+    if (exitStatus != QProcess::NormalExit || exitCode != 0) {
+        finish(false, tr("ctags の実行に失敗しました: %1").arg(QString::fromLocal8Bit(process->readAllStandardError())));
+        return;
+    }
+
+    outputs.append(process->property("output").toString());
+    taggedFiles += process->property("files").toInt();
+    emit progress(taggedFiles, scanResult.changed.size());
+
+    if (!pendingBatches.isEmpty()) {
+        startBatch();
+    } else if (processes.isEmpty()) {
+        emit progress(0, 0);
+        mergeWatcher.setFuture(QtConcurrent::run(&TagsMaker::merge, dirPath, outputs, scanResult, manifestKey, &cancelled));
+    }
+}
+
+void TagsMaker::batchError(QProcess::ProcessError error)
+{
+    if (error != QProcess::FailedToStart) {
+        return;     // 終了は batchFinished() で扱う
+    }
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    finish(false, tr("ctags を起動できません: %1").arg(process->errorString()));
+}
+
+/**
+ * ctags の出力と前回のtagsファイル(変更・削除されたファイルの行を除く)をマージし、記録を更新する
+ */
+QString TagsMaker::merge(const QString &dirPath, const QStringList &outputs, const ScanResult &result,
+                         const QStringList &arguments, QAtomicInt *cancelled)
+{
+    QSet<QByteArray> excludes;
+    foreach (const QString &fileName, result.changed + result.removed) {
+        excludes.insert(QFile::encodeName(fileName));
+    }
+
+    QStringList inputFiles = outputs;
+    if (result.incremental) {
+        inputFiles.append(tagsFileName(dirPath));
+    }
+    QVector<MergeInput> inputs;
+    foreach (const QString &fileName, inputFiles) {
+        MergeInput input;
+        input.file = new QFile(fileName);
+        input.filter = result.incremental && fileName == inputFiles.last();
+        if (!input.file->open(QFile::ReadOnly)) {
+            const QString error = input.file->errorString();
+            delete input.file;
+            foreach (const MergeInput &opened, inputs) {
+                delete opened.file;
+            }
+            return error;
+        }
+        inputs.append(input);
+    }
+
+    AtomicFile tags(tagsFileName(dirPath));
+    bool ok = tags.open()
+            && tags.write("!_TAG_FILE_FORMAT\t2\t/extended format; --format=1 will not append ;\" to lines/\n"
+                          "!_TAG_FILE_SORTED\t1\t/0=unsorted, 1=sorted, 2=foldcase/\n");
+
+    MergeGreater greater(&inputs);
+    std::priority_queue<int, std::vector<int>, MergeGreater> queue(greater);
+    for (int i = 0; i < inputs.size(); ++i) {
+        if (readTagLine(inputs[i], excludes)) {
+            queue.push(i);
+        }
+    }
+    QByteArray buffer;
+    int lines = 0;
+    while (ok && !queue.empty()) {
+        const int i = queue.top();
+        queue.pop();
+        buffer += inputs.at(i).line;
+        buffer += '\n';
+        if (readTagLine(inputs[i], excludes)) {
+            queue.push(i);
+        }
+        if (buffer.size() >= 1024 * 1024) {
+            ok = tags.write(buffer);
+            buffer.clear();
+        }
+        if (++lines % 4096 == 0 && isCancelled(cancelled)) {
+            ok = false;
+        }
+    }
+    foreach (const MergeInput &input, inputs) {
+        delete input.file;
+    }
+    if (ok) {
+        ok = tags.write(buffer) && tags.commit();
+    }
+    if (!ok) {
+        tags.cancel();
+        return isCancelled(cancelled) ? tr("タグファイルの作成を中止しました") : tags.errorString();
+    }
+
+    /* 記録の更新(書込みに失敗した場合は次回を全体の作り直しにする) */
+    QByteArray data = QByteArray(MANIFEST_MAGIC) + "\n"
+            + MANIFEST_ARGUMENTS + QFile::encodeName(arguments.join("\t")) + "\n";
+    foreach (const FileStat &stat, result.files) {
+        data += QByteArray::number(stat.size) + '\t' + QByteArray::number(stat.modified) + '\t'
+                + QFile::encodeName(stat.path) + '\n';
+    }
+    AtomicFile manifest(manifestFileName(dirPath));
+    if (!manifest.open() || !manifest.write(data) || !manifest.commit()) {
+        manifest.cancel();
+        QFile::remove(manifestFileName(dirPath));
+    }
+    return QString();
+}
+
+void TagsMaker::mergeFinished()
+{
+    const QString error = mergeWatcher.result();
+    if (!error.isEmpty()) {
+        finish(false, error);
+        return;
+    }
+    finish(true, tr("タグファイルを作成しました: %1 ファイル").arg(scanResult.changed.size()));
+}
+
+void TagsMaker::finish(bool ok, const QString &message)
+{
+    if (!running) {
+        return;
+    }
+    if (!ok) {
+        cancelled.fetchAndStoreOrdered(1);
+        pendingBatches.clear();
+        foreach (QProcess *process, processes) {
+            process->disconnect(this);
+            process->kill();
+            process->waitForFinished();
+        }
+    }
+    running = false;
+    clear();
+    emit finished(ok, message);
+}
+
+void TagsMaker::clear()
+{
+    foreach (QProcess *process, processes) {
+        process->deleteLater();     // シグナルの処理中に呼ばれる場合がある
+    }
+    processes.clear();
+    qDeleteAll(temporaryFiles);
+    temporaryFiles.clear();
+    outputs.clear();
+    pendingBatches.clear();
+}
@@ -0,0 +1,90 @@
+#ifndef TAGSMAKER_H
+#define TAGSMAKER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QVector>
+#include <QFutureWatcher>
+
+class QTemporaryFile;
+
+/**
+ * tagsファイルの作成
+ *
+ * 対象のファイルを複数の ctags へ分割して並列に実行し、整列済みの出力をマージして1つのtagsファイルにする。
+ * 前回作成時のファイルの更新日時・サイズを tags.manifest に記録し、変更されたファイルのみ作り直す。
+ * 処理は全て非同期に行い、progress() で進捗を、finished() で結果を通知する。
+ */
+class TagsMaker : public QObject
+{
+    Q_OBJECT
+public:
+    enum { TAGS_MIN_BATCH_FILES = 64, TAGS_BATCHES_PER_JOB = 8 };
+
+    typedef struct tagFileStat {
+        QString path;                       // 対象ディレクトリからの相対パス
+        qint64 size;
+        qint64 modified;
+    } FileStat;
+
+    typedef struct tagScanResult {
+        QVector<FileStat> files;            // 全ての対象ファイル
+        QStringList changed;                // 追加・変更されたファイル
+        QStringList removed;                // 削除されたファイル
+        bool incremental;                   // 前回のtagsファイルを更新する
+    } ScanResult;
+
+public:
+    explicit TagsMaker(QObject *parent = 0);
+    ~TagsMaker();
+    void setDirPath(const QString &dirPath) { this->dirPath = dirPath; }
+    void setRecursive(bool recursive) { this->recursive = recursive; }
+    void setArguments(const QStringList &arguments) { this->arguments = arguments; }
+    void setJobCount(int count) { jobCount = qMax(1, count); }
+    bool isRunning() const { return running; }
+    static QString tagsFileName(const QString &dirPath);
+    static QString manifestFileName(const QString &dirPath);
+    static QStringList splitArguments(const QString &text);
+
+public slots:
+    void start();
+    void cancel();
+
+signals:
+    void progress(int value, int maximum);
+    void finished(bool ok, const QString &message);
+
+private slots:
+    void scanFinished();
+    void batchFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void batchError(QProcess::ProcessError error);
+    void mergeFinished();
+
+private:
+    static ScanResult scan(const QString &dirPath, bool recursive, const QStringList &arguments, QAtomicInt *cancelled);
+    static QString merge(const QString &dirPath, const QStringList &outputs, const ScanResult &result,
+                         const QStringList &arguments, QAtomicInt *cancelled);
+    void startBatch();
+    void finish(bool ok, const QString &message);
+    void clear();
+
+private:
+    QString dirPath;
+    bool recursive;
+    QStringList arguments;
+    QStringList manifestKey;                // 記録する引数(引数が変わった場合は全体を作り直す)
+    int jobCount;
+    bool running;
+    QAtomicInt cancelled;
+    ScanResult scanResult;
+    QList<QStringList> pendingBatches;      // 未実行の分割
+    QList<QProcess *> processes;            // 実行中の ctags
+    QList<QTemporaryFile *> temporaryFiles; // ファイル一覧と ctags の出力
+    QStringList outputs;                    // 完了した ctags の出力
+    int taggedFiles;
+    QFutureWatcher<ScanResult> scanWatcher;
+    QFutureWatcher<QString> mergeWatcher;
+};
+
+#endif // TAGSMAKER_H
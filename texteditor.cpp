@@ -1,9 +1,16 @@
 #include <QtGui>
 #include "texteditor.h"
 #include "highlighter.h"
+#include "lineindex.h"
+#include "atomicfile.h"
+#include "codecdetector.h"
+#include "regexpcache.h"
 #include <QFile>
 #include <QTextStream>
 
+#define LOAD_CHUNK_SIZE     (1024 * 1024)
+#define INDEX_CHUNK_SIZE    (16 * 1024 * 1024)
+#define SAVE_BATCH_SIZE     (64 * 1024)
 
 class LineNumberArea : public QWidget
 {
@@ -72,6 +79,12 @@ TextEditor::TextEditor(QWidget *parent) :
     columnNumberArea = new ColumnNumberArea(this);
     lineNumberArea = new LineNumberArea(this);
     highlighter = new Highlighter(document());
+    lineIndex = 0;
+    viewerScrollBar = 0;
+    viewerTopLine = 0;
+    dirtyAreas = 0;
+    configBatchDepth = 0;
+    clearGlyphCache();
 
     untitled = true;
     keyControl = false;
@@ -99,6 +112,12 @@ TextEditor::TextEditor(QWidget *parent) :
     connect(this, SIGNAL(textChanged()), this, SLOT(changedCursorPosition()));
     connect(this, SIGNAL(updateRequest(QRect,int)), this, SLOT(updateArea(QRect,int)));
     connect(document(), SIGNAL(contentsChanged()), this, SLOT(documentWasModified()));
+    connect(highlighter, SIGNAL(finished()), this, SIGNAL(highlightFinished()));
+}
+
+TextEditor::~TextEditor()
+{
+    delete lineIndex;
 }
 
 void TextEditor::newFile()
@@ -124,7 +143,7 @@ bool TextEditor::openFile(const QString &filePath)
         return false;
     }
 
-    /* ファイル一部読込み(ファイル解析用) */
+    /* ファイルオープン(解析と読込みで共用) */
     if (!file.open(QFile::ReadOnly)) {
         QMessageBox::warning(this, tr("ファイル読込み"),
                              tr("ファイルを読み込めませんでした: %1\n%2.")
@@ -132,23 +151,16 @@ bool TextEditor::openFile(const QString &filePath)
                              .arg(file.errorString()));
         return false;
     }
-    QString analysis_text = QTextStream(&file).read(1000);
-    file.close();
 
-    /* 改行コード判定 */
-    if (analysis_text.indexOf("\r\n")) {
-        new_line_code = NewLineCodeCRLF;
-    } else if (analysis_text.indexOf("\n")) {
-        new_line_code = NewLineCodeLF;
-    } else if (analysis_text.indexOf("\r")) {
-        new_line_code = NewLineCodeCR;
+    /* 文字コード・改行コード判定(生のバイト列の先頭と末尾から判定する) */
+    CodecDetector::Result detected = CodecDetector::detect(file, QTextCodec::codecForName(config.defTextCodecName));
+    textCodec = detected.codec;
+    if (detected.newLineCode != NewLineCodeUnknown) {
+        new_line_code = detected.newLineCode;
     } else {
         new_line_code = config.defNewLineCode;
     }
 
-    /* 文字コード判定 */
-    textCodec = QTextCodec::codecForUtfText(analysis_text.toLatin1() ,QTextCodec::codecForName(config.defTextCodecName));
-
     /* ファイル履歴検索 */
     TextEditor::OpenedData opened_data = openedData(filePath); // カーソルの位置及び文字コードを取得
 
@@ -166,16 +178,19 @@ bool TextEditor::openFile(const QString &filePath)
                                        QMessageBox::Yes | QMessageBox::No);
         if (ret == QMessageBox::No) {
             textCodec = QTextCodec::codecForName(config.defTextCodecName);
+            if (!textCodec) {
+                textCodec = QTextCodec::codecForLocale();
+            }
         }
     }
 
     /* ファイルの読込み */
-    if (!loadFile(filePath, textCodec)) {
+    if (!loadFile(file, textCodec)) {
         return false;
     }
 
     /* カーソルの位置復元 */
-    setCursorForLineNumber(opened_data.row);
+    setCursorForPosition(opened_data.row, opened_data.column);
 
     /* 拡張子からキーを取得 */
     QString key = TextEditor::find(filePath);
@@ -211,8 +226,15 @@ bool TextEditor::saveAs()
 
 bool TextEditor::saveFile(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QFile::WriteOnly | QFile::Text)) {
+    if (lineIndex) {
+        QMessageBox::warning(this, "",
+                             tr("ビューアモードで開いたファイルは保存できません。 %1")
+                             .arg(filePath));
+        return false;
+    }
+
+    AtomicFile file(filePath);
+    if (!file.open()) {
         QMessageBox::warning(this, "",
                              tr("ファイルの書き込みに失敗しました。 %1:\n%2.")
                              .arg(filePath)
@@ -221,26 +243,51 @@ bool TextEditor::saveFile(const QString &filePath)
     }
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    QTextStream out(&file);
-    out.setCodec(textCodec);
+    bool written = writeFile(file) && file.commit();
+    QApplication::restoreOverrideCursor();
 
-    out << toPlainText();
-    /*
-    const QByteArray newLineCode = newLineCodeText();
-    QTextCursor cur = textCursor();
-    cur.movePosition(QTextCursor::Start);
-    while (!cur.atEnd()) {
-        out << qPrintable(cur.block().text()) << newLineCode;
-        cur.movePosition(QTextCursor::NextBlock);
+    if (!written) {
+        QMessageBox::warning(this, "",
+                             tr("ファイルの書き込みに失敗しました。 %1:\n%2.")
+                             .arg(filePath)
+                             .arg(file.errorString()));
+        return false;
     }
-    */
-
-    QApplication::restoreOverrideCursor();
 
     setCurrentFile(filePath);
     return true;
 }
 
+/**
+ * ブロック単位でテキストを取り出し、一定量毎にエンコードして書き込む
+ */
+bool TextEditor::writeFile(AtomicFile &file)
+{
+    QTextCodec *codec = saveCodec();
+    QTextEncoder *encoder = codec->makeEncoder(saveBomSize(codec) > 0 ? QTextCodec::DefaultConversion : QTextCodec::IgnoreHeader);
+
+    const QString newLine = QString::fromLatin1(newLineCodeText());
+    QString batch;
+    batch.reserve(SAVE_BATCH_SIZE);
+    bool written = true;
+    for (QTextBlock block = document()->begin(); written && block.isValid(); block = block.next()) {
+        batch += block.text();
+        if (block.next().isValid()) {
+            batch += newLine;
+        }
+        if (batch.size() >= SAVE_BATCH_SIZE) {
+            written = file.write(encoder->fromUnicode(batch));
+            batch.resize(0);
+        }
+    }
+    if (written && !batch.isEmpty()) {
+        written = file.write(encoder->fromUnicode(batch));
+    }
+
+    delete encoder;
+    return written;
+}
+
 bool TextEditor::maybeSave()
 {
     if (document()->isModified()) {
@@ -283,6 +330,57 @@ QString TextEditor::strippedName(const QString &fullFileName)
     return QFileInfo(fullFileName).fileName();
 }
 
+/**
+ * 保存に使う文字コード
+ */
+QTextCodec *TextEditor::saveCodec() const
+{
+    QTextCodec *codec = textCodec;
+    if (!codec) {
+        codec = QTextCodec::codecForName(config.defTextCodecName);
+    }
+    if (!codec) {
+        codec = QTextCodec::codecForLocale();
+    }
+    return codec;
+}
+
+/**
+ * 保存時に出力するBOMのバイト数
+ * BOMはUTF-8では設定に従い、バイト順指定のないUTF-16/UTF-32では常に出力する
+ */
+int TextEditor::saveBomSize(QTextCodec *codec) const
+{
+    switch (codec->mibEnum()) {
+    case 106:   // UTF-8
+        return config.useUtf8Bom ? 3 : 0;
+    case 1015:  // UTF-16
+        return 2;
+    case 1017:  // UTF-32
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * 行索引をバイト単位で作成できる文字コードか判定する
+ */
+static bool isByteOrientedCodec(QTextCodec *textCodec)
+{
+    switch (textCodec->mibEnum()) {
+    case 1013:  // UTF-16BE
+    case 1014:  // UTF-16LE
+    case 1015:  // UTF-16
+    case 1017:  // UTF-32
+    case 1018:  // UTF-32BE
+    case 1019:  // UTF-32LE
+        return false;
+    default:
+        return true;
+    }
+}
+
 bool TextEditor::loadFile(const QString &filePath, QTextCodec *textCodec)
 {
     QFile file(filePath);
@@ -304,13 +402,31 @@ bool TextEditor::loadFile(const QString &filePath, QTextCodec *textCodec)
         return false;
     }
 
-    QApplication::setOverrideCursor(Qt::WaitCursor);
+    return loadFile(file, textCodec);
+}
+
+/**
+ * 読込み用に開いたファイルからドキュメントを作成する
+ */
+bool TextEditor::loadFile(QFile &file, QTextCodec *textCodec)
+{
+    const QString filePath = file.fileName();
+
+    /* 巨大ファイルは閲覧専用のビューアモードで開く */
+    if (config.largeFileSize > 0
+            && file.size() >= static_cast<qint64>(config.largeFileSize) * 1024 * 1024
+            && isByteOrientedCodec(textCodec)) {
+        file.close();
+        return loadLargeFile(filePath, textCodec);
+    }
+
+    closeViewer();
     clear();
-    QTextStream in(&file);
-    in.setCodec(textCodec);
-    setPlainText(in.readAll());
+    bool loaded = readFile(file, textCodec);
     file.close();
-    QApplication::restoreOverrideCursor();
+    if (!loaded) {
+        return false;
+    }
 
     /* ファイル書き込み権限チェック */
     if (!QFileInfo(filePath).isWritable()) {
@@ -329,6 +445,224 @@ bool TextEditor::loadFile(const QString &filePath, QTextCodec *textCodec)
     return true;
 }
 
+/**
+ * ファイルをメモリマップし、一定サイズ毎にデコードしてドキュメントへ追記する
+ */
+bool TextEditor::readFile(QFile &file, QTextCodec *textCodec)
+{
+    const qint64 size = file.size();
+    if (size <= 0) {
+        return true;
+    }
+
+    QProgressDialog progress(tr("ファイルを読み込んでいます: %1").arg(strippedName(file.fileName())),
+                             tr("キャンセル"), 0, 1000, window());
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    /* マップできない場合(特殊ファイル等)は通常の読込みで代用する */
+    uchar *data = file.map(0, size);
+    QTextDecoder *decoder = textCodec->makeDecoder();
+    QTextCursor cursor(document());
+    QString pending;
+    QByteArray buffer;
+    qint64 pos = 0;
+    bool canceled = false;
+
+    /* 読込み中は元に戻す履歴と強調表示を止める(アウトラインなどには読込み中であることを通知する) */
+    document()->setUndoRedoEnabled(false);
+    highlighter->setSuspended(true);
+    emit loadingChanged(document(), true);
+
+    while (pos < size) {
+        const qint64 length = qMin<qint64>(LOAD_CHUNK_SIZE, size - pos);
+        QString text = pending;
+        pending.clear();
+        if (data) {
+            text += decoder->toUnicode(reinterpret_cast<const char *>(data + pos), static_cast<int>(length));
+            pos += length;
+        } else {
+            buffer = file.read(length);
+            if (buffer.isEmpty()) {
+                break;
+            }
+            text += decoder->toUnicode(buffer);
+            pos += buffer.size();
+        }
+
+        /* CR+LFがチャンク境界で分断されると空行が増えるため末尾のCRは次へ持ち越す */
+        if (pos < size && text.endsWith(QLatin1Char('\r'))) {
+            pending = QLatin1String("\r");
+            text.chop(1);
+        }
+        cursor.insertText(text);
+
+        progress.setValue(static_cast<int>(pos * 1000 / size));
+        QCoreApplication::processEvents();
+        if (progress.wasCanceled()) {
+            canceled = true;
+            break;
+        }
+    }
+    if (!canceled && !pending.isEmpty()) {
+        cursor.insertText(pending);
+    }
+
+    delete decoder;
+    if (data) {
+        file.unmap(data);
+    }
+
+    if (canceled) {
+        clear();
+    }
+    document()->setUndoRedoEnabled(true);
+    document()->setModified(false);
+    highlighter->setSuspended(false);
+    setTextCursor(QTextCursor(document()));
+    emit loadingChanged(document(), false);
+
+    return !canceled;
+}
+
+/**
+ * 行索引を作成し、表示範囲の行だけをドキュメントに展開するビューアモードで開く
+ */
+bool TextEditor::loadLargeFile(const QString &filePath, QTextCodec *textCodec)
+{
+    LineIndex *index = new LineIndex;
+    if (!index->open(filePath, new_line_code == NewLineCodeCR ? '\r' : '\n')) {
+        QMessageBox::warning(this, tr("ファイル読込み"),
+                             tr("ファイルを読み込めませんでした: %1\n%2.")
+                             .arg(filePath)
+                             .arg(index->errorString()));
+        delete index;
+        return false;
+    }
+
+    QProgressDialog progress(tr("行索引を作成しています: %1").arg(strippedName(filePath)),
+                             tr("キャンセル"), 0, 1000, window());
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+
+    while (!index->buildStep(INDEX_CHUNK_SIZE)) {
+        progress.setValue(static_cast<int>(index->scannedSize() * 1000 / index->fileSize()));
+        QCoreApplication::processEvents();
+        if (progress.wasCanceled()) {
+            delete index;
+            return false;
+        }
+    }
+
+    closeViewer();
+    lineIndex = index;
+    this->textCodec = textCodec;
+    viewerTopLine = 0;
+
+    document()->setUndoRedoEnabled(false);
+    setReadOnly(true);
+    setCenterOnScroll(false);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    if (!viewerScrollBar) {
+        viewerScrollBar = new QScrollBar(Qt::Vertical, this);
+        connect(viewerScrollBar, SIGNAL(valueChanged(int)), this, SLOT(setViewerTopLine(int)));
+    }
+    viewerScrollBar->show();
+    updateExtraArea();
+    updateViewerScrollBar();
+    viewerScrollBar->setValue(0);
+    fillViewer(0, 0);
+
+    return true;
+}
+
+/**
+ * ビューアモードを終了し通常の編集状態へ戻す
+ */
+void TextEditor::closeViewer()
+{
+    if (!lineIndex) {
+        return;
+    }
+
+    delete lineIndex;
+    lineIndex = 0;
+    viewerTopLine = 0;
+    viewerScrollBar->hide();
+    setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    setCenterOnScroll(true);
+    setReadOnly(false);
+    document()->setUndoRedoEnabled(true);
+    updateExtraArea();
+}
+
+/**
+ * 表示範囲の行を行索引から読み出してドキュメントへ展開する
+ */
+void TextEditor::fillViewer(int cursorLine, int column)
+{
+    const int pageLines = viewerLineCount();
+    const int last = qMin(lineIndex->lineCount(), viewerTopLine + pageLines + 1);
+    QString text;
+    for (int i = viewerTopLine; i < last; ++i) {
+        if (i > viewerTopLine) {
+            text += QLatin1Char('\n');
+        }
+        text += textCodec->toUnicode(lineIndex->lineData(i));
+    }
+    emit loadingChanged(document(), true);
+    setPlainText(text);
+    emit loadingChanged(document(), false);
+    document()->setModified(false);
+    setWindowModified(false);
+
+    /* 表示範囲外のカーソルは範囲の端へ寄せる */
+    const int row = qBound(0, cursorLine - viewerTopLine, qMin(pageLines, document()->blockCount()) - 1);
+    QTextCursor cursor(document()->findBlockByNumber(row));
+    cursor.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor,
+                        qMin(column, cursor.block().length() - 1));
+    setTextCursor(cursor);
+}
+
+int TextEditor::viewerLineCount()
+{
+    return qMax(1, viewport()->height() / qMax(1, fontMetrics().height()));
+}
+
+void TextEditor::updateViewerScrollBar()
+{
+    if (!lineIndex) {
+        return;
+    }
+
+    const int pageLines = viewerLineCount();
+    viewerScrollBar->setRange(0, qMax(0, lineIndex->lineCount() - pageLines));
+    viewerScrollBar->setSingleStep(1);
+    viewerScrollBar->setPageStep(pageLines);
+}
+
+void TextEditor::updateViewerGeometry()
+{
+    if (!lineIndex) {
+        return;
+    }
+
+    const QRect &vr = viewport()->geometry();
+    viewerScrollBar->setGeometry(QRect(vr.right() + 1, vr.top(), viewerScrollBar->sizeHint().width(), vr.height()));
+}
+
+void TextEditor::setViewerTopLine(int line)
+{
+    if (!lineIndex) {
+        return;
+    }
+
+    const int cursorLine = viewerTopLine + textCursor().blockNumber();
+    const int column = textCursor().positionInBlock();
+    viewerTopLine = qBound(0, line, viewerScrollBar->maximum());
+    fillViewer(cursorLine, column);
+}
+
 TextEditor::OpenedData TextEditor::openedData(QString /*filePath*/)
 {
     TextEditor::OpenedData opened_data = { "System", 0, 0 };
@@ -337,18 +671,218 @@ TextEditor::OpenedData TextEditor::openedData(QString /*filePath*/)
 
 void TextEditor::setCursorForLineNumber(int line)
 {
-    //QTextBlock anchorBlock = document()->findBlockByNumber(line);
-    QTextCursor cursor(document());
-    cursor.movePosition(QTextCursor::Start);
-    for (int i = 1; i < line; ++i) {
-        cursor.movePosition(QTextCursor::Down);
+    setCursorForPosition(line, 0);
+}
+
+/**
+ * 指定行(1始まり)・指定列(行頭からの文字数)にカーソルを移動する
+ * 行は折返しに関係なくブロック単位で数え、範囲外の場合は先頭・末尾に丸める
+ */
+void TextEditor::setCursorForPosition(int line, int column)
+{
+    QTextBlock block;
+    if (lineIndex) {
+        const int target = qBound(0, line - 1, lineIndex->lineCount() - 1);
+        viewerScrollBar->setValue(target - viewerLineCount() / 2);
+        block = document()->findBlockByNumber(target - viewerTopLine);
+    } else {
+        block = document()->findBlockByNumber(qBound(0, line - 1, document()->blockCount() - 1));
     }
+    if (!block.isValid()) {
+        return;
+    }
+
+    QTextCursor cursor(block);
+    cursor.setPosition(block.position() + qBound(0, column, block.length() - 1));
     setTextCursor(cursor);
 }
 
+/**
+ * ファイル先頭からのバイト位置にカーソルを移動する(BOMの途中は先頭とみなす)
+ * ビューアモードでは行索引から行を求め、行内のバイト数だけをデコードして列を求める
+ * 編集中はブロック毎に保存時の文字コードでエンコードした長さを積算する(保存した場合のバイト位置)
+ */
+void TextEditor::setCursorForOffset(qint64 offset)
+{
+    if (lineIndex) {
+        /* ビューアモードはバイト単位の文字コードのみのため、BOMはUTF-8のものだけを考える */
+        const int line = lineIndex->lineForOffset(offset);
+        const QByteArray data = lineIndex->lineData(line);
+        int length = static_cast<int>(qBound<qint64>(0, offset - lineIndex->lineOffset(line), data.size()));
+        if (line == 0 && data.startsWith("\xEF\xBB\xBF") && length < 3) {
+            length = 0;
+        }
+        setCursorForPosition(line + 1, textCodec->toUnicode(data.left(length)).length());
+        return;
+    }
+
+    QTextCodec *codec = saveCodec();
+    QScopedPointer<QTextEncoder> encoder(codec->makeEncoder(QTextCodec::IgnoreHeader));
+    const int newLineSize = encoder->fromUnicode(QString::fromLatin1(newLineCodeText())).size();
+    qint64 begin = saveBomSize(codec);
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        const QByteArray data = encoder->fromUnicode(block.text());
+        if (offset < begin + data.size() + newLineSize || !block.next().isValid()) {
+            const int column = codec->toUnicode(data.left(static_cast<int>(qMax<qint64>(0, offset - begin)))).length();
+            setCursorForPosition(block.blockNumber() + 1, column);
+            return;
+        }
+        begin += data.size() + newLineSize;
+    }
+}
+
+/* 置換する範囲 */
+typedef struct tagReplacement {
+    int position;
+    int length;
+    QString text;
+} Replacement;
+
+/**
+ * 文書の範囲内で一致する文字列を数える(replacements を指定した場合は置換する範囲も求める)
+ */
+static int collectReplacements(const QTextDocument *document, QRegExp &regexp, const QString &after, bool regularExpression,
+                               int rangeBegin, int rangeEnd, QVector<Replacement> *replacements)
+{
+    int count = 0;
+    const QTextBlock last = document->findBlock(rangeEnd);
+    for (QTextBlock block = document->findBlock(rangeBegin); block.isValid(); block = block.next()) {
+        const QString text = block.text();
+        const int blockPosition = block.position();
+        int offset = qMax(0, rangeBegin - blockPosition);
+        while (offset <= text.size()) {
+            const int index = regexp.indexIn(text, offset);
+            if (index < 0) {
+                break;
+            }
+            const int length = regexp.matchedLength();
+            if (blockPosition + index + length > rangeEnd) {
+                break;
+            }
+            if (replacements) {
+                Replacement replacement;
+                replacement.position = blockPosition + index;
+                replacement.length = length;
+                replacement.text = TextEditor::replacementText(regexp, after, regularExpression);
+                replacements->append(replacement);
+            }
+            ++count;
+            offset = index + qMax(1, length);
+        }
+        if (block == last) {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * 一致する文字列を全て置換し、置換した数を返す(パターンを使用できない場合は-1)
+ * ブロックのテキストを1回走査して一致範囲を全て求めてから、後ろから順に1つの編集ブロック内で置き換える
+ * (元に戻すは1回で済み、レイアウトの更新も編集ブロックの終了時の1回になる)
+ */
+int TextEditor::replaceAll(const QString &before, const QString &after, const KeywordOption &option, bool inSelection)
+{
+    bool rejected = false;
+    QRegExp regexp = RegExpCache::regExp(before, option, &rejected);
+    if (rejected) {
+        return -1;
+    }
+    if (before.isEmpty() || isReadOnly()) {
+        return 0;
+    }
+
+    QTextCursor cursor = textCursor();
+    const int rangeBegin = inSelection ? cursor.selectionStart() : 0;
+    const int rangeEnd = inSelection ? cursor.selectionEnd() : document()->characterCount() - 1;
+
+    QVector<Replacement> replacements;
+    collectReplacements(document(), regexp, after, option.regularExpression, rangeBegin, rangeEnd, &replacements);
+    if (replacements.isEmpty()) {
+        return 0;
+    }
+
+    /* 置換後のカーソル位置(選択範囲内の場合は置換後の範囲を選択する) */
+    int delta = 0;
+    int cursorDelta = 0;
+    foreach (const Replacement &replacement, replacements) {
+        delta += replacement.text.size() - replacement.length;
+        if (replacement.position + replacement.length <= cursor.position()) {
+            cursorDelta += replacement.text.size() - replacement.length;
+        }
+    }
+
+    QTextCursor editCursor(document());
+    editCursor.beginEditBlock();
+    for (int i = replacements.size() - 1; i >= 0; --i) {
+        const Replacement &replacement = replacements.at(i);
+        editCursor.setPosition(replacement.position);
+        editCursor.setPosition(replacement.position + replacement.length, QTextCursor::KeepAnchor);
+        editCursor.insertText(replacement.text);
+    }
+    editCursor.endEditBlock();
+
+    if (inSelection) {
+        cursor.setPosition(rangeBegin);
+        cursor.setPosition(rangeEnd + delta, QTextCursor::KeepAnchor);
+    } else {
+        cursor.setPosition(qBound(0, cursor.position() + cursorDelta, document()->characterCount() - 1));
+    }
+    setTextCursor(cursor);
+
+    return replacements.size();
+}
+
+/**
+ * 文書全体で一致する文字列の数を返す(パターンを使用できない場合は-1)
+ */
+int TextEditor::countMatches(const QString &before, const KeywordOption &option) const
+{
+    bool rejected = false;
+    QRegExp regexp = RegExpCache::regExp(before, option, &rejected);
+    if (rejected) {
+        return -1;
+    }
+    if (before.isEmpty()) {
+        return 0;
+    }
+    return collectReplacements(document(), regexp, QString(), false, 0, document()->characterCount() - 1, 0);
+}
+
+/**
+ * 置換後の文字列(正規表現の場合は \1〜\9 を一致したグループに、\\ を \ に置き換える)
+ */
+QString TextEditor::replacementText(const QRegExp &regexp, const QString &after, bool regularExpression)
+{
+    if (!regularExpression || !after.contains(QLatin1Char('\\'))) {
+        return after;
+    }
+
+    QString text;
+    text.reserve(after.size());
+    for (int i = 0; i < after.size(); ++i) {
+        const QChar c = after.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < after.size()) {
+            const QChar next = after.at(i + 1);
+            if (next >= QLatin1Char('0') && next <= QLatin1Char('9')) {
+                text += regexp.cap(next.digitValue());
+                ++i;
+                continue;
+            }
+            if (next == QLatin1Char('\\')) {
+                text += next;
+                ++i;
+                continue;
+            }
+        }
+        text += c;
+    }
+    return text;
+}
+
 int TextEditor::cursorForLineNumber() const
 {
-    return textCursor().blockNumber() + 1;
+    return viewerTopLine + textCursor().blockNumber() + 1;
 }
 
 int TextEditor::cursorForColumnNumber() const
@@ -418,13 +952,27 @@ const QByteArray TextEditor::newLineCodeText()
 
 QVector<int> TextEditor::findwordMatchLines(int index) const
 {
-    return highlighter->findwordMatchLines(index);
+    QVector<int> lines = highlighter->findwordMatchLines(index);
+    if (viewerTopLine) {
+        for (int i = 0; i < lines.size(); ++i) {
+            lines[i] += viewerTopLine;
+        }
+    }
+    return lines;
 }
 
 int TextEditor::findwordsCount(int index) const
 {
     return highlighter->findwordCount(index);
 }
+
+/**
+ * 検索文字列の一致数・一致行が確定しているか(背景での強調処理が完了しているか)
+ */
+bool TextEditor::isHighlightFinished() const
+{
+    return highlighter->isFinished();
+}
 void TextEditor::updateConfig(const int &index)
 {
     // 設定値取得
@@ -441,6 +989,8 @@ void TextEditor::updateConfig(const QString &key)
 
 void TextEditor::updateConfig()
 {
+    /* 設定の反映中は再描画要求をまとめ、最後に領域毎に1回だけ発行する */
+    ++configBatchDepth;
     setFontFamily(config.fontFamily);
     setFontPointSizeF(config.fontPointSizeF);
     setZoom(config.zoom);
@@ -465,6 +1015,46 @@ void TextEditor::updateConfig()
     setSelectionFormat(config.selectionFormat);
     setKeywords(config.keywords);
     setBlockwords(config.blockwords);
+    --configBatchDepth;
+    flushInvalidation();
+}
+
+/**
+ * 再描画が必要な領域を記録する(設定の反映中でなければすぐに再描画を要求する)
+ * overlay は現在行・現在列の強調のように表示領域の一部だけを描き直す場合に使い、rect で範囲を指定する
+ */
+void TextEditor::invalidate(int areas, const QRect &rect)
+{
+    dirtyAreas |= areas;
+    if (areas & DirtyOverlay) {
+        dirtyOverlayRegion += rect;
+    }
+    flushInvalidation();
+}
+
+/**
+ * 記録した領域毎に1回だけ再描画を要求する
+ */
+void TextEditor::flushInvalidation()
+{
+    if (configBatchDepth > 0 || dirtyAreas == 0) {
+        return;
+    }
+
+    if (dirtyAreas & DirtyGutter) {
+        lineNumberArea->update();
+    }
+    if (dirtyAreas & DirtyRuler) {
+        columnNumberArea->update();
+    }
+    if (dirtyAreas & DirtyViewport) {
+        viewport()->update();   // 表示領域全体を描き直すので部分的な領域は不要
+    } else if (dirtyAreas & DirtyOverlay) {
+        viewport()->update(dirtyOverlayRegion);
+    }
+
+    dirtyAreas = 0;
+    dirtyOverlayRegion = QRegion();
 }
 
 void TextEditor::setFontFamily(const QString &family)
@@ -472,6 +1062,7 @@ void TextEditor::setFontFamily(const QString &family)
     QFont f = font();
     f.setFamily(family);
     setFont(f);
+    clearGlyphCache();
     setTabStopDigits(config.tabStopDigits);
 }
 
@@ -481,13 +1072,14 @@ void TextEditor::setFontPointSizeF(double sizeF)
     QFont f = font();
     f.setPointSizeF(sizeF * config.zoom);
     setFont(f);
+    clearGlyphCache();
     setTabStopDigits(config.tabStopDigits);
 }
 
 void TextEditor::setZoom(double zoom)
 {
     config.zoom = zoom;
-    setFontPointSizeF(config.fontPointSizeF);
+    setFontPointSizeF(config.fontPointSizeF);   // 記号・数字の画像も破棄される
 }
 
 void TextEditor::setLineNumberVisible(bool visible)
@@ -506,8 +1098,7 @@ void TextEditor::setColumnNumberVisible(bool visible)
 void TextEditor::setTabVisible(bool visible)
 {
     config.tabVisibleFormat.enabled = visible;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setTabStopDigits(int digits)
@@ -519,64 +1110,55 @@ void TextEditor::setTabStopDigits(int digits)
 void TextEditor::setTabChar(const QString &text)
 {
     config.tabChar = text;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setHalfSpaceVisible(bool visible)
 {
     config.halfSpaceVisibleFormat.enabled = visible;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setHalfSpaceChar(const QString &text)
 {
     config.halfSpaceChar = text;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setFullSpaceVisible(bool visible)
 {
     config.fullSpaceVisibleFormat.enabled = visible;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setFullSpaceChar(const QString &text)
 {
     config.fullSpaceChar = text;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfLineVisible(bool visible)
 {
     config.endOfLineFormat.enabled = visible;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfLineChar(const QString &text)
 {
     config.endOfLineChar = text;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfFileVisible(bool visible)
 {
     config.endOfFileFormat.enabled = visible;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfFileChar(const QString &text)
 {
     config.endOfFileChar = text;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setBasicFormat(const TextFormat &format)
@@ -593,36 +1175,37 @@ void TextEditor::setBasicFormat(const TextFormat &format)
 void TextEditor::setStripeFormat(const TextFormat &format)
 {
     config.stripeFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setLineNumberFormat(const TextFormat &format)
 {
     config.lineNumberFormat = format;
-    columnNumberArea->repaint();
-    lineNumberArea->repaint();
+    clearGlyphCache();
+    invalidate(DirtyGutter | DirtyRuler);
     updateExtraArea();
 }
 
 void TextEditor::setLineNumberCurrentFormat(const TextFormat &format)
 {
     config.lineNumberCurrentFormat = format;
-    lineNumberArea->repaint();
+    clearGlyphCache();
+    invalidate(DirtyGutter);
 }
 
 void TextEditor::setColumnNumberFormat(const TextFormat &format)
 {
     config.columnNumberFormat = format;
-    columnNumberArea->repaint();
-    lineNumberArea->repaint();
+    clearGlyphCache();
+    invalidate(DirtyGutter | DirtyRuler);
     updateExtraArea();
 }
 
 void TextEditor::setColumnNumberCurrentFormat(const TextFormat &format)
 {
     config.columnNumberCurrentFormat = format;
-    columnNumberArea->repaint();
+    clearGlyphCache();
+    invalidate(DirtyRuler);
 }
 
 void TextEditor::setHighlightFormat(const int index, const TextFormat &format)
@@ -652,36 +1235,36 @@ void TextEditor::setFindFormats(const QList<QVariant> &formats)
 void TextEditor::setHalfSpaceVisibleFormat(const TextFormat &format)
 {
     config.halfSpaceVisibleFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    clearGlyphCache();
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setFullSpaceVisibleFormat(const TextFormat &format)
 {
     config.fullSpaceVisibleFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    clearGlyphCache();
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setTabVisibleFormat(const TextFormat &format)
 {
     config.tabVisibleFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    clearGlyphCache();
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfLineFormat(const TextFormat &format)
 {
     config.endOfLineFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    clearGlyphCache();
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setEndOfFileFormat(const TextFormat &format)
 {
     config.endOfFileFormat = format;
-    setUpdatesEnabled(false);
-    setUpdatesEnabled(true);
+    clearGlyphCache();
+    invalidate(DirtyViewport);
 }
 
 void TextEditor::setCurrentLineFormat(const TextFormat &format)
@@ -690,7 +1273,7 @@ void TextEditor::setCurrentLineFormat(const TextFormat &format)
     QRect cursor_rect = oldCursorRect;
     cursor_rect.setLeft(0);
     cursor_rect.setWidth(width());
-    viewport()->update(cursor_rect);
+    invalidate(DirtyOverlay, cursor_rect);
 }
 
 void TextEditor::setCurrentColumnFormat(const TextFormat &format)
@@ -699,7 +1282,7 @@ void TextEditor::setCurrentColumnFormat(const TextFormat &format)
     QRect cursor_rect = oldCursorRect;
     cursor_rect.setTop(0);
     cursor_rect.setHeight(height());
-    viewport()->update(cursor_rect);
+    invalidate(DirtyOverlay, cursor_rect);
 }
 
 void TextEditor::setSelectionFormat(const TextFormat &format)
@@ -732,7 +1315,9 @@ void TextEditor::setFindword(int index, const TextEditor::KeywordData &data)
 
 void TextEditor::setFindwords(const TextEditor::KeywordData finds[])
 {
-    memcpy(findwords, finds, sizeof(findwords));
+    for (int i = 0; i < 10; ++i) {
+        findwords[i] = finds[i];
+    }
     highlighter->updateFindwords(findwords);
 }
 
@@ -743,7 +1328,9 @@ void TextEditor::documentWasModified()
 
 void TextEditor::updateExtraArea()
 {
-    setViewportMargins(lineNumberAreaWidth(), columnNumberAreaHeight(), 0, 0);
+    const int scrollBarWidth = lineIndex ? viewerScrollBar->sizeHint().width() : 0;
+    setViewportMargins(lineNumberAreaWidth(), columnNumberAreaHeight(), scrollBarWidth, 0);
+    updateViewerGeometry();
 }
 
 void TextEditor::changedCursorPosition()
@@ -817,11 +1404,22 @@ void TextEditor::updateColumnNumberArea(const QRect &rect, int)
 void TextEditor::updateArea(const QRect &rect, int)
 {
     viewport()->update(rect);
+    updateHighlightViewport();
 
     if (rect.contains(viewport()->rect()))
         changedCursorPosition();
 }
 
+/**
+ * 表示中のブロック範囲を強調処理に通知する(表示範囲を優先して強調するため)
+ */
+void TextEditor::updateHighlightViewport()
+{
+    const int first = firstVisibleBlock().blockNumber();
+    const int lines = viewport()->height() / qMax(1, fontMetrics().height());
+    highlighter->setVisibleBlocks(first, first + lines + 1);
+}
+
 void TextEditor::closeEvent(QCloseEvent *event)
 {
     if (maybeSave()) {
@@ -911,6 +1509,38 @@ void TextEditor::keyPressEvent(QKeyEvent *event)
         }
     }
 
+    /* ビューアモードでは表示範囲の端でスクロールさせる */
+    if (lineIndex) {
+        const int row = textCursor().blockNumber();
+        if (event->key() == Qt::Key_Up && row == 0) {
+            viewerScrollBar->setValue(viewerScrollBar->value() - 1);
+            moveCursor(QTextCursor::Up);
+            event->accept();
+            return;
+        } else if (event->key() == Qt::Key_Down && row >= viewerLineCount() - 1) {
+            viewerScrollBar->setValue(viewerScrollBar->value() + 1);
+            moveCursor(QTextCursor::Down);
+            event->accept();
+            return;
+        } else if (event->key() == Qt::Key_PageUp) {
+            viewerScrollBar->triggerAction(QAbstractSlider::SliderPageStepSub);
+            event->accept();
+            return;
+        } else if (event->key() == Qt::Key_PageDown) {
+            viewerScrollBar->triggerAction(QAbstractSlider::SliderPageStepAdd);
+            event->accept();
+            return;
+        } else if (event == QKeySequence::MoveToStartOfDocument) {
+            setCursorForLineNumber(1);
+            event->accept();
+            return;
+        } else if (event == QKeySequence::MoveToEndOfDocument) {
+            setCursorForLineNumber(lineIndex->lineCount());
+            event->accept();
+            return;
+        }
+    }
+
     QPlainTextEdit::keyPressEvent(event);
 }
 
@@ -921,6 +1551,12 @@ void TextEditor::resizeEvent(QResizeEvent *e)
     const QRect &cr = contentsRect();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
     columnNumberArea->setGeometry(QRect(cr.left(), cr.top(), cr.width(), columnNumberAreaHeight()));
+
+    if (lineIndex) {
+        updateViewerGeometry();
+        updateViewerScrollBar();
+        setViewerTopLine(viewerScrollBar->value());
+    }
 }
 
 void TextEditor::scrollContentsBy(int dx, int dy)
@@ -938,9 +1574,10 @@ void TextEditor::paintEvent(QPaintEvent *event)
     QTextBlock block = firstVisibleBlock();
     int top = (int) blockBoundingGeometry(block).translated(offset).top();
     int bottom = top + (int) blockBoundingRect(block).height();
-    QTextCursor eof_cur = textCursor();
-    eof_cur.movePosition(QTextCursor::End);
-    const int eof = eof_cur.position();
+    QVector<int> halfSpaces;
+    QVector<int> fullSpaces;
+    QVector<int> tabs;
+    QVector<int> endOfLine(1);
 
     painter.setBrushOrigin(offset);
     painter.setClipRect(event->rect());
@@ -959,64 +1596,58 @@ void TextEditor::paintEvent(QPaintEvent *event)
                 if (selected)
                     painter.fillRect(blockBoundingRect(block).translated(0, top), config.currentLineFormat.background);
             }
-            // 改行
-            QTextCursor eol_cur(block);
-            eol_cur.movePosition(QTextCursor::EndOfBlock);
-            if (config.endOfLineFormat.enabled && eol_cur.position() != eof) {
-                QRect r = cursorRect(eol_cur);
-                QRectF bounding = painter.boundingRect(QRectF(r), config.endOfLineChar);
-                painter.fillRect(bounding, config.endOfLineFormat.background);
-                painter.setPen(config.endOfLineFormat.foreground);
-                painter.drawText(bounding, config.endOfLineChar);
-            }
 
-            // 特殊文字
-            QTextCursor search_char_cur(block);
-            search_char_cur.movePosition(QTextCursor::StartOfBlock);
-            do {
-                QChar c = document()->characterAt(search_char_cur.position());
-                // 半角空白
-                if (config.halfSpaceVisibleFormat.enabled && c == ' ') {
-                    QRect r = cursorRect(search_char_cur);
-                    QRectF bounding = painter.boundingRect(QRectF(r), config.halfSpaceChar);
-                    painter.fillRect(bounding, config.halfSpaceVisibleFormat.background);
-                    painter.setPen(config.halfSpaceVisibleFormat.foreground);
-                    painter.drawText(bounding, config.halfSpaceChar);
-                }
-                // 全角空白
-                if (config.fullSpaceVisibleFormat.enabled && c.unicode() == 12288) {
-                    QRect r = cursorRect(search_char_cur);
-                    QRectF bounding = painter.boundingRect(QRectF(r), config.fullSpaceChar);
-                    painter.fillRect(bounding, config.fullSpaceVisibleFormat.background);
-                    painter.setPen(config.fullSpaceVisibleFormat.foreground);
-                    painter.drawText(bounding, config.fullSpaceChar);
-                }
-                // タブ
-                if (config.tabVisibleFormat.enabled && c == '\t') {
-                    QRect r = cursorRect(search_char_cur);
-                    QRectF bounding = painter.boundingRect(QRectF(r), config.tabChar);
-                    painter.fillRect(bounding, config.tabVisibleFormat.background);
-                    painter.setPen(config.tabVisibleFormat.foreground);
-                    painter.drawText(bounding, config.tabChar);
+            // 特殊文字(行の文字列を1回だけ走査し、種類毎に位置を集める)
+            const QString text = block.text();
+            const QChar *chars = text.constData();
+            halfSpaces.clear();
+            fullSpaces.clear();
+            tabs.clear();
+            for (int i = 0; i < text.size(); ++i) {
+                switch (chars[i].unicode()) {
+                case ' ':
+                    halfSpaces.append(i);
+                    break;
+                case 0x3000:
+                    fullSpaces.append(i);
+                    break;
+                case '\t':
+                    tabs.append(i);
+                    break;
+                default:
+                    break;
                 }
-                search_char_cur.movePosition(QTextCursor::NextCharacter);
-            } while (!search_char_cur.atBlockEnd());
+            }
+
+            const QTextLayout *layout = block.layout();
+            const QPointF origin = QPointF(offset.x(), top) + layout->position();
+            if (config.halfSpaceVisibleFormat.enabled) {
+                drawMarkers(painter, layout, origin, halfSpaces, config.halfSpaceChar, config.halfSpaceVisibleFormat);
+            }
+            if (config.fullSpaceVisibleFormat.enabled) {
+                drawMarkers(painter, layout, origin, fullSpaces, config.fullSpaceChar, config.fullSpaceVisibleFormat);
+            }
+            if (config.tabVisibleFormat.enabled) {
+                drawMarkers(painter, layout, origin, tabs, config.tabChar, config.tabVisibleFormat);
+            }
 
+            // 改行・EOF(ビューアモードでは展開した範囲の最終行ではなく、ファイルの最終行かで判定する)
+            endOfLine[0] = text.size();
+            const bool hasNextLine = lineIndex ? viewerTopLine + block.blockNumber() + 1 < lineIndex->lineCount()
+                                               : block.next().isValid();
+            if (hasNextLine) {
+                if (config.endOfLineFormat.enabled) {
+                    drawMarkers(painter, layout, origin, endOfLine, config.endOfLineChar, config.endOfLineFormat);
+                }
+            } else if (config.endOfFileFormat.enabled) {
+                drawMarkers(painter, layout, origin, endOfLine, config.endOfFileChar, config.endOfFileFormat);
+            }
         }
         block = block.next();
         top = bottom;
         bottom = top + (int)blockBoundingRect(block).height();
     }
 
-    // EOF
-    if (config.endOfFileFormat.enabled) {
-        QRect r = cursorRect(eof_cur);
-        QRectF bounding = painter.boundingRect(QRectF(r), config.endOfFileChar);
-        painter.fillRect(bounding, config.endOfFileFormat.background);
-        painter.setPen(config.endOfFileFormat.foreground);
-        painter.drawText(bounding, config.endOfFileChar);
-    }
-
     QPlainTextEdit::paintEvent(event);
 
     QPainter painter2(viewport());
@@ -1033,11 +1664,129 @@ void TextEditor::paintEvent(QPaintEvent *event)
     }
 }
 
+/**
+ * 1行分の同じ種類の記号をまとめて描画する
+ * 位置はブロックのレイアウトから求め、描画済みの記号の画像を1回の呼出しで転送する
+ */
+void TextEditor::drawMarkers(QPainter &painter, const QTextLayout *layout, const QPointF &origin,
+                             const QVector<int> &positions, const QString &marker, const TextFormat &format)
+{
+    if (positions.isEmpty()) {
+        return;
+    }
+
+    const QPixmap pixmap = glyphPixmap(marker, format.foreground, format.background);
+    const QRectF source = pixmap.rect();
+    QVector<QPainter::PixmapFragment> fragments;
+    fragments.reserve(positions.size());
+    foreach (int position, positions) {
+        const QTextLine line = layout->lineForTextPosition(position);
+        if (!line.isValid()) {
+            continue;
+        }
+        const QPointF center(origin.x() + line.cursorToX(position) + source.width() / 2,
+                             origin.y() + line.y() + source.height() / 2);
+        fragments.append(QPainter::PixmapFragment::create(center, source));
+    }
+    painter.drawPixmapFragments(fragments.constData(), fragments.size(), pixmap);
+}
+
+/**
+ * 文字列を描画した画像を返す(フォント・倍率の変更時と書式の変更時に破棄する)
+ */
+QPixmap TextEditor::glyphPixmap(const QString &text, const QColor &foreground, const QColor &background)
+{
+    const QString key = QString("%1:%2:%3").arg(foreground.rgba(), 0, 16).arg(background.rgba(), 0, 16).arg(text);
+    QHash<QString, QPixmap>::const_iterator it = glyphCache.constFind(key);
+    if (it != glyphCache.constEnd()) {
+        return it.value();
+    }
+
+    const QFontMetrics metrics(font());
+    QPixmap pixmap(qMax(1, metrics.width(text)), qMax(1, metrics.height()));
+    pixmap.fill(background);
+    QPainter painter(&pixmap);
+    painter.setFont(font());
+    painter.setPen(foreground);
+    painter.drawText(0, metrics.ascent(), text);
+    painter.end();
+
+    glyphCache.insert(key, pixmap);
+    return pixmap;
+}
+
+/**
+ * 0から9の数字を等間隔(digitCellWidth毎)に並べて描画した画像を返す
+ */
+QPixmap TextEditor::digitAtlas(const QColor &foreground, const QColor &background)
+{
+    const QString key = QString("%1:%2:digits").arg(foreground.rgba(), 0, 16).arg(background.rgba(), 0, 16);
+    QHash<QString, QPixmap>::const_iterator it = glyphCache.constFind(key);
+    if (it != glyphCache.constEnd()) {
+        return it.value();
+    }
+
+    const QFontMetrics metrics(font());
+    QPixmap pixmap(digitCellWidth * 10, qMax(1, metrics.height()));
+    pixmap.fill(background);
+    QPainter painter(&pixmap);
+    painter.setFont(font());
+    painter.setPen(foreground);
+    for (int digit = 0; digit < 10; ++digit) {
+        painter.drawText(digit * digitCellWidth, metrics.ascent(), QString(QLatin1Char('0' + digit)));
+    }
+    painter.end();
+
+    glyphCache.insert(key, pixmap);
+    return pixmap;
+}
+
+/**
+ * 数字の描画断片(数字の画像からの切出し位置と描画位置)を右端から順に追加する
+ */
+void TextEditor::appendDigitFragments(QVector<QPainter::PixmapFragment> &fragments, int number, qreal right, qreal top)
+{
+    const qreal height = QFontMetrics(font()).height();
+    do {
+        const int digit = number % 10;
+        right -= digitWidths[digit];
+        fragments.append(QPainter::PixmapFragment::create(QPointF(right + digitWidths[digit] / 2.0, top + height / 2),
+                                                          QRectF(digit * digitCellWidth, 0, digitWidths[digit], height)));
+        number /= 10;
+    } while (number > 0);
+}
+
+int TextEditor::digitsWidth(int number) const
+{
+    int width = 0;
+    do {
+        width += digitWidths[number % 10];
+        number /= 10;
+    } while (number > 0);
+    return width;
+}
+
+void TextEditor::clearGlyphCache()
+{
+    glyphCache.clear();
+
+    const QFontMetrics metrics(font());
+    digitCellWidth = 1;
+    for (int digit = 0; digit < 10; ++digit) {
+        digitWidths[digit] = metrics.width(QLatin1Char('0' + digit));
+        digitCellWidth = qMax(digitCellWidth, digitWidths[digit]);
+    }
+}
+
 void TextEditor::wheelEvent(QWheelEvent *event)
 {
     QCoreApplication::sendEvent(parent(), event);
     if (event->isAccepted()) {
-        QPlainTextEdit::wheelEvent(event);
+        if (lineIndex) {
+            QCoreApplication::sendEvent(viewerScrollBar, event);
+        } else {
+            QPlainTextEdit::wheelEvent(event);
+        }
     }
 }
 
@@ -1046,7 +1795,7 @@ int TextEditor::lineNumberAreaWidth()
     if (!config.lineNumberFormat.enabled) return 0;
 
     int digits = 1;
-    int max = qMax(10, blockCount());
+    int max = qMax(10, lineIndex ? lineIndex->lineCount() : blockCount());
     while (max >= 10) {
         max /= 10;
         ++digits;
@@ -1065,7 +1814,7 @@ void TextEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
     painter.fillRect(event->rect(), config.lineNumberFormat.background);
 
     QTextBlock block = firstVisibleBlock();
-    int blockNumber = block.blockNumber();
+    int blockNumber = viewerTopLine + block.blockNumber();
     const int width = lineNumberArea->width() - 15;
     const int height = (int)blockBoundingRect(block).height();
     const int selStart = textCursor().selectionStart();
@@ -1073,21 +1822,20 @@ void TextEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
     int top = (int)blockBoundingGeometry(block).translated(offset).top();
     int bottom = top + height;
 
-    painter.setPen(config.lineNumberFormat.foreground);
+    /* 行番号は数字の画像から切り出し、色毎にまとめて描画する */
+    QVector<QPainter::PixmapFragment> numbers;
+    QVector<QPainter::PixmapFragment> currentNumbers;
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
             // 行番号描画
-            const QString &number = QString::number(blockNumber + 1);
             bool selected = config.lineNumberCurrentFormat.enabled && ((selStart < block.position() + block.length() && selEnd > block.position())
                              || (selStart == selEnd && selStart == block.position()));
             if(selected) {
-                painter.save();
                 painter.fillRect(blockBoundingRect(block).translated(0, top), config.lineNumberCurrentFormat.background);
-                painter.setPen(config.lineNumberCurrentFormat.foreground);
+                appendDigitFragments(currentNumbers, blockNumber + 1, width, top);
+            } else {
+                appendDigitFragments(numbers, blockNumber + 1, width, top);
             }
-            painter.drawText(0, top, width, height, Qt::AlignRight, number);
-            if (selected)
-                painter.restore();
         }
 
         block = block.next();
@@ -1095,6 +1843,15 @@ void TextEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
         bottom = top + height;
         ++blockNumber;
     }
+
+    if (!numbers.isEmpty()) {
+        painter.drawPixmapFragments(numbers.constData(), numbers.size(),
+                                    digitAtlas(config.lineNumberFormat.foreground, Qt::transparent));
+    }
+    if (!currentNumbers.isEmpty()) {
+        painter.drawPixmapFragments(currentNumbers.constData(), currentNumbers.size(),
+                                    digitAtlas(config.lineNumberCurrentFormat.foreground, Qt::transparent));
+    }
 }
 
 void TextEditor::lineNumberAreaMouseEvent(QMouseEvent *event)
@@ -1175,21 +1932,24 @@ void TextEditor::columnNumberAreaPaintEvent(QPaintEvent *event)
     }
 
     /* 番号 */
+    QVector<QPainter::PixmapFragment> numbers;
     left = document()->documentMargin() + columnNumberOffset;
     right = left + fontWidth;
     while (left <= event->rect().right()) {
         if (right >= event->rect().left()) {
             int columnNumber = (left - columnNumberOffset) / fontWidth;
             if (columnNumber % 10 == 0) {
-                QRectF bounding = painter.boundingRect(QRectF(left + fontWidth * 0.5, 0, 0, 0), QString::number(columnNumber));
-                painter.fillRect(bounding, config.columnNumberFormat.background);
-                painter.drawText(bounding, QString::number(columnNumber));
+                appendDigitFragments(numbers, columnNumber, left + fontWidth * 0.5 + digitsWidth(columnNumber), 0);
             }
         }
 
         left = right;
         right = left + fontWidth;
     }
+    if (!numbers.isEmpty()) {
+        painter.drawPixmapFragments(numbers.constData(), numbers.size(),
+                                    digitAtlas(config.columnNumberFormat.foreground, config.columnNumberFormat.background));
+    }
 
     if (config.columnNumberCurrentFormat.enabled) {
         const QRect &cr = cursorRect();
@@ -1336,6 +2096,7 @@ TextEditor::Config TextEditor::configs(const  QString &key)
     config.defTextCodecName = settings.value("defTextCodecName", "System").toByteArray();
     config.useUtf8Bom = settings.value("useUtf8Bom", true).toBool();
     config.defNewLineCode = settings.value("defNewLineCode", NewLineCodeCRLF).value<NewLineCode>();
+    config.largeFileSize = settings.value("largeFileSize", 256).toInt();
     config.basicFormat = settings.value("basicFormat", QVariant::fromValue(TextFormat(tr("基本"), true, "#000000", "#ffffff"))).value<TextFormat>();
     config.stripeFormat = settings.value("stripeFormat", QVariant::fromValue(TextFormat(tr("ストライプ"), false, "transparent", "#f7f7f7"))).value<TextFormat>();
     config.lineNumberFormat = settings.value("lineNumberFormat", QVariant::fromValue(TextFormat(tr("行番号"), true, "#A0A0A0", "#F0F0F0"))).value<TextFormat>();
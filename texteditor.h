@@ -2,9 +2,16 @@
 #define TEXTEDITOR_H
 
 #include <QCoreApplication>
+#include <QPainter>
 #include <QPlainTextEdit>
+#include <QTextBlock>
 
+class AtomicFile;
 class Highlighter;
+class LineIndex;
+class QFile;
+class QScrollBar;
+class QTextLayout;
 
 class TextEditor : public QPlainTextEdit
 {
@@ -17,6 +24,13 @@ public:
         NewLineCodeUnknown
     } NewLineCode;
 
+    typedef enum tagDirtyArea {
+        DirtyGutter = 1,                    // 行番号
+        DirtyRuler = 2,                     // 列番号
+        DirtyViewport = 4,                  // 表示領域全体
+        DirtyOverlay = 8                    // 表示領域の一部(現在行・現在列)
+    } DirtyArea;
+
     typedef struct tagOpenedData {
         QByteArray textCodecForName;
         int column;
@@ -91,6 +105,7 @@ public:
         QByteArray defTextCodecName;                // デフォルト文字コード
         bool useUtf8Bom;                            // UTF-8 BOM付き
         NewLineCode defNewLineCode;                 // デフォルト改行コード
+        int largeFileSize;                          // ビューアモード切替サイズ(MB)
         TextFormat basicFormat;                     // 基本色
         TextFormat stripeFormat;                    // ストライプ
         TextFormat lineNumberFormat;                // 行番号
@@ -113,6 +128,7 @@ public:
 
 public:
     explicit TextEditor(QWidget *parent = 0);
+    ~TextEditor();
     void newFile();
     bool openFile(const QString &fileName);
     bool save();
@@ -124,9 +140,15 @@ public:
     QString currentFile() const { return filePath; }
     QString strippedName(const QString &fullFileName);
     bool isUntitled() const { return untitled; }
+    bool isViewerMode() const { return lineIndex != 0; }
     bool loadFile(const QString &fileName, QTextCodec *textCodec);
     OpenedData openedData(QString filePath);
     void setCursorForLineNumber(int line);
+    void setCursorForPosition(int line, int column);
+    void setCursorForOffset(qint64 offset);
+    int replaceAll(const QString &before, const QString &after, const KeywordOption &option, bool inSelection);
+    int countMatches(const QString &before, const KeywordOption &option) const;
+    static QString replacementText(const QRegExp &regexp, const QString &after, bool regularExpression);
     int cursorForLineNumber() const;
     int cursorForColumnNumber() const;
     void setTextCodecForName(QString codec);
@@ -137,6 +159,7 @@ public:
     const QByteArray newLineCodeText();
     QVector<int> findwordMatchLines(int index) const;
     int findwordsCount(int index) const;
+    bool isHighlightFinished() const;
     void updateConfig(const int &index);
     void updateConfig(const QString &key);
     void updateConfig();
@@ -189,6 +212,9 @@ public slots:
     void updateColumnNumberArea(const QRect &, int);
     void updateArea(const QRect &rect, int);
 
+private slots:
+    void setViewerTopLine(int line);
+
 protected:
     void closeEvent(QCloseEvent *event);
     void mousePressEvent(QMouseEvent *event);
@@ -218,11 +244,35 @@ public:
     static Config configs(const int &index);
     static Config configs(const QString &key);
 
+private:
+    bool loadFile(QFile &file, QTextCodec *textCodec);
+    bool readFile(QFile &file, QTextCodec *textCodec);
+    bool writeFile(AtomicFile &file);
+    QTextCodec *saveCodec() const;
+    int saveBomSize(QTextCodec *codec) const;
+    bool loadLargeFile(const QString &fileName, QTextCodec *textCodec);
+    void closeViewer();
+    void fillViewer(int cursorLine, int column);
+    int viewerLineCount();
+    void updateViewerScrollBar();
+    void updateViewerGeometry();
+    void updateHighlightViewport();
+    void drawMarkers(QPainter &painter, const QTextLayout *layout, const QPointF &origin,
+                     const QVector<int> &positions, const QString &marker, const TextFormat &format);
+    QPixmap glyphPixmap(const QString &text, const QColor &foreground, const QColor &background);
+    QPixmap digitAtlas(const QColor &foreground, const QColor &background);
+    void appendDigitFragments(QVector<QPainter::PixmapFragment> &fragments, int number, qreal right, qreal top);
+    int digitsWidth(int number) const;
+    void clearGlyphCache();
+    void invalidate(int areas, const QRect &rect = QRect());
+    void flushInvalidation();
+
 signals:
     void untitledChanged(bool);
     void mouseClickRequest(QMouseEvent *);
     void mouseDoubleClickRequest(QMouseEvent *);
-
+    void highlightFinished();
+    void loadingChanged(QTextDocument *document, bool loading);
 
 private:
     Config config;
@@ -237,6 +287,15 @@ private:
     QWidget *columnNumberArea;
     Highlighter *highlighter;
     NewLineCode new_line_code;
+    LineIndex *lineIndex;
+    QScrollBar *viewerScrollBar;
+    int viewerTopLine;
+    QHash<QString, QPixmap> glyphCache;         // 記号・数字の画像
+    int digitWidths[10];                        // 数字毎の幅
+    int digitCellWidth;                         // 数字の画像の1文字分の幅
+    int dirtyAreas;                             // 再描画が必要な領域(DirtyArea)
+    QRegion dirtyOverlayRegion;                 // 再描画が必要な表示領域の一部
+    int configBatchDepth;                       // 設定の反映中(再描画要求をまとめる)
 };
 
 Q_DECLARE_METATYPE(TextEditor::FormatOption)
@@ -0,0 +1,687 @@
+#include "trigramindex.h"
+#include "atomicfile.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QtConcurrentMap>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+const char INDEX_MAGIC[4] = { 'K', 'T', 'G', 'X' };
+const quint32 INDEX_VERSION = 1;
+
+/*
+ * 索引ファイルの構成
+ *   IndexHeader
+ *   IndexFile[fileCount]            (相対パス順)
+ *   IndexTrigram[trigramCount]      (トライグラム順)
+ *   quint32[postingCount]           (トライグラム毎のファイル番号、昇順)
+ *   char[stringsSize]               (相対パス、UTF-8)
+ */
+typedef struct tagIndexHeader {
+    char magic[4];
+    quint32 version;
+    quint32 fileCount;
+    quint32 trigramCount;
+    quint32 postingCount;
+    quint32 stringsSize;
+} IndexHeader;
+
+typedef struct tagIndexFile {
+    qint64 size;
+    qint64 modified;
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint32 flags;
+    quint32 reserved;
+} IndexFile;
+
+typedef struct tagIndexTrigram {
+    quint32 trigram;
+    quint32 postingBegin;                   // 次の要素の postingBegin(末尾は postingCount)までが一覧
+} IndexTrigram;
+
+typedef struct tagFileStat {
+    QString path;                           // 相対パス
+    qint64 size;
+    qint64 modified;
+} FileStat;
+
+class StatLess
+{
+public:
+    bool operator()(const FileStat &a, const FileStat &b) const { return a.path < b.path; }
+};
+
+bool isCancelled(QAtomicInt *cancelled)
+{
+    return cancelled && cancelled->fetchAndAddOrdered(0) != 0;
+}
+
+/**
+ * 対象ファイルの一覧を相対パス順に作成する(隠しファイルとシンボリックリンクのディレクトリは除く)
+ */
+bool scanFiles(const QString &rootPath, QVector<FileStat> &stats, QAtomicInt *cancelled)
+{
+    const QDir dir(rootPath);
+    QDirIterator it(rootPath, QDir::Files | QDir::NoDotAndDotDot | QDir::Readable, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (isCancelled(cancelled)) {
+            return false;
+        }
+        const QString filePath = it.next();
+        const QFileInfo info = it.fileInfo();
+        FileStat stat;
+        stat.path = dir.relativeFilePath(filePath);
+        stat.size = info.size();
+        stat.modified = info.lastModified().toMSecsSinceEpoch();
+        stats.append(stat);
+    }
+    std::sort(stats.begin(), stats.end(), StatLess());
+    return true;
+}
+
+inline uchar fold(uchar c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+inline bool isLineBreak(uchar c)
+{
+    return c == '\n' || c == '\r';
+}
+
+const IndexHeader *headerOf(const uchar *data)
+{
+    return reinterpret_cast<const IndexHeader *>(data);
+}
+
+const IndexFile *filesOf(const uchar *data)
+{
+    return reinterpret_cast<const IndexFile *>(data + sizeof(IndexHeader));
+}
+
+const IndexTrigram *trigramsOf(const uchar *data)
+{
+    return reinterpret_cast<const IndexTrigram *>(filesOf(data) + headerOf(data)->fileCount);
+}
+
+const quint32 *postingsOf(const uchar *data)
+{
+    return reinterpret_cast<const quint32 *>(trigramsOf(data) + headerOf(data)->trigramCount);
+}
+
+const char *stringsOf(const uchar *data)
+{
+    return reinterpret_cast<const char *>(postingsOf(data) + headerOf(data)->postingCount);
+}
+
+class TrigramLess
+{
+public:
+    bool operator()(const IndexTrigram &entry, quint32 trigram) const { return entry.trigram < trigram; }
+};
+
+/* あいまい検索の候補(点数の高い順、同点はファイル番号順) */
+class ScoreGreater
+{
+public:
+    bool operator()(const QPair<int, int> &a, const QPair<int, int> &b) const
+    {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    }
+};
+
+/**
+ * パターンの文字を順に含むか調べ、一致の良さを点数にする(含まない場合は-1)
+ * 連続した一致・区切り文字の直後の一致・ファイル名部分での一致を高く評価する
+ */
+int fuzzyScore(const QString &path, const QString &pattern)
+{
+    const int nameBegin = path.lastIndexOf(QLatin1Char('/')) + 1;
+    int score = 0;
+    int previous = -2;
+    int p = 0;
+    for (int i = 0; i < path.size() && p < pattern.size(); ++i) {
+        if (path.at(i).toLower() != pattern.at(p)) {
+            continue;
+        }
+        score += 1;
+        if (i == previous + 1) {
+            score += 5;
+        }
+        if (i == 0 || path.at(i - 1) == QLatin1Char('/') || path.at(i - 1) == QLatin1Char('_')
+                || path.at(i - 1) == QLatin1Char('.') || path.at(i - 1) == QLatin1Char('-')) {
+            score += 4;
+        }
+        if (i >= nameBegin) {
+            score += 3;
+        }
+        previous = i;
+        ++p;
+    }
+    if (p < pattern.size()) {
+        return -1;
+    }
+    return score * 64 - path.size();
+}
+
+}
+
+TrigramIndex::TrigramIndex()
+    : indexData(0)
+{
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    close();
+}
+
+/**
+ * ディレクトリの索引ファイルをメモリマップする(作成されていない場合も対象のディレクトリは設定する)
+ * 内容はディスクと一致しているとは限らないため、最新にする場合は update() を呼ぶ
+ */
+bool TrigramIndex::open(const QString &dirPath)
+{
+    close();
+    rootPath = QDir(dirPath).absolutePath();
+    return mapIndex(indexFileName(rootPath));
+}
+
+/**
+ * ディレクトリを走査して索引と比較する(ファイルの一覧・サイズ・更新日時を比較する、内容は読まない)
+ * current には索引のファイル番号毎に変わっていないか、changed には追加・変更されたファイルの相対パスを設定する
+ * 削除されたファイルは current が偽になる。いずれかが変わった場合は update() で索引を作り直せる。
+ */
+bool TrigramIndex::compareFiles(QVector<bool> &current, QStringList &changed, QAtomicInt *cancelled) const
+{
+    current.clear();
+    changed.clear();
+    if (!isOpen()) {
+        return false;
+    }
+    QVector<FileStat> stats;
+    if (!scanFiles(rootPath, stats, cancelled)) {
+        return false;
+    }
+
+    /* どちらも相対パス順のため、先頭から突き合わせる */
+    const int count = fileCount();
+    const IndexFile *files = count > 0 ? filesOf(indexData) : 0;
+    current.fill(false, count);
+    int id = 0;
+    QString indexPath = count > 0 ? relativeFilePath(0) : QString();
+    foreach (const FileStat &stat, stats) {
+        while (id < count && indexPath < stat.path) {
+            ++id;                           // 削除されたファイル
+            indexPath = id < count ? relativeFilePath(id) : QString();
+        }
+        if (id < count && indexPath == stat.path
+                && files[id].size == stat.size && files[id].modified == stat.modified) {
+            current[id] = true;
+        } else {
+            changed << stat.path;
+        }
+        if (id < count && indexPath == stat.path) {
+            ++id;
+            indexPath = id < count ? relativeFilePath(id) : QString();
+        }
+    }
+    return true;
+}
+
+/**
+ * ディレクトリを走査し、サイズ・更新日時が変わったファイルだけ読み直して索引ファイルを作り直す
+ * 変わったファイルのトライグラムは一定数ずつ複数のスレッドで集め、すぐにトライグラム毎の一覧へ移す
+ * (全ファイルのトライグラムを同時に保持しない)
+ */
+bool TrigramIndex::update(QAtomicInt *cancelled)
+{
+    if (rootPath.isEmpty()) {
+        return false;
+    }
+    QVector<FileStat> stats;
+    if (!scanFiles(rootPath, stats, cancelled)) {
+        return false;
+    }
+
+    /* 前回の索引と比較する */
+    const QDir dir(rootPath);
+    QHash<QString, int> previousIds;
+    const int previousCount = fileCount();
+    for (int i = 0; i < previousCount; ++i) {
+        previousIds.insert(relativeFilePath(i), i);
+    }
+    QVector<int> reused(previousCount, -1);     // 前回のファイル番号 → 今回のファイル番号
+    QVector<quint32> flags(stats.size(), 0);
+    QStringList changedPaths;
+    QVector<int> changedIds;
+    for (int i = 0; i < stats.size(); ++i) {
+        const int previous = previousIds.value(stats.at(i).path, -1);
+        if (previous >= 0) {
+            const IndexFile &entry = filesOf(indexData)[previous];
+            if (entry.size == stats.at(i).size && entry.modified == stats.at(i).modified) {
+                reused[previous] = i;
+                flags[i] = entry.flags;
+                continue;
+            }
+        }
+        changedPaths.append(dir.absoluteFilePath(stats.at(i).path));
+        changedIds.append(i);
+    }
+    if (changedPaths.isEmpty() && stats.size() == previousCount) {
+        return true;
+    }
+
+    /*
+     * トライグラム毎のファイル番号の一覧
+     * 変わっていないファイルは前回の索引から復元する(前回・今回ともファイル番号は相対パス順なので昇順に追加される)
+     */
+    QHash<quint32, QVector<quint32> > lists;
+    if (isOpen()) {
+        const IndexHeader *header = headerOf(indexData);
+        const IndexTrigram *trigrams = trigramsOf(indexData);
+        const quint32 *postingData = postingsOf(indexData);
+        for (quint32 t = 0; t < header->trigramCount; ++t) {
+            const quint32 end = t + 1 < header->trigramCount ? trigrams[t + 1].postingBegin : header->postingCount;
+            for (quint32 p = trigrams[t].postingBegin; p < end; ++p) {
+                const int id = reused.at(postingData[p]);
+                if (id >= 0) {
+                    lists[trigrams[t].trigram].append(id);
+                }
+            }
+        }
+    }
+
+    /* 変わったファイルは UPDATE_BATCH_FILES ずつ読み、中止された場合は読み込み中のファイルだけ待って終える */
+    for (int begin = 0; begin < changedPaths.size(); begin += UPDATE_BATCH_FILES) {
+        const QStringList batch = changedPaths.mid(begin, UPDATE_BATCH_FILES);
+        QFuture<FileTrigrams> future = QtConcurrent::mapped(batch, &TrigramIndex::fileTrigrams);
+        for (int i = 0; i < batch.size(); ++i) {
+            if (isCancelled(cancelled)) {
+                future.cancel();
+                future.waitForFinished();
+                return false;
+            }
+            const FileTrigrams result = future.resultAt(i);
+            const int id = changedIds.at(begin + i);
+            flags[id] = result.flags;
+            foreach (quint32 trigram, result.trigrams) {
+                lists[trigram].append(id);
+            }
+        }
+    }
+    if (isCancelled(cancelled)) {
+        return false;
+    }
+
+    /* 変わったファイルの番号は後から追加したため並べ直す */
+    quint32 postingCount = 0;
+    for (QHash<quint32, QVector<quint32> >::iterator it = lists.begin(); it != lists.end(); ++it) {
+        if (!changedIds.isEmpty() && !reused.isEmpty()) {
+            std::sort(it.value().begin(), it.value().end());
+        }
+        postingCount += it.value().size();
+    }
+    QList<quint32> keys = lists.keys();
+    std::sort(keys.begin(), keys.end());
+
+    QByteArray strings;
+    QVector<IndexFile> entries(stats.size());
+    for (int i = 0; i < stats.size(); ++i) {
+        const QByteArray path = stats.at(i).path.toUtf8();
+        entries[i].size = stats.at(i).size;
+        entries[i].modified = stats.at(i).modified;
+        entries[i].pathOffset = strings.size();
+        entries[i].pathLength = path.size();
+        entries[i].flags = flags.at(i);
+        entries[i].reserved = 0;
+        strings += path;
+    }
+    QVector<IndexTrigram> trigrams(keys.size());
+    quint32 postingBegin = 0;
+    for (int i = 0; i < keys.size(); ++i) {
+        trigrams[i].trigram = keys.at(i);
+        trigrams[i].postingBegin = postingBegin;
+        postingBegin += lists.value(keys.at(i)).size();
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.fileCount = entries.size();
+    header.trigramCount = trigrams.size();
+    header.postingCount = postingCount;
+    header.stringsSize = strings.size();
+
+    const QString fileName = indexFileName(rootPath);
+    QDir().mkpath(QFileInfo(fileName).path());
+    AtomicFile file(fileName);
+    if (!file.open()
+            || !file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(&header), sizeof(header)))
+            || !file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(IndexFile)))
+            || !file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(trigrams.constData()), trigrams.size() * sizeof(IndexTrigram)))) {
+        error = file.errorString();
+        return false;
+    }
+    /* ファイル番号の一覧は書き込んだものから解放する */
+    foreach (quint32 key, keys) {
+        const QVector<quint32> list = lists.take(key);
+        if (!file.write(QByteArray::fromRawData(reinterpret_cast<const char *>(list.constData()), list.size() * sizeof(quint32)))) {
+            error = file.errorString();
+            return false;
+        }
+    }
+
+    /* 置き換える前にマップを解除する(開いたままでは置き換えられない環境がある) */
+    unmapIndex();
+    if (!file.write(strings) || !file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return mapIndex(fileName);
+}
+
+void TrigramIndex::close()
+{
+    unmapIndex();
+    rootPath.clear();
+}
+
+int TrigramIndex::fileCount() const
+{
+    return isOpen() ? headerOf(indexData)->fileCount : 0;
+}
+
+QString TrigramIndex::relativeFilePath(int id) const
+{
+    const IndexFile &entry = filesOf(indexData)[id];
+    return QString::fromUtf8(stringsOf(indexData) + entry.pathOffset, entry.pathLength);
+}
+
+QString TrigramIndex::filePath(int id) const
+{
+    return rootPath + QLatin1Char('/') + relativeFilePath(id);
+}
+
+/**
+ * 検索文字列を含む可能性のあるファイルの番号を返す(バイナリファイルは除く)
+ * literals には検索文字列を文字コード毎にエンコードしたバイト列を渡し、いずれかのトライグラムを全て含むファイルを候補にする
+ */
+QVector<int> TrigramIndex::candidates(const QList<QByteArray> &literals) const
+{
+    const int count = fileCount();
+    QVector<bool> selected(count, false);
+
+    foreach (const QByteArray &literal, literals) {
+        const QVector<quint32> trigrams = literalTrigrams(literal);
+        if (trigrams.isEmpty()) {
+            selected.fill(true);
+            break;
+        }
+
+        /* 短い一覧から順に積集合を求める */
+        QVector<QPair<int, quint32> > lists;
+        bool missing = false;
+        foreach (quint32 trigram, trigrams) {
+            const quint32 *begin;
+            const quint32 *end;
+            if (!postings(trigram, &begin, &end)) {
+                missing = true;
+                break;
+            }
+            lists.append(qMakePair(static_cast<int>(end - begin), trigram));
+        }
+        if (missing) {
+            continue;
+        }
+        std::sort(lists.begin(), lists.end());
+
+        const quint32 *begin;
+        const quint32 *end;
+        postings(lists.first().second, &begin, &end);
+        QVector<quint32> result(static_cast<int>(end - begin));
+        std::copy(begin, end, result.begin());
+        QVector<quint32> intersection;
+        for (int i = 1; i < lists.size() && !result.isEmpty(); ++i) {
+            postings(lists.at(i).second, &begin, &end);
+            intersection.resize(result.size());
+            QVector<quint32>::iterator last = std::set_intersection(result.begin(), result.end(), begin, end, intersection.begin());
+            intersection.resize(last - intersection.begin());
+            result.swap(intersection);
+        }
+        foreach (quint32 id, result) {
+            selected[id] = true;
+        }
+    }
+
+    QVector<int> ids;
+    const IndexFile *files = count > 0 ? filesOf(indexData) : 0;
+    for (int i = 0; i < count; ++i) {
+        if (files[i].flags & FLAG_BINARY) {
+            continue;
+        }
+        if (selected.at(i) || (files[i].flags & FLAG_UNINDEXED)) {
+            ids.append(i);
+        }
+    }
+    return ids;
+}
+
+/**
+ * 索引に記録したファイルの相対パスの一覧
+ */
+QStringList TrigramIndex::relativeFilePaths() const
+{
+    QStringList paths;
+    const int count = fileCount();
+    for (int i = 0; i < count; ++i) {
+        paths.append(relativeFilePath(i));
+    }
+    return paths;
+}
+
+/**
+ * ディレクトリのファイルの相対パスの一覧(ファイル名だけを走査し、内容は読まない)
+ */
+QStringList TrigramIndex::listFiles(const QString &dirPath, QAtomicInt *cancelled)
+{
+    QVector<FileStat> stats;
+    QStringList paths;
+    if (scanFiles(QDir(dirPath).absolutePath(), stats, cancelled)) {
+        foreach (const FileStat &stat, stats) {
+            paths.append(stat.path);
+        }
+    }
+    return paths;
+}
+
+/**
+ * ファイル名のあいまい検索(パターンの文字を順に含むファイルの番号を一致の良い順に返す)
+ */
+QVector<int> TrigramIndex::findFiles(const QStringList &paths, const QString &pattern, int limit)
+{
+    const QString key = QDir::fromNativeSeparators(pattern).toLower();
+    QVector<QPair<int, int> > scores;
+    for (int i = 0; i < paths.size(); ++i) {
+        const int score = fuzzyScore(paths.at(i), key);
+        if (score >= 0 || key.isEmpty()) {
+            scores.append(qMakePair(score, i));
+        }
+    }
+    const int size = qMin(limit, scores.size());
+    std::partial_sort(scores.begin(), scores.begin() + size, scores.end(), ScoreGreater());
+
+    QVector<int> ids;
+    for (int i = 0; i < size; ++i) {
+        ids.append(scores.at(i).second);
+    }
+    return ids;
+}
+
+/**
+ * ファイルのトライグラムを集める(改行を含む並びは検索文字列に現れないため除く)
+ */
+TrigramIndex::FileTrigrams TrigramIndex::fileTrigrams(const QString &filePath)
+{
+    FileTrigrams result;
+    result.flags = 0;
+
+    QFile file(filePath);
+    if (!file.open(QFile::ReadOnly)) {
+        result.flags = FLAG_UNINDEXED;
+        return result;
+    }
+    const qint64 fileSize = file.size();
+    if (fileSize > MAX_INDEX_FILE_SIZE) {
+        result.flags = FLAG_UNINDEXED;
+        return result;
+    }
+    if (fileSize < 3) {
+        return result;
+    }
+
+    QByteArray buffer;
+    const uchar *data = file.map(0, fileSize);
+    qint64 size = fileSize;
+    if (!data) {
+        buffer = file.readAll();
+        data = reinterpret_cast<const uchar *>(buffer.constData());
+        size = buffer.size();
+    }
+    if (memchr(data, 0, qMin<qint64>(size, BINARY_CHECK_SIZE))) {
+        result.flags = FLAG_BINARY;
+        return result;
+    }
+
+    if (size > BITMAP_FILE_SIZE) {
+        /* 大きいファイルは全てのトライグラムのビット表で重複を除く */
+        QVector<quint32> bitmap(1 << 19, 0);
+        for (qint64 i = 2; i < size; ++i) {
+            if (isLineBreak(data[i - 2]) || isLineBreak(data[i - 1]) || isLineBreak(data[i])) {
+                continue;
+            }
+            const quint32 trigram = (fold(data[i - 2]) << 16) | (fold(data[i - 1]) << 8) | fold(data[i]);
+            bitmap[trigram >> 5] |= 1u << (trigram & 31);
+        }
+        for (int i = 0; i < bitmap.size(); ++i) {
+            for (quint32 bits = bitmap.at(i); bits; bits &= bits - 1) {
+                int bit = 0;
+                while (!(bits & (1u << bit))) {
+                    ++bit;
+                }
+                result.trigrams.append((i << 5) | bit);
+            }
+        }
+        return result;
+    }
+
+    result.trigrams.reserve(static_cast<int>(size));
+    for (qint64 i = 2; i < size; ++i) {
+        if (isLineBreak(data[i - 2]) || isLineBreak(data[i - 1]) || isLineBreak(data[i])) {
+            continue;
+        }
+        result.trigrams.append((fold(data[i - 2]) << 16) | (fold(data[i - 1]) << 8) | fold(data[i]));
+    }
+    std::sort(result.trigrams.begin(), result.trigrams.end());
+    result.trigrams.erase(std::unique(result.trigrams.begin(), result.trigrams.end()), result.trigrams.end());
+    result.trigrams.squeeze();
+    return result;
+}
+
+/**
+ * 検索文字列のトライグラム(昇順、3バイト未満の場合は空)
+ */
+QVector<quint32> TrigramIndex::literalTrigrams(const QByteArray &literal)
+{
+    QVector<quint32> trigrams;
+    const uchar *data = reinterpret_cast<const uchar *>(literal.constData());
+    for (int i = 2; i < literal.size(); ++i) {
+        trigrams.append((fold(data[i - 2]) << 16) | (fold(data[i - 1]) << 8) | fold(data[i]));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+/**
+ * 索引ファイル名(キャッシュディレクトリ内、ディレクトリのパスのハッシュ値)
+ */
+QString TrigramIndex::indexFileName(const QString &dirPath)
+{
+    const QByteArray hash = QCryptographicHash::hash(QDir(dirPath).absolutePath().toUtf8(),
+                                                     QCryptographicHash::Md5).toHex();
+    return QDesktopServices::storageLocation(QDesktopServices::CacheLocation)
+            + "/trigram/" + QString::fromLatin1(hash) + ".idx";
+}
+
+bool TrigramIndex::mapIndex(const QString &indexFileName)
+{
+    indexFile.setFileName(indexFileName);
+    if (!indexFile.open(QFile::ReadOnly)) {
+        error = indexFile.errorString();
+        return false;
+    }
+    const qint64 size = indexFile.size();
+    if (size < static_cast<qint64>(sizeof(IndexHeader))) {
+        indexFile.close();
+        return false;
+    }
+    indexData = indexFile.map(0, size);
+    if (!indexData) {
+        error = indexFile.errorString();
+        indexFile.close();
+        return false;
+    }
+
+    const IndexHeader *header = headerOf(indexData);
+    const qint64 expected = sizeof(IndexHeader)
+            + static_cast<qint64>(header->fileCount) * sizeof(IndexFile)
+            + static_cast<qint64>(header->trigramCount) * sizeof(IndexTrigram)
+            + static_cast<qint64>(header->postingCount) * sizeof(quint32)
+            + header->stringsSize;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 || header->version != INDEX_VERSION
+            || size != expected) {
+        unmapIndex();
+        return false;
+    }
+    return true;
+}
+
+void TrigramIndex::unmapIndex()
+{
+    if (indexData) {
+        indexFile.unmap(const_cast<uchar *>(indexData));
+        indexData = 0;
+    }
+    if (indexFile.isOpen()) {
+        indexFile.close();
+    }
+}
+
+/**
+ * トライグラムを含むファイル番号の一覧を二分探索で求める
+ */
+bool TrigramIndex::postings(quint32 trigram, const quint32 **begin, const quint32 **end) const
+{
+    if (!isOpen()) {
+        return false;
+    }
+    const IndexHeader *header = headerOf(indexData);
+    const IndexTrigram *trigrams = trigramsOf(indexData);
+    const IndexTrigram *found = std::lower_bound(trigrams, trigrams + header->trigramCount, trigram, TrigramLess());
+    if (found == trigrams + header->trigramCount || found->trigram != trigram) {
+        return false;
+    }
+    const quint32 *postingData = postingsOf(indexData);
+    *begin = postingData + found->postingBegin;
+    *end = postingData + (found + 1 < trigrams + header->trigramCount ? (found + 1)->postingBegin : header->postingCount);
+    return true;
+}
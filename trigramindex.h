@@ -0,0 +1,72 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * ディレクトリ内のファイルのトライグラム索引
+ *
+ * ファイル毎に含まれる3バイトの並び(ASCIIの英字は小文字に揃える)を集め、トライグラム毎のファイル番号の一覧を
+ * キャッシュディレクトリの索引ファイルに保存してメモリマップする。検索文字列の全てのトライグラムを含むファイルだけを
+ * Grepの候補にする。索引ファイルには各ファイルのサイズと更新日時を記録し、update() で変わったファイルだけ読み直す。
+ * 検索時は compareFiles() で変わっていないファイルだけ索引の候補を使い、変わったファイルは直接検索する。ファイル名のあいまい検索は listFiles() の一覧に対して行う。
+ */
+class TrigramIndex
+{
+public:
+    enum {
+        MAX_INDEX_FILE_SIZE = 64 * 1024 * 1024,     // これより大きいファイルは索引を作らず常に候補にする
+        BINARY_CHECK_SIZE = 8000,                   // NULを含む場合はバイナリとして候補から除く
+        BITMAP_FILE_SIZE = 1024 * 1024,             // これより大きいファイルはビット表でトライグラムを集める
+        UPDATE_BATCH_FILES = 256                    // 更新時に一度に読むファイル数
+    };
+
+    enum FILE_FLAG {
+        FLAG_BINARY = 1,
+        FLAG_UNINDEXED = 2
+    };
+
+    typedef struct tagFileTrigrams {
+        QVector<quint32> trigrams;          // 昇順
+        quint32 flags;
+    } FileTrigrams;
+
+public:
+    TrigramIndex();
+    ~TrigramIndex();
+    bool open(const QString &dirPath);
+    bool compareFiles(QVector<bool> &current, QStringList &changed, QAtomicInt *cancelled = 0) const;
+    bool update(QAtomicInt *cancelled = 0);
+    void close();
+    bool isOpen() const { return indexData != 0; }
+    QString dirPath() const { return rootPath; }
+    QString errorString() const { return error; }
+    int fileCount() const;
+    QString relativeFilePath(int id) const;
+    QString filePath(int id) const;
+    QVector<int> candidates(const QList<QByteArray> &literals) const;
+    QStringList relativeFilePaths() const;
+    static QStringList listFiles(const QString &dirPath, QAtomicInt *cancelled = 0);
+    static QVector<int> findFiles(const QStringList &paths, const QString &pattern, int limit);
+    static FileTrigrams fileTrigrams(const QString &filePath);
+    static QVector<quint32> literalTrigrams(const QByteArray &literal);
+    static QString indexFileName(const QString &dirPath);
+
+private:
+    bool mapIndex(const QString &indexFileName);
+    void unmapIndex();
+    bool postings(quint32 trigram, const quint32 **begin, const quint32 **end) const;
+
+private:
+    QString rootPath;
+    QFile indexFile;
+    const uchar *indexData;
+    QString error;
+};
+
+#endif // TRIGRAMINDEX_H